@@ -0,0 +1,43 @@
+# -*- autoconf -*-
+# -----------------------------------------------------------------------------
+# Usage: AX_ARG_WITH_FBM(option-name, DEFINE_PREFIX, default, description)
+#
+# Add an option --with-OPTION-NAME=OCTAVES:LOWER:UPPER for the
+# parameters of an fBM noise, and define DEFINE_PREFIX_OCTAVES,
+# DEFINE_PREFIX_LOWER_BOUND, and DEFINE_PREFIX_UPPER_BOUND. OCTAVES
+# must be 3 or 6 as only they have unrolled versions of the noise.
+# -----------------------------------------------------------------------------
+AC_DEFUN([AX_ARG_WITH_FBM],
+[
+    AC_REQUIRE([AC_PROG_AWK])
+    AC_ARG_WITH(
+        [$1],
+        [AS_HELP_STRING(
+             [--with-$1=OCTAVES:LOWER:UPPER],
+             [octaves and bounds of the noise for $4 @<:@default: $3@:>@])])
+    AS_VAR_PUSHDEF([ax_fbm], [with_]m4_translit([$1], [-], [_]))
+    AS_CASE(
+        [$ax_fbm],
+        ["yes"|""],                 [ax_fbm=$3],
+        [*[[!0-9.:]]*|*:*:*:*],     [ax_fbm=invalid],
+        [[[36]]:*.*:*.*],           [],
+        [ax_fbm=invalid])
+    AS_IF([test x"$ax_fbm" = xinvalid],
+          [AC_MSG_ERROR([Invalid --with-$1. It must be OCTAVES:LOWER:UPPER where OCTAVES is 3 or 6, and the bounds are decimal numbers such as 0.5.])])
+    ax_fbm_octaves=`echo "$ax_fbm" | cut -d: -f1`
+    ax_fbm_lower=`echo "$ax_fbm" | cut -d: -f2`
+    ax_fbm_upper=`echo "$ax_fbm" | cut -d: -f3`
+    AS_IF([$AWK -v l="$ax_fbm_lower" -v u="$ax_fbm_upper" 'BEGIN { exit !(0 <= l && l < u && u <= 1) }'],
+          [],
+          [AC_MSG_ERROR([Invalid --with-$1. The bounds must satisfy 0 <= LOWER < UPPER <= 1.])])
+    AS_VAR_POPDEF([ax_fbm])
+    AC_DEFINE_UNQUOTED(
+        [$2_OCTAVES], [$ax_fbm_octaves],
+        [Define to the number of octaves of the noise for $4, either 3 or 6.])
+    AC_DEFINE_UNQUOTED(
+        [$2_LOWER_BOUND], [$ax_fbm_lower],
+        [Define to the value of the noise for $4 at and below which it has no effect.])
+    AC_DEFINE_UNQUOTED(
+        [$2_UPPER_BOUND], [$ax_fbm_upper],
+        [Define to the value of the noise for $4 at and above which it has the full effect. The noise stops adding octaves as soon as it's known to be outside of the bounds, so narrower bounds make it cheaper.])
+])
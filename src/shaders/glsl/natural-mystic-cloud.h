@@ -4,24 +4,65 @@
 
 #include "natural-mystic-noise.h"
 
-/* Generate a pattern of clouds based on a world position. */
-highp float cloudMap(int octaves, float lowerBound, float upperBound, highp float time, highp vec3 pos) {
+/* The resolution of the cloud noise in the world space. */
+const highp vec2 cloudResolution = vec2(1.4, 1.4);
+
+/* We intentionally throw away some of the precision so we get
+ * somewhat sparse noise.
+ */
+const highp float cloudSparseness = 3.0;
+
+/* Translate a world position into the st space of the cloud noise. */
+highp vec2 cloudCoords(highp float time, highp vec3 pos) {
     /* Use of highp is essential here, as the uniform
      * TOTAL_REAL_WORLD_TIME in mediump starts to lose precision
      * within 10 minutes.
      */
-    const highp vec2 resolution = vec2(1.4, 1.4);
-
-    highp vec2 st = pos.xz / resolution;
+    highp vec2 st = pos.xz / cloudResolution;
     /* The inverse of the speed (512) should be a power of two in
      * order to avoid a precision loss.
      */
     st.y += time / 512.0;
 
-    /* We intentionally throw away some
-     * of the precision so we get somewhat sparse noise.
-     */
-    return fBM(octaves, lowerBound, upperBound, st * 3.0);
+    return st * cloudSparseness;
+}
+
+/* Generate a pattern of clouds based on a world position, with 3 or
+ * 6 octaves. See fBM3() and fBM6().
+ */
+highp float cloudMap3(float lowerBound, float upperBound, highp float time, highp vec3 pos) {
+    return fBM3(lowerBound, upperBound, cloudCoords(time, pos));
+}
+
+highp float cloudMap6(float lowerBound, float upperBound, highp float time, highp vec3 pos) {
+    return fBM6(lowerBound, upperBound, cloudCoords(time, pos));
+}
+
+/* The size of a pixel in the st space of the cloud noise, given its
+ * size in the world space. */
+highp float cloudFootprint(highp float footprint) {
+    return footprint * cloudSparseness / cloudResolution.x;
+}
+
+/* Generate a band-limited pattern of clouds based on a world
+ * position. "footprint" is the size of a pixel in the world space,
+ * usually obtained with fwidth(pos.xz).
+ */
+highp float cloudMapFiltered3(float lowerBound, float upperBound, highp float time, highp vec3 pos, highp float footprint) {
+    return fBMFiltered3(lowerBound, upperBound, cloudCoords(time, pos), cloudFootprint(footprint));
+}
+
+highp float cloudMapFiltered6(float lowerBound, float upperBound, highp float time, highp vec3 pos, highp float footprint) {
+    return fBMFiltered6(lowerBound, upperBound, cloudCoords(time, pos), cloudFootprint(footprint));
+}
+
+#if defined(NOISE_QUAD_SHARED)
+/* Quad-shared version of cloudMapFiltered3() and
+ * cloudMapFiltered6(). See fBMQuad(). */
+highp float cloudMapQuad(int octaves, float lowerBound, float upperBound, highp float time, highp vec3 pos, highp float footprint) {
+    return fBMQuad(
+        octaves, lowerBound, upperBound, cloudCoords(time, pos), cloudFootprint(footprint));
 }
+#endif /* defined(NOISE_QUAD_SHARED) */
 
 #endif /* !defined(NATURAL_MYSTIC_CLOUD_H_INCLUDED) */
@@ -23,6 +23,19 @@ vec3 sunlightColor(float daylight) {
     return mix(setColor, dayColor, smoothstep(0.45, 1.0, daylight));
 }
 
+/* Calculate the color of light coming from outside, i.e. the sun, the
+ * moon, and the sky, based on the time-dependent daylight level
+ * "daylight" [0, 1].
+ */
+vec3 outsideLightColor(float daylight) {
+    /* The daylight color is a mixture of sunlight and skylight. */
+    vec3 daylightColor = mix(skylightColor, sunlightColor(daylight), 0.625);
+
+    /* The influence of the sun and the moon depends on the daylight
+     * level. */
+    return mix(moonlightColor, daylightColor, daylight);
+}
+
 /* Calculate the color of the ambient light based solely on the fog
  * color.
  */
@@ -36,12 +49,7 @@ vec3 ambientLightColor(vec4 fogColor) {
  * but the color is.
  */
 vec3 ambientLightColor(float sunLevel, float daylight) {
-    /* The daylight color is a mixture of sunlight and skylight. */
-    vec3 daylightColor = mix(skylightColor, sunlightColor(daylight), 0.625);
-
-    /* The influence of the sun and the moon depends on the daylight
-     * level. */
-    vec3 outsideColor = mix(moonlightColor, daylightColor, daylight);
+    vec3 outsideColor = outsideLightColor(daylight);
 
     /* In caves the torch light is the only possible light source but
      * on the ground the sun or the moon is the most influential. */
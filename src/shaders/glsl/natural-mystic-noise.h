@@ -2,6 +2,8 @@
 #if !defined(NATURAL_MYSTIC_NOISE_H_INCLUDED)
 #define NATURAL_MYSTIC_NOISE_H_INCLUDED 1
 
+#include "natural-mystic-config.h"
+
 // See also: https://www.shadertoy.com/view/4djSRW
 // Also https://briansharpe.wordpress.com/2011/10/01/gpu-texture-free-noise/
 // Also https://github.com/stegu/webgl-noise/
@@ -312,4 +314,308 @@ highp float fBM(const int octaves, const float lowerBound, const float upperBoun
     return smoothstep(lowerBound, upperBound, value);
 }
 
+/* Unrolled specializations of fBM() for the numbers of octaves we
+ * actually use. Many GLSL ES 1.00 drivers don't unroll the loop in
+ * fBM() because of its breaks, and compile it into a generic loop
+ * that schedules poorly. These return exactly the same values.
+ */
+void fBMOctave(inout highp float value, inout bool active, const float lowerBound, const float upperBound, highp vec2 st, const float amplitude) {
+    if (active) {
+        value += amplitude * (simplexNoise(st) * 0.5 + 0.5);
+
+        // Optimization (#29): See fBM().
+        active = value < upperBound && value + amplitude > lowerBound;
+    }
+}
+
+highp float fBM3(const float lowerBound, const float upperBound, highp vec2 st) {
+    highp float value  = 0.0;
+    bool        active = true;
+    fBMOctave(value, active, lowerBound, upperBound, st      , 0.5  );
+    fBMOctave(value, active, lowerBound, upperBound, st * 2.0, 0.25 );
+    fBMOctave(value, active, lowerBound, upperBound, st * 4.0, 0.125);
+    return smoothstep(lowerBound, upperBound, value);
+}
+
+highp float fBM6(const float lowerBound, const float upperBound, highp vec2 st) {
+    highp float value  = 0.0;
+    bool        active = true;
+    fBMOctave(value, active, lowerBound, upperBound, st       , 0.5     );
+    fBMOctave(value, active, lowerBound, upperBound, st *  2.0, 0.25    );
+    fBMOctave(value, active, lowerBound, upperBound, st *  4.0, 0.125   );
+    fBMOctave(value, active, lowerBound, upperBound, st *  8.0, 0.0625  );
+    fBMOctave(value, active, lowerBound, upperBound, st * 16.0, 0.03125 );
+    fBMOctave(value, active, lowerBound, upperBound, st * 32.0, 0.015625);
+    return smoothstep(lowerBound, upperBound, value);
+}
+
+/* Compute a fade factor [0, 1] for a noise octave based on how many
+ * cycles of it fall within a single pixel. Octaves approaching the
+ * Nyquist frequency (0.5 cycles per pixel) cannot be represented on
+ * screen and only add aliasing, so they should be faded out towards
+ * their expected value.
+ */
+float nyquistFade(highp float cyclesPerPixel) {
+    return 1.0 - smoothstep(0.25, 0.5, cyclesPerPixel);
+}
+
+/* Generate a band-limited 2D fBM noise [0, 1]. This is the same as
+ * fBM() but "footprint" is the size of a pixel in the st space,
+ * usually obtained with fwidth(st). Octaves above the pixel Nyquist
+ * frequency are never evaluated, and the ones near it are faded out,
+ * so distant pixels become cheaper and less shimmery at the same
+ * time.
+ */
+highp float fBMFiltered(const int octaves, const float lowerBound, const float upperBound, highp vec2 st, highp float footprint) {
+    // Initial values
+    highp float value = 0.0;
+    highp float amplitude = 0.5;
+
+    // Loop of octaves
+    for (int i = 0; i < octaves; i++) {
+        /* Simplex noise has roughly one cycle per unit of st, so the
+         * footprint is also the number of cycles per pixel. An octave
+         * being faded out is replaced with its expected value, which
+         * keeps the overall density of the pattern unchanged. */
+        float fade = nyquistFade(footprint);
+        if (fade <= 0.0) {
+            /* The footprint only grows with octaves, so every
+             * remaining octave is faded out too. Add all of their
+             * expected values at once and stop here. */
+            value += amplitude * (1.0 - exp2(float(i - octaves)));
+            break;
+        }
+        value += amplitude * mix(0.5, simplexNoise(st) * 0.5 + 0.5, fade);
+
+        if (value >= upperBound) {
+            // Optimization (#29): See fBM().
+            break;
+        }
+        else if (value + amplitude <= lowerBound) {
+            // Optimization (#29): See fBM().
+            break;
+        }
+
+        st        *= 2.0;
+        footprint *= 2.0;
+        amplitude *= 0.5;
+    }
+
+    return smoothstep(lowerBound, upperBound, value);
+}
+
+/* Unrolled specializations of fBMFiltered(). See fBM3() and
+ * fBM6(). "lastAmplitude" is the amplitude of the last octave, which
+ * is needed to add the expected values of all the remaining octaves
+ * at once when they are faded out.
+ */
+void fBMFilteredOctave(inout highp float value, inout bool active, const float lowerBound, const float upperBound, highp vec2 st, highp float footprint, const float amplitude, const float lastAmplitude) {
+    if (active) {
+        float fade = nyquistFade(footprint);
+        if (fade <= 0.0) {
+            // See fBMFiltered().
+            value  += amplitude - 0.5 * lastAmplitude;
+            active  = false;
+        }
+        else {
+            value += amplitude * mix(0.5, simplexNoise(st) * 0.5 + 0.5, fade);
+
+            // Optimization (#29): See fBM().
+            active = value < upperBound && value + amplitude > lowerBound;
+        }
+    }
+}
+
+highp float fBMFiltered3(const float lowerBound, const float upperBound, highp vec2 st, highp float footprint) {
+    highp float value  = 0.0;
+    bool        active = true;
+    fBMFilteredOctave(value, active, lowerBound, upperBound, st      , footprint      , 0.5  , 0.125);
+    fBMFilteredOctave(value, active, lowerBound, upperBound, st * 2.0, footprint * 2.0, 0.25 , 0.125);
+    fBMFilteredOctave(value, active, lowerBound, upperBound, st * 4.0, footprint * 4.0, 0.125, 0.125);
+    return smoothstep(lowerBound, upperBound, value);
+}
+
+highp float fBMFiltered6(const float lowerBound, const float upperBound, highp vec2 st, highp float footprint) {
+    highp float value  = 0.0;
+    bool        active = true;
+    fBMFilteredOctave(value, active, lowerBound, upperBound, st       , footprint       , 0.5     , 0.015625);
+    fBMFilteredOctave(value, active, lowerBound, upperBound, st *  2.0, footprint *  2.0, 0.25    , 0.015625);
+    fBMFilteredOctave(value, active, lowerBound, upperBound, st *  4.0, footprint *  4.0, 0.125   , 0.015625);
+    fBMFilteredOctave(value, active, lowerBound, upperBound, st *  8.0, footprint *  8.0, 0.0625  , 0.015625);
+    fBMFilteredOctave(value, active, lowerBound, upperBound, st * 16.0, footprint * 16.0, 0.03125 , 0.015625);
+    fBMFilteredOctave(value, active, lowerBound, upperBound, st * 32.0, footprint * 32.0, 0.015625, 0.015625);
+    return smoothstep(lowerBound, upperBound, value);
+}
+
+/* Quad-shared evaluation of noise: Fragments are shaded in 2x2
+ * quads, and dFdx()/dFdy() are the differences between neighbours in
+ * a quad. That means a fragment can read values computed by its
+ * neighbours, and expensive noise that is smooth at the pixel scale
+ * can be split so that each fragment of a quad evaluates only a
+ * quarter of it.
+ *
+ * This only works when the driver computes derivatives per fragment
+ * and not per quad (i.e. "fine" derivatives), which GLSL ES doesn't
+ * guarantee. This is why it's an opt-in. The functions must also be
+ * called in control flow that is uniform within a quad. Fragment
+ * shaders should define NATURAL_MYSTIC_FRAGMENT_SHADER before
+ * including this header to use them, and also
+ * NATURAL_MYSTIC_MAY_DISCARD if they may discard some fragments of a
+ * quad but not the others, because derivatives are undefined after
+ * that.
+ */
+#if defined(ENABLE_QUAD_SHARED_NOISE) && defined(NATURAL_MYSTIC_FRAGMENT_SHADER) && !defined(NATURAL_MYSTIC_MAY_DISCARD) && (__VERSION__ >= 300 || defined(GL_OES_standard_derivatives))
+#define NOISE_QUAD_SHARED 1
+
+/* The position of the fragment in its quad. Each component is either
+ * 0.0 or 1.0.
+ */
+vec2 quadPosition() {
+    return mod(floor(gl_FragCoord.xy), 2.0);
+}
+
+/* The index of the fragment in its quad [0, 3]. */
+float quadIndex() {
+    vec2 pos = quadPosition();
+    return pos.x + pos.y * 2.0;
+}
+
+/* The directions towards the horizontal and the vertical neighbours
+ * in the quad. Each component is either 1.0 or -1.0.
+ */
+vec2 quadNeighbourDir() {
+    return 1.0 - 2.0 * quadPosition();
+}
+
+/* Sum a value over the quad. Every fragment in the quad gets the same
+ * result.
+ */
+highp float quadSum(highp float v) {
+    highp vec2  dir  = quadNeighbourDir();
+    highp float pair = v + (v + dir.x * dFdx(v));
+    return pair + (pair + dir.y * dFdy(pair));
+}
+
+highp vec3 quadSum(highp vec3 v) {
+    highp vec2 dir  = quadNeighbourDir();
+    highp vec3 pair = v + (v + dir.x * dFdx(v));
+    return pair + (pair + dir.y * dFdy(pair));
+}
+
+/* Return true if the condition holds for any of the fragments in the
+ * quad. Unlike comparing the result of quadSum() with something, this
+ * is exact and can be used to make a branch uniform within the quad.
+ */
+bool quadAny(bool cond) {
+    return quadSum(cond ? 1.0 : 0.0) > 0.5;
+}
+
+/* Move a coordinate to the centroid of the quad with a first-order
+ * correction by its derivatives. This is exact as long as the
+ * coordinate is affine in the screen space, which is the case for
+ * positions on a triangle. All the fragments in the quad can then
+ * evaluate a noise at the same point and share the results.
+ */
+highp vec2 quadCentroid(highp vec2 st) {
+    highp vec2 dir = quadNeighbourDir();
+    return st + 0.5 * (dir.x * dFdx(st) + dir.y * dFdy(st));
+}
+
+highp vec3 quadCentroid(highp vec3 st) {
+    highp vec2 dir = quadNeighbourDir();
+    return st + 0.5 * (dir.x * dFdx(st) + dir.y * dFdy(st));
+}
+
+/* The offset of the fragment from the centroid of its quad, in the
+ * space of the given coordinate. A value shared among the quad is
+ * reconstructed at each fragment by adding its gradient at the
+ * centroid times this offset, which is the same as adding its
+ * dFdx() and dFdy() times the offset in pixels, if it weren't shared.
+ */
+highp vec2 quadOffset(highp vec2 st) {
+    return st - quadCentroid(st);
+}
+
+/* simplexNoise() and its gradient at the same time, as (value, d/dx,
+ * d/dy). Each corner contributes t^4 (g . x) where t = 0.5 - x . x,
+ * so its gradient is t^4 g - 8 t^3 (g . x) x.
+ */
+highp vec3 simplexNoiseGrad(highp vec2 v) {
+    const highp vec4 C = vec4(
+        0.211324865405187,   // (3.0-sqrt(3.0))/6.0
+        0.366025403784439,   // 0.5*(sqrt(3.0)-1.0)
+        -0.577350269189626,  // -1.0 + 2.0 * C.x
+        0.024390243902439);  // 1.0 / 41.0
+
+    highp vec2 i  = floor(v + dot(v, C.yy));
+    highp vec2 x0 = v -   i + dot(i, C.xx);
+
+    highp vec2 i1  = x0.x > x0.y ? vec2(1.0, 0.0) : vec2(0.0, 1.0);
+    highp vec4 x12 = x0.xyxy + C.xxzz;
+    x12.xy -= i1;
+
+    i = mod289(i);
+    highp vec3 p =
+        permute289(
+            permute289(
+                i.y + vec3(0.0, i1.y, 1.0)
+                ) + i.x + vec3(0.0, i1.x, 1.0)
+            );
+
+    highp vec3 t  = max(0.5 - vec3(dot(x0, x0), dot(x12.xy, x12.xy), dot(x12.zw, x12.zw)), 0.0);
+    highp vec3 t2 = t * t;
+    highp vec3 t4 = t2 * t2;
+
+    highp vec3 x    = 2.0 * fract(p * C.www) - 1.0;
+    highp vec3 h    = abs(x) - 0.5;
+    highp vec3 ox   = round(x);
+    highp vec3 a0   = x - ox;
+    highp vec3 norm = inversesqrt(a0 * a0 + h * h);
+
+    // Normalised gradients at the three corners.
+    highp vec2 g0 = vec2(a0.x, h.x) * norm.x;
+    highp vec2 g1 = vec2(a0.y, h.y) * norm.y;
+    highp vec2 g2 = vec2(a0.z, h.z) * norm.z;
+
+    highp vec3 gx = vec3(dot(g0, x0), dot(g1, x12.xy), dot(g2, x12.zw));
+    highp vec3 w  = -8.0 * t2 * t * gx;
+    highp vec2 grad =
+        t4.x * g0 + w.x * x0 +
+        t4.y * g1 + w.y * x12.xy +
+        t4.z * g2 + w.z * x12.zw;
+
+    return 130.0 * vec3(dot(t4, gx), grad);
+}
+
+/* Quad-shared version of fBMFiltered(). Each fragment evaluates every
+ * fourth octave and its gradient at the centroid of the quad, so the
+ * four fragments run the noise in lockstep and each of them pays for
+ * at most ceil(octaves / 4) octaves. The sum is then extrapolated to
+ * each fragment to the first order, so the result doesn't become
+ * blocky. Pass 0.0 as "footprint" to disable the band-limiting. The
+ * early exits of fBM() (#29) are not possible here, as the sum isn't
+ * known until all the fragments are done.
+ */
+highp float fBMQuad(const int octaves, const float lowerBound, const float upperBound, highp vec2 st, highp float footprint) {
+    highp vec2  stc   = quadCentroid(st);
+    highp float lane  = quadIndex();
+    highp vec3  value = vec3(0.0); // The value and its gradient.
+
+    for (int i = 0; i < (octaves + 3) / 4; i++) {
+        highp float octave    = lane + float(i) * 4.0;
+        highp float frequency = exp2(octave);
+        highp float amplitude = octave < float(octaves) ? 0.5 / frequency : 0.0;
+
+        float      fade  = nyquistFade(footprint * frequency);
+        highp vec3 noise = simplexNoiseGrad(stc * frequency);
+        value.x  += amplitude * mix(0.5, noise.x * 0.5 + 0.5, fade);
+        value.yz += amplitude * fade * 0.5 * frequency * noise.yz;
+    }
+
+    value = quadSum(value);
+    return smoothstep(lowerBound, upperBound, value.x + dot(value.yz, quadOffset(st)));
+}
+
+#endif /* defined(ENABLE_QUAD_SHARED_NOISE) && ... */
+
 #endif /* NATURAL_MYSTIC_NOISE_H_INCLUDED */
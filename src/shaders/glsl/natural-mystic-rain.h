@@ -2,6 +2,7 @@
 #if !defined(NATURAL_MYSTIC_RAIN_H_INCLUDED)
 #define NATURAL_MYSTIC_RAIN_H_INCLUDED 1
 
+#include "natural-mystic-config.h"
 #include "natural-mystic-noise.h"
 #include "natural-mystic-precision.h"
 
@@ -19,25 +20,94 @@ float wetness(float clearWeather, float sunLevel) {
     return (1.0 - clearWeather) * smoothstep(shadowBorder - shadowBlur, shadowBorder + shadowBlur, sunLevel);
 }
 
-/* Compute light reflected by water ripples on the ground.
+#if defined(NOISE_QUAD_SHARED)
+/* Quad-shared version of the two layers of noise in ripples(): The
+ * first two fragments in a quad evaluate one layer each, along with
+ * its gradient, at the centroid of the quad, and every fragment
+ * extrapolates the weighted sum to its own position like fBMQuad()
+ * does. The other two evaluate the second layer again so that the
+ * quad runs in lockstep, and throw it away. "gen" and "weight" only
+ * depend on the time, so they are the same for the whole quad.
  */
-vec3 ripples(vec3 incomingLight, prec_hm vec3 worldPos, float cameraDist, prec_hm float time, prec_hm vec3 normal) {
+prec_hm float rippleNoiseQuad(prec_hm vec2 st, prec_hm vec2 gen, vec2 weight) {
+    float        lane = quadIndex();
+    prec_hm vec2 stc  = quadCentroid(st);
+    prec_hm vec2 offs = lane < 0.5 ? vec2(gen.x) : vec2(-gen.y);
+    float        w    = lane < 0.5 ? weight.x : (lane < 1.5 ? weight.y : 0.0);
+
+    prec_hm vec3 noise = quadSum(w * simplexNoiseGrad(stc + offs));
+    return noise.x + dot(noise.yz, quadOffset(st));
+}
+#endif /* defined(NOISE_QUAD_SHARED) */
+
+/* Compute light reflected by water ripples on the ground. The
+ * argument "wet" is the wetness of the terrain, "cameraDepth" is the
+ * distance from the camera in blocks, and "footprint" is the size of
+ * a pixel in the world space, or 0.0 if unknown.
+ */
+vec3 ripples(float wet, vec3 incomingLight, prec_hm vec3 worldPos, float cameraDepth, prec_hm float time, prec_hm vec3 normal, prec_hm float footprint) {
+    /* Water ripples should only be apparent on the ground, i.e. where
+     * the normal matches to (0, 1, 0). Walls and undersides would
+     * only get a faint fraction of them, which isn't worth the
+     * noise. They fade out towards minCosTheta instead of being cut
+     * off there, or steep slopes would have a visible edge. */
+    const float minCosTheta = 0.1;
+    float cosTheta = normal.y; // Equivalent to dot(normal, vec3(0, 1, 0))
+    float slope    = smoothstep(minCosTheta, minCosTheta + 0.1, cosTheta);
+
     /* The visual effect of ripples is so subtle, and it won't be
      * visible on far terrain. We can skip the costly noise generation
-     * unless worldPos isn't close to the camera. */
-    const float distThreshold = 0.1;
+     * unless worldPos isn't close to the camera. The threshold is in
+     * blocks, not relative to the render distance, or the number of
+     * pixels paying for the noise would grow quadratically with the
+     * render distance. */
+    const float distThreshold = RIPPLES_DISTANCE;
     const float distFadeStart = distThreshold * 0.8;
 
-    if (cameraDist < distThreshold) {
-        /* Water ripples should only be apparent on the ground, i.e. where the
-         * normal matches to (0, 1, 0). */
-        float cosTheta = max(0.0, normal.y); // Equivalent to max(0.0, dot(normal, vec3(0, 1, 0)));
+    const prec_hm vec3 resolution = vec3(vec2(0.16), 0.5);
+
+    /* Ripples finer than a pixel only produce sparkling noise. Fade
+     * them out before they reach the Nyquist frequency, and skip the
+     * noise entirely past it. */
+    float fade = nyquistFade(footprint / resolution.x);
 
-        const prec_hm vec3 resolution = vec3(vec2(0.16), 0.5);
+    /* Everything that can reject the pixel has to come before the
+     * noise. */
+    bool visible = slope > 0.0 && wet > 0.0 && cameraDepth < distThreshold && fade > 0.0;
+#if defined(NOISE_QUAD_SHARED)
+    /* rippleNoiseQuad() relies on derivatives so the branch has to
+     * be uniform within a quad. Every factor of the result is zero
+     * where the pixel itself is rejected. */
+    visible = quadAny(visible);
+#endif
+    if (visible) {
         const float amount = 0.1;
 
-        prec_hm vec3 st = vec3(worldPos.xz, time) / resolution;
-        float ripples = simplexNoise(st);
+        /* Rather than a 3D noise sweeping through time, cross-fade two
+         * layers of 2D noise. Each layer is faded in, faded out, and
+         * then replaced with an unrelated pattern while it's
+         * invisible. The two layers are half a period apart so that
+         * their weights always sum up to 1. Two 2D simplex noises are
+         * considerably cheaper than a 3D one, and they can also be
+         * shared within a quad. */
+        prec_hm vec2  st = worldPos.xz / resolution.xy;
+        prec_hm float t  = time / resolution.z;
+        prec_hm vec2  t2 = t + vec2(0.0, 0.5);
+        prec_hm vec2  ph = fract(t2);
+        /* Offset each generation of a layer by an arbitrary amount.
+         * The mod() keeps the offset small enough not to lose the
+         * precision of st. */
+        prec_hm vec2  gen = mod(floor(t2), 17.0) * 23.0;
+        vec2 weight = 1.0 - abs(ph * 2.0 - 1.0);
+
+#if defined(NOISE_QUAD_SHARED)
+        float ripples = rippleNoiseQuad(st, gen, weight);
+#else
+        float ripples = dot(weight, vec2(simplexNoise(st + gen.x), simplexNoise(st - gen.y)));
+#endif
+        /* Cross-fading reduces the contrast in the middle. Compensate
+         * it by normalizing the variance. */
+        ripples *= inversesqrt(dot(weight, weight));
 
         /* Shift the range of ripples. */
         ripples = (ripples + 0.8) * 0.5;
@@ -45,8 +115,8 @@ vec3 ripples(vec3 incomingLight, prec_hm vec3 worldPos, float cameraDist, prec_h
         /* Threshold and scale of ripples. */
         ripples = smoothstep(0.3, 1.0, ripples);
 
-        return incomingLight * mix(0.2, 1.0, cosTheta) * ripples * amount *
-            (1.0 - smoothstep(distFadeStart, distThreshold, cameraDist));
+        return incomingLight * wet * mix(0.2, 1.0, cosTheta) * slope * ripples * amount * fade *
+            (1.0 - smoothstep(distFadeStart, distThreshold, cameraDepth));
     }
     else {
         return vec3(0);
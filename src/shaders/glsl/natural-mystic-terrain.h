@@ -0,0 +1,145 @@
+// -*- glsl -*-
+#if !defined(NATURAL_MYSTIC_TERRAIN_H_INCLUDED)
+#define NATURAL_MYSTIC_TERRAIN_H_INCLUDED 1
+
+#include "natural-mystic-config.h"
+#include "natural-mystic-hacks.h"
+#include "natural-mystic-light.h"
+
+/* Blocks rendered as entities, such as falling blocks and blocks
+ * moved by pistons, are drawn with these shaders too. Their positions
+ * are in the clip space rather than the world space, so water, torch
+ * flickering, specular lighting, and ripples were never right for
+ * them. With ENABLE_LIGHTWEIGHT_ENTITIES they are compiled out, and
+ * the light is accumulated per vertex whenever possible.
+ */
+#if defined(ENABLE_LIGHTWEIGHT_ENTITIES) && defined(AS_ENTITY_RENDERER) && defined(MCPE40059)
+#  define TERRAIN_LIGHTWEIGHT_ENTITY 1
+#endif
+
+/* Light accumulation for terrain. Everything here depends only on the
+ * lightmap coordinates, the vertex color, and per-draw values, so it
+ * can either be computed per fragment (the default) or per vertex
+ * (ENABLE_VERTEX_LIGHTING). Vertex shaders need a texture fetch for
+ * that, which is only guaranteed to be available on GLSL ES 3.00.
+ */
+#if (defined(ENABLE_VERTEX_LIGHTING) || defined(TERRAIN_LIGHTWEIGHT_ENTITY)) && defined(MCPE40059) && !defined(BYPASS_PIXEL_SHADER) && __VERSION__ >= 300
+#  define TERRAIN_VERTEX_LIGHTING 1
+#endif
+
+/* Translate the level of daylight (i.e. the one which darkens at
+ * night) fetched from the light map passed by the upstream. Note that
+ * we intentionally reduce the dynamic range because the upstream
+ * daylight level doesn't drop to zero at night.
+ */
+float terrainDaylight(float lightmapDaylight) {
+    return smoothstep(0.4, 1.0, lightmapDaylight);
+}
+
+/* Translate the level of ambient light fetched from the light map
+ * passed by the upstream. The constant multiplifier is determined so
+ * the intensity will be 6 on the Overworld and 26 in the
+ * Nether/End.
+ */
+float terrainAmbientBrightness(float lightmapAmbient) {
+    return lightmapAmbient * 44.797;
+}
+
+/* Accumulate all the light reaching a surface into the color of
+ * ambient light, and linear RGB vectors of directional and
+ * undirectional light. "lightLevels" is the torch light level and the
+ * terrain-dependent sunlight level, i.e. uv1. "fogColor" is only used
+ * when FOG is defined, and "clearWeather" and "flickerFactor" are
+ * only used when MCPE40059 is defined.
+ */
+void terrainLight(
+    vec2 lightLevels, float daylight, float ambientBrightness,
+    vec4 fogColor, float clearWeather, float flickerFactor,
+    out vec3 ambientColor, out vec3 dirLight, out vec3 undirLight) {
+
+    /* Calculate the color of the ambient light based on the fog
+     * color. We'll use it at several places. */
+#if defined(UNDERWATER)
+    const bool isUnderwater = true;
+#else
+    const bool isUnderwater = false;
+#endif /* defined(UNDERWATER) */
+
+#if defined(FOG) && defined(MCPE40059)
+    if (isRenderDistanceFog(FOG_CONTROL)) {
+        /* Don't use the fog color in this case, as it would be
+         * slightly different from the color of near terrain. */
+        ambientColor = ambientLightColor(lightLevels.y, daylight);
+    }
+    else {
+        /* The existence of bad weather fog (and also underwater fog)
+         * should increase the intensity of ambient light (#32). But
+         * at night it should work the other way.
+         */
+        if (isUnderwater) {
+            ambientColor = ambientLightColor(fogColor);
+            ambientBrightness *= mix(0.9, 1.4, daylight);
+        }
+        else {
+            ambientColor = mix(
+                ambientLightColor(fogColor),
+                ambientLightColor(lightLevels.y, daylight),
+                clearWeather);
+            ambientBrightness *= mix(mix(0.9, 1.4, daylight), 1.0, clearWeather);
+        }
+    }
+#else
+    ambientColor = ambientLightColor(lightLevels.y, daylight);
+#endif /* defined(FOG) */
+
+    /* Accumulate all the light to one linear RGB vector. We are going
+     * to use it for diffuse lighting, and also specular lighting. */
+    dirLight   = vec3(0);
+    undirLight = vec3(0);
+
+    undirLight += ambientLight(ambientColor, ambientBrightness);
+#if defined(FOG) && defined(MCPE40059)
+    /* When it's raining the sunlight shouldn't affect the scene
+     * (#24), but we cannot treat the rain as a boolean switch as that
+     * would cause #40. */
+    if (isUnderwater) {
+        dirLight += sunlight(lightLevels.y, daylight);
+        dirLight += moonlight(lightLevels.y, daylight);
+    }
+    else {
+        dirLight += sunlight(lightLevels.y, daylight) * clearWeather;
+        dirLight += moonlight(lightLevels.y, daylight) * clearWeather;
+    }
+#else
+    dirLight += sunlight(lightLevels.y, daylight);
+    dirLight += moonlight(lightLevels.y, daylight);
+#endif /* FOG */
+    undirLight += skylight(lightLevels.y, daylight);
+#if defined(MCPE40059)
+    /* Torchlight is directional, but since we don't actually know
+     * their directions we have to consider it as undirectional. */
+    undirLight += torchLight(lightLevels.x, lightLevels.y, daylight, flickerFactor);
+#endif
+
+    /* Light sources should be significantly brighter than regular
+     * objects. */
+#if defined(ALWAYS_LIT)
+    undirLight += emissiveLight(flickerFactor);
+#endif
+}
+
+/* Apply the fake shadows generated from the ambient occlusion factor
+ * to directional light. Water doesn't get them.
+ */
+vec3 occlusionShadow(vec3 dirLight, float occlusion) {
+#if defined(ENABLE_OCCLUSION_SHADOWS)
+    /* The intensity of directional light should be affected by the
+     * occlusion factor. */
+    const float occlShadow = 0.35;
+    return dirLight * mix(occlShadow, 1.0, occlusion);
+#else
+    return dirLight;
+#endif /* defined(ENABLE_OCCLUSION_SHADOWS) */
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TERRAIN_H_INCLUDED) */
@@ -2,6 +2,7 @@
 #if !defined(NATURAL_MYSTIC_WATER_H_INCLUDED)
 #define NATURAL_MYSTIC_WATER_H_INCLUDED 1
 
+#include "natural-mystic-noise.h"
 #include "natural-mystic-precision.h"
 
 /* Overview of our water system:
@@ -130,6 +131,66 @@ prec_hm vec3 waterWaveNormal(prec_hm vec3 wPos, prec_hm float time, prec_hm vec3
     return normal;
 }
 
+#if defined(NOISE_QUAD_SHARED)
+/* Quad-shared version of waterWaveNormal(): The first three fragments
+ * in a quad compute one of the three waves each, at the centroid of
+ * the quad, and share the results. The phase of a wave is affine in
+ * the position, so they also share the derivatives of the waves by
+ * x and z, which every fragment uses to extrapolate the sum to its
+ * own position. The parameters must be kept in sync with
+ * waterWaveNormal().
+ */
+prec_hm vec3 waterWaveNormalQuad(prec_hm vec3 wPos, prec_hm float time, prec_hm vec3 normal) {
+    const float Q        = 0.45;
+    const float numWaves = float(3);
+
+    /* The fourth fragment has nothing to do. It computes the third
+     * wave again (so every fragment runs in lockstep) and throws it
+     * away. */
+    float lane   = quadIndex();
+    float Ai     = lane < 1.5 ? 0.0058 : 0.0045;
+    float deg    = lane < 0.5 ? 85.0 : (lane < 1.5 ? 255.0 : 65.0);
+    float Li     = lane < 0.5 ? 0.75 : (lane < 1.5 ? 0.725 : 0.7);
+    float Si     = lane < 0.5 ? 1.0  : 2.0;
+    float weight = lane < 2.5 ? 1.0  : 0.0;
+
+    /* The contribution of a wave, the same as what gerstnerWaveN()
+     * subtracts from the normal, and its derivative by the phase
+     * theta. Theta grows by wi * Di per unit of the position. The
+     * first-order term only holds while theta changes by a small
+     * part of a cycle per pixel, so it fades out like octaves of
+     * noise do. Once it has faded out entirely for any of the waves,
+     * the quad would be left with a single normal while neighbouring
+     * pixels are meant to see different phases, so such quads
+     * evaluate the waves per pixel instead. */
+    const float wFactor = 9.80665 * 2.0 * 3.14159;
+    vec2        Di      = deg2dir(deg);
+    float       wi      = sqrt(wFactor / Li);
+    float       Qi      = Q / (wi * Ai * numWaves);
+    float       phi_i   = Si * 2.0 / Li;
+
+    prec_hm vec3  wPosc  = quadCentroid(wPos);
+    prec_hm float theta  = wi * dot(Di, wPosc.xz) + phi_i * time;
+    prec_hm float wiAi   = wi * Ai * weight;
+    prec_hm float cosT   = cos(theta);
+    prec_hm float sinT   = sin(theta);
+    prec_hm vec3  delta  = -wiAi * vec3(Di.x * cosT, Qi * sinT, Di.y * cosT);
+    prec_hm float cycles = wi * (abs(dot(Di, dFdx(wPos.xz))) + abs(dot(Di, dFdy(wPos.xz)))) / (2.0 * 3.14159);
+    float         fade   = nyquistFade(cycles);
+    if (quadAny(fade <= 0.0)) {
+        return waterWaveNormal(wPos, time, normal);
+    }
+    prec_hm vec3  dDelta = wiAi * fade * vec3(Di.x * sinT, -Qi * cosT, Di.y * sinT);
+
+    prec_hm vec3 sum  = quadSum(delta);
+    prec_hm vec3 sumX = quadSum(dDelta * (wi * Di.x));
+    prec_hm vec3 sumZ = quadSum(dDelta * (wi * Di.y));
+
+    prec_hm vec2 offset = quadOffset(wPos.xz);
+    return normal + sum + sumX * offset.x + sumZ * offset.y;
+}
+#endif /* defined(NOISE_QUAD_SHARED) */
+
 /* Compute the specular light on a water surface, and the opacity at
  * the same time. The .a component of the result should be used as an
  * absolute, not relative opacity.
@@ -0,0 +1,189 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_GLSL_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_GLSL_HPP_INCLUDED 1
+
+/* A tiny subset of GLSL ES built-in types and functions, just enough
+ * to port our shader headers to C++ line by line. Only the ones we
+ * actually use are defined. The precision qualifiers are ignored and
+ * everything is computed in single precision, which corresponds to
+ * highp.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+namespace glsl {
+    struct vec2 {
+        float x, y;
+
+        constexpr vec2() : x(0), y(0) {}
+        constexpr explicit vec2(float s) : x(s), y(s) {}
+        constexpr vec2(float x_, float y_) : x(x_), y(y_) {}
+
+        float &operator[](int i)       { return (&x)[i]; }
+        float  operator[](int i) const { return (&x)[i]; }
+    };
+
+    struct vec3 {
+        float x, y, z;
+
+        constexpr vec3() : x(0), y(0), z(0) {}
+        constexpr explicit vec3(float s) : x(s), y(s), z(s) {}
+        constexpr vec3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+        constexpr vec3(vec2 xy, float z_) : x(xy.x), y(xy.y), z(z_) {}
+
+        constexpr vec2 xy() const { return vec2(x, y); }
+        constexpr vec2 xz() const { return vec2(x, z); }
+
+        float &operator[](int i)       { return (&x)[i]; }
+        float  operator[](int i) const { return (&x)[i]; }
+    };
+
+    struct vec4 {
+        float x, y, z, w;
+
+        constexpr vec4() : x(0), y(0), z(0), w(0) {}
+        constexpr explicit vec4(float s) : x(s), y(s), z(s), w(s) {}
+        constexpr vec4(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {}
+        constexpr vec4(vec3 xyz, float w_) : x(xyz.x), y(xyz.y), z(xyz.z), w(w_) {}
+        constexpr vec4(vec2 xy, vec2 zw) : x(xy.x), y(xy.y), z(zw.x), w(zw.y) {}
+
+        constexpr vec2 xy()  const { return vec2(x, y); }
+        constexpr vec2 zw()  const { return vec2(z, w); }
+        constexpr vec3 rgb() const { return vec3(x, y, z); }
+        constexpr vec3 xyz() const { return vec3(x, y, z); }
+
+        float &operator[](int i)       { return (&x)[i]; }
+        float  operator[](int i) const { return (&x)[i]; }
+    };
+
+    /* Only our vector types take part in the overloads below. */
+    template <typename V> struct is_vec : std::false_type {};
+    template <> struct is_vec<vec2> : std::true_type {};
+    template <> struct is_vec<vec3> : std::true_type {};
+    template <> struct is_vec<vec4> : std::true_type {};
+    template <typename V, typename R = V>
+    using if_vec = typename std::enable_if<is_vec<V>::value, R>::type;
+
+    /* Component-wise application of unary and binary functions. */
+    template <typename F> inline vec2 map(vec2 a, F f) { return vec2(f(a.x), f(a.y)); }
+    template <typename F> inline vec3 map(vec3 a, F f) { return vec3(f(a.x), f(a.y), f(a.z)); }
+    template <typename F> inline vec4 map(vec4 a, F f) { return vec4(f(a.x), f(a.y), f(a.z), f(a.w)); }
+
+    template <typename F> inline vec2 zip(vec2 a, vec2 b, F f) { return vec2(f(a.x, b.x), f(a.y, b.y)); }
+    template <typename F> inline vec3 zip(vec3 a, vec3 b, F f) { return vec3(f(a.x, b.x), f(a.y, b.y), f(a.z, b.z)); }
+    template <typename F> inline vec4 zip(vec4 a, vec4 b, F f) { return vec4(f(a.x, b.x), f(a.y, b.y), f(a.z, b.z), f(a.w, b.w)); }
+
+#define GLSL_DEFINE_OPERATOR(OP)                                                    \
+    template <typename V> inline if_vec<V> operator OP(V a, V b) {                  \
+        return zip(a, b, [](float p, float q) { return p OP q; });                  \
+    }                                                                               \
+    template <typename V> inline if_vec<V> operator OP(V a, float s) {              \
+        return map(a, [s](float p) { return p OP s; });                             \
+    }                                                                               \
+    template <typename V> inline if_vec<V> operator OP(float s, V a) {              \
+        return map(a, [s](float p) { return s OP p; });                             \
+    }                                                                               \
+    template <typename V> inline if_vec<V, V &> operator OP##=(V &a, V b) {         \
+        return a = a OP b;                                                          \
+    }                                                                               \
+    template <typename V> inline if_vec<V, V &> operator OP##=(V &a, float s) {     \
+        return a = a OP s;                                                          \
+    }
+    GLSL_DEFINE_OPERATOR(+)
+    GLSL_DEFINE_OPERATOR(-)
+    GLSL_DEFINE_OPERATOR(*)
+    GLSL_DEFINE_OPERATOR(/)
+#undef GLSL_DEFINE_OPERATOR
+
+    template <typename V> inline if_vec<V> operator-(V a) {
+        return map(a, [](float p) { return -p; });
+    }
+
+    /* Scalar functions. */
+    inline float radians(float deg) { return deg * 3.14159265358979f / 180.0f; }
+    inline float fract(float x) { return x - std::floor(x); }
+    inline float sign(float x) { return x > 0.0f ? 1.0f : x < 0.0f ? -1.0f : 0.0f; }
+    inline float step(float edge, float x) { return x < edge ? 0.0f : 1.0f; }
+    inline float clamp(float x, float lo, float hi) { return std::min(std::max(x, lo), hi); }
+    inline float mix(float a, float b, float t) { return a * (1.0f - t) + b * t; }
+    inline float inversesqrt(float x) { return 1.0f / std::sqrt(x); }
+    inline float smoothstep(float e0, float e1, float x) {
+        float t = clamp((x - e0) / (e1 - e0), 0.0f, 1.0f);
+        return t * t * (3.0f - 2.0f * t);
+    }
+    inline float round(float x) { return std::round(x); }
+
+    using std::abs;
+    using std::cos;
+    using std::exp;
+    using std::floor;
+    using std::log;
+    using std::max;
+    using std::min;
+    using std::pow;
+    using std::sin;
+    using std::sqrt;
+
+    /* Vector versions of them. */
+#define GLSL_DEFINE_UNARY(F)                                                        \
+    template <typename V> inline if_vec<V> F(V a) {                                 \
+        return map(a, [](float p) { return F(p); });                                \
+    }
+    GLSL_DEFINE_UNARY(abs)
+    GLSL_DEFINE_UNARY(cos)
+    GLSL_DEFINE_UNARY(exp)
+    GLSL_DEFINE_UNARY(floor)
+    GLSL_DEFINE_UNARY(fract)
+    GLSL_DEFINE_UNARY(inversesqrt)
+    GLSL_DEFINE_UNARY(round)
+    GLSL_DEFINE_UNARY(sign)
+    GLSL_DEFINE_UNARY(sin)
+    GLSL_DEFINE_UNARY(sqrt)
+#undef GLSL_DEFINE_UNARY
+
+    template <typename V> inline if_vec<V> max(V a, V b) { return zip(a, b, [](float p, float q) { return std::max(p, q); }); }
+    template <typename V> inline if_vec<V> max(V a, float s) { return zip(a, V(s), [](float p, float q) { return std::max(p, q); }); }
+    template <typename V> inline if_vec<V> min(V a, V b) { return zip(a, b, [](float p, float q) { return std::min(p, q); }); }
+    template <typename V> inline if_vec<V> min(V a, float s) { return zip(a, V(s), [](float p, float q) { return std::min(p, q); }); }
+    template <typename V> inline if_vec<V> pow(V a, V b) { return zip(a, b, [](float p, float q) { return std::pow(p, q); }); }
+    template <typename V> inline if_vec<V> step(V edge, V x) { return zip(edge, x, [](float e, float p) { return step(e, p); }); }
+    template <typename V> inline if_vec<V> step(float edge, V x) { return step(V(edge), x); }
+
+    template <typename V> inline if_vec<V> clamp(V x, float lo, float hi) {
+        return map(x, [lo, hi](float p) { return clamp(p, lo, hi); });
+    }
+    template <typename V> inline if_vec<V> mix(V a, V b, float t) { return a * (1.0f - t) + b * t; }
+    template <typename V> inline if_vec<V> mix(V a, V b, V t) { return a * (1.0f - t) + b * t; }
+    template <typename V> inline if_vec<V> smoothstep(float e0, float e1, V x) {
+        return map(x, [e0, e1](float p) { return smoothstep(e0, e1, p); });
+    }
+
+    inline float dot(vec2 a, vec2 b) { return a.x * b.x + a.y * b.y; }
+    inline float dot(vec3 a, vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline float dot(vec4 a, vec4 b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+    template <typename V> inline if_vec<V, float> length(V a) { return std::sqrt(dot(a, a)); }
+    template <typename V> inline if_vec<V> normalize(V a) { return a * inversesqrt(dot(a, a)); }
+
+    inline vec3 cross(vec3 a, vec3 b) {
+        return vec3(a.y * b.z - a.z * b.y,
+                    a.z * b.x - a.x * b.z,
+                    a.x * b.y - a.y * b.x);
+    }
+
+    /* A 3x3 matrix, stored as columns like GLSL does. */
+    struct mat3 {
+        vec3 c[3];
+
+        constexpr explicit mat3(float s) : c{vec3(s, 0, 0), vec3(0, s, 0), vec3(0, 0, s)} {}
+        constexpr mat3(vec3 c0, vec3 c1, vec3 c2) : c{c0, c1, c2} {}
+    };
+
+    inline mat3 operator+(mat3 a, mat3 b) { return mat3(a.c[0] + b.c[0], a.c[1] + b.c[1], a.c[2] + b.c[2]); }
+    inline mat3 operator*(float s, mat3 a) { return mat3(s * a.c[0], s * a.c[1], s * a.c[2]); }
+    inline vec3 operator*(mat3 m, vec3 v) { return m.c[0] * v.x + m.c[1] * v.y + m.c[2] * v.z; }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_GLSL_HPP_INCLUDED) */
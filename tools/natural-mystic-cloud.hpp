@@ -0,0 +1,59 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_CLOUD_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_CLOUD_HPP_INCLUDED 1
+
+/* C++ port of src/shaders/glsl/natural-mystic-cloud.h. Keep this in
+ * sync with the original.
+ */
+
+#include "glsl.hpp"
+#include "natural-mystic-noise.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    const vec2  cloudResolution = vec2(1.4f, 1.4f);
+    const float cloudSparseness = 3.0f;
+
+    inline vec2 cloudCoords(float time, vec3 pos) {
+        vec2 st = pos.xz() / cloudResolution;
+        st.y += time / 512.0f;
+        return st * cloudSparseness;
+    }
+
+    inline float cloudMap3(float lowerBound, float upperBound, float time, vec3 pos) {
+        return fBM3(lowerBound, upperBound, cloudCoords(time, pos));
+    }
+
+    inline float cloudMap6(float lowerBound, float upperBound, float time, vec3 pos) {
+        return fBM6(lowerBound, upperBound, cloudCoords(time, pos));
+    }
+
+    inline float cloudFootprint(float footprint) {
+        return footprint * cloudSparseness / cloudResolution.x;
+    }
+
+    inline float cloudMapFiltered3(float lowerBound, float upperBound, float time, vec3 pos, float footprint) {
+        return fBMFiltered3(lowerBound, upperBound, cloudCoords(time, pos), cloudFootprint(footprint));
+    }
+
+    inline float cloudMapFiltered6(float lowerBound, float upperBound, float time, vec3 pos, float footprint) {
+        return fBMFiltered6(lowerBound, upperBound, cloudCoords(time, pos), cloudFootprint(footprint));
+    }
+
+    /* Emulation of cloudMapQuad(). See fBMQuad(). "pos" and "posc"
+     * are the position of each fragment and the centroid it sees. */
+    inline void cloudMapQuad(int octaves, float lowerBound, float upperBound, float time,
+                             const vec3 pos[4], const vec3 posc[4], const float footprint[4], float out[4]) {
+        vec2  stc[4], offset[4];
+        float fp[4];
+        for (int lane = 0; lane < 4; lane++) {
+            stc[lane]    = cloudCoords(time, posc[lane]);
+            offset[lane] = cloudCoords(time, pos[lane]) - stc[lane];
+            fp[lane]     = cloudFootprint(footprint[lane]);
+        }
+        fBMQuad(octaves, lowerBound, upperBound, stc, offset, fp, out);
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_CLOUD_HPP_INCLUDED) */
@@ -0,0 +1,68 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_COLOR_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_COLOR_HPP_INCLUDED 1
+
+/* C++ port of src/shaders/glsl/natural-mystic-color.h. Keep this in
+ * sync with the original.
+ */
+
+#include "glsl.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    inline float rgb2luma(vec3 color) {
+        return dot(color, vec3(0.22f, 0.707f, 0.071f));
+    }
+
+    inline vec3 desaturate(vec3 baseColor, float degree) {
+        float luma = rgb2luma(baseColor);
+        return mix(baseColor, vec3(luma), degree);
+    }
+
+    inline vec3 rgb2hsv(vec3 c) {
+        const vec4 K = vec4(0.0f, -1.0f / 3.0f, 2.0f / 3.0f, -1.0f);
+        vec4 p = c.y < c.z ? vec4(c.z, c.y, K.w, K.z) : vec4(c.y, c.z, K.x, K.y);
+        vec4 q = c.x < p.x ? vec4(p.x, p.y, p.w, c.x) : vec4(c.x, p.y, p.z, p.x);
+
+        float d = q.x - min(q.w, q.y);
+        const float e = 1.0e-10f;
+        return vec3(abs(q.z + (q.w - q.y) / (6.0f * d + e)), d / (q.x + e), q.x);
+    }
+
+    inline vec3 brighten(vec3 color) {
+        float rgbMax = max(color.x, max(color.y, color.z));
+        float delta  = 1.0f - rgbMax;
+        return color + delta;
+    }
+
+    inline vec3 uncharted2ToneMap_(vec3 x) {
+        const float A = 0.015f;
+        const float B = 0.50f;
+        const float C = 0.10f;
+        const float D = 0.010f;
+        const float E = 0.02f;
+        const float F = 0.30f;
+
+        return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+    }
+    inline vec3 uncharted2ToneMap(vec3 frag, float whiteLevel, float exposureBias) {
+        vec3 curr = uncharted2ToneMap_(exposureBias * frag);
+        vec3 whiteScale = 1.0f / uncharted2ToneMap_(vec3(whiteLevel));
+        vec3 color = curr * whiteScale;
+
+        return clamp(color, 0.0f, 1.0f);
+    }
+
+    inline vec3 contrastFilter(vec3 color, float contrast) {
+        float t = 0.5f - contrast * 0.5f;
+        return clamp(color * contrast + t, 0.0f, 1.0f);
+    }
+
+    inline float contrastFilter(float lum, float contrast) {
+        float t = 0.5f - contrast * 0.5f;
+        return clamp(lum * contrast + t, 0.0f, 1.0f);
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_COLOR_HPP_INCLUDED) */
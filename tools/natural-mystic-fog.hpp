@@ -0,0 +1,47 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_FOG_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_FOG_HPP_INCLUDED 1
+
+/* C++ port of src/shaders/glsl/natural-mystic-fog.h. Keep this in
+ * sync with the original.
+ */
+
+#include "glsl.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    inline float linearFog(vec2 control, float dist) {
+        float density = (dist - control.x) / (control.y - control.x);
+        return clamp(density, 0.0f, 1.0f);
+    }
+
+    inline float exponentialFog(vec2 control, float dist) {
+        float base = log(1.0f/0.03f) / (control.y - control.x);
+        dist = max(0.0f, dist - control.x);
+
+        float fogFactor = 1.0f / exp(dist * base);
+        fogFactor = clamp(fogFactor, 0.0f, 1.0f);
+
+        return 1.0f - fogFactor;
+    }
+
+    inline float exponentialSquaredFog(vec2 control, float dist) {
+        float base = sqrt(log(1.0f/0.015f)) / (control.y - control.x);
+        dist = max(0.0f, dist - control.x);
+
+        float fogFactor = 1.0f / exp(pow(dist * base, 2.0f));
+        fogFactor = clamp(fogFactor, 0.0f, 1.0f);
+
+        return 1.0f - fogFactor;
+    }
+
+    inline float fogBrightness(float torchLevel, float sunLevel, float daylight) {
+        const float scatter = 1.2f;
+
+        float brightness = max(torchLevel, sunLevel * daylight) * scatter;
+        return clamp(brightness, 0.0f, 1.0f);
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_FOG_HPP_INCLUDED) */
@@ -0,0 +1,56 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_HACKS_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_HACKS_HPP_INCLUDED 1
+
+/* C++ port of src/shaders/glsl/natural-mystic-hacks.h. Keep this in
+ * sync with the original. The unused detections aren't ported.
+ */
+
+#include "glsl.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    inline bool isGrass(vec3 hsv) {
+        float hue = hsv.x * 360.0f;
+        return hsv.y > 0.1f && (hue < 149.0f && hue > 12.0f);
+    }
+
+    inline bool isWater(vec3 hsv) {
+        float hue = hsv.x * 360.0f;
+        return hsv.y > 0.1f && hue >= 147.0f && hue <= 270.0f;
+    }
+
+    inline bool isWaterPlane(vec4 wPos) {
+        float y = fract(wPos.y);
+        return y >= 0.7f && y <= 0.9f;
+    }
+
+    inline bool isRenderDistanceFog(vec2 fogControl) {
+        return fogControl.x > 0.6f;
+    }
+
+    inline float isClearWeather(vec2 fogControl) {
+        return smoothstep(0.8f, 1.0f, fogControl.y);
+    }
+
+    inline float isDuskOrDawn(vec4 fogColor) {
+        return pow(clamp(1.0f - fogColor.z * 1.7f, 0.0f, 1.0f), 0.3f);
+    }
+
+    inline float isNight(vec4 fogColor) {
+        return pow(clamp(1.0f - fogColor.x * 1.5f, 0.0f, 1.0f), 2.0f);
+    }
+
+    inline float occlusionFactor(vec3 color) {
+        const float shadowBorder = 0.83f;
+        const float shadowBlurLo = 0.05f;
+        const float shadowBlurHi = 0.01f;
+
+        float luminance = color.y * 2.0f - (color.x < color.z ? color.x : color.z);
+
+        return smoothstep(shadowBorder - shadowBlurLo, shadowBorder + shadowBlurHi, luminance);
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_HACKS_HPP_INCLUDED) */
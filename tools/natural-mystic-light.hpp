@@ -0,0 +1,144 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_LIGHT_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_LIGHT_HPP_INCLUDED 1
+
+/* C++ port of src/shaders/glsl/natural-mystic-light.h. Keep this in
+ * sync with the original. Only the analytic definitions are ported,
+ * as they are what the generated fits are checked against. Torch
+ * flickering isn't ported either.
+ */
+
+#include "glsl.hpp"
+#include "natural-mystic-color.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    const vec3 torchlightColor = vec3(1.0f, 0.66f, 0.28f);
+    const vec3 skylightColor   = vec3(0.8392f, 0.9098f, 0.9961f);
+    const vec3 moonlightColor  = vec3(112.0f, 135.5f, 255.0f) / 255.0f;
+
+    inline vec3 sunlightColor(float daylight) {
+        const vec3 setColor = vec3(1.0f, 0.3569f, 0.0196f);
+        const vec3 dayColor = vec3(1.0f, 0.8706f, 0.8039f);
+
+        return mix(setColor, dayColor, smoothstep(0.45f, 1.0f, daylight));
+    }
+
+    /* The points where the derivatives of the daylight-dependent
+     * colors above are discontinuous, i.e. the edges of the
+     * smoothstep() in sunlightColor(). */
+    const float daylightKnots[] = { 0.0f, 0.45f, 1.0f };
+
+    inline vec3 outsideLightColor(float daylight) {
+        vec3 daylightColor = mix(skylightColor, sunlightColor(daylight), 0.625f);
+        return mix(moonlightColor, daylightColor, daylight);
+    }
+
+    inline vec3 ambientLightColor(vec4 fogColor) {
+        return brighten(fogColor.rgb());
+    }
+
+    inline vec3 ambientLightColor(float sunLevel, float daylight) {
+        vec3 outsideColor = outsideLightColor(daylight);
+        return brighten(mix(torchlightColor, outsideColor, sunLevel));
+    }
+
+    inline vec3 ambientLight(vec3 lightColor, float intensity) {
+        return lightColor * intensity;
+    }
+
+    inline vec3 torchLight(float torchLevel, float sunLevel, float daylight, float flickerFactor) {
+        const float baseIntensity = 180.0f;
+        const float decay         = 5.0f;
+
+        if (torchLevel > 0.0f) {
+            float intensity = baseIntensity * pow(torchLevel, decay) * flickerFactor;
+            intensity *= mix(1.0f, 0.1f, smoothstep(0.65f, 0.875f, sunLevel * daylight));
+            return torchlightColor * intensity;
+        }
+        else {
+            return vec3(0.0f);
+        }
+    }
+
+    inline vec3 emissiveLight(float flickerFactor) {
+        const vec3  lightColor = torchlightColor;
+        const float intensity  = 60.0f;
+
+        return lightColor * intensity * flickerFactor;
+    }
+
+    inline vec3 sunlight(float sunLevel, float daylight) {
+        const float baseIntensity = 50.0f;
+        const float shadowFactor  = 0.01f;
+        const float shadowBorder  = 0.87f;
+        const float shadowBlur    = 0.003f;
+
+        float intensity = baseIntensity * sunLevel * daylight;
+        if (intensity > 0.0f) {
+            intensity *= mix(
+                shadowFactor, 1.0f,
+                smoothstep(shadowBorder - shadowBlur, shadowBorder + shadowBlur, sunLevel));
+            return sunlightColor(daylight) * intensity;
+        }
+        else {
+            return vec3(0.0f);
+        }
+    }
+
+    inline vec3 skylight(float sunLevel, float daylight) {
+        const float baseIntensity = 30.0f;
+
+        float intensity = baseIntensity * sunLevel * daylight;
+        if (intensity > 0.0f) {
+            return skylightColor * intensity;
+        }
+        else {
+            return vec3(0.0f);
+        }
+    }
+
+    inline vec3 moonlight(float sunLevel, float daylight) {
+        const float baseIntensity = 10.0f;
+        const float shadowFactor  = 0.20f;
+        const float shadowBorder  = 0.87f;
+        const float shadowBlur    = 0.003f;
+
+        float intensity = baseIntensity * sunLevel * (1.0f - daylight);
+        if (intensity > 0.0f) {
+            intensity *= mix(
+                shadowFactor, 1.0f,
+                smoothstep(shadowBorder - shadowBlur, shadowBorder + shadowBlur, sunLevel));
+            return moonlightColor * intensity;
+        }
+        else {
+            return vec3(0.0f);
+        }
+    }
+
+    inline vec3 specularLight(
+        float fresnel, float shininess, vec3 incomingDirLight, vec3 incomingUndirLight,
+        vec3 worldPos, vec3 normal) {
+
+        vec3 incomingLight = incomingDirLight + incomingUndirLight;
+        vec3 dirLightRatio = incomingDirLight / (incomingLight + vec3(0.001f));
+
+        const vec3 lightDir = normalize(vec3(-2.5f, 5.5f, 1.0f));
+
+        vec3  viewDir   = -normalize(worldPos);
+        vec3  halfDir   = normalize(viewDir + lightDir);
+        float incident  = max(0.0f, dot(lightDir, halfDir));
+        float reflAngle = max(0.0f, dot(halfDir, normal));
+        float dotNL     = max(0.0f, dot(normal, lightDir));
+        float reflCoeff = fresnel + (1.0f - fresnel) * pow(1.0f - incident, 5.0f);
+        vec3  specular  = incomingLight * 2.0f * pow(reflAngle, shininess) * reflCoeff * dotNL;
+
+        float viewAngle = max(0.0f, dot(normal, viewDir));
+        float viewCoeff = fresnel + (1.0f - fresnel) * pow(1.0f - viewAngle, 5.0f);
+        return specular * dirLightRatio +
+            viewCoeff * incomingLight * 0.03f;
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_LIGHT_HPP_INCLUDED) */
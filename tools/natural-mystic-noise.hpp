@@ -0,0 +1,281 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_NOISE_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_NOISE_HPP_INCLUDED 1
+
+/* C++ port of src/shaders/glsl/natural-mystic-noise.h. Keep this in
+ * sync with the original. Only the functions we actually use are
+ * ported.
+ */
+
+#include "glsl.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    /* Permutation in mod 289. */
+    const float noiseSimplex1Div289 = 0.00346020761245674740484429065744f;
+
+    inline float mod289(float x) {
+        return x - floor(x * noiseSimplex1Div289) * 289.0f;
+    }
+
+    template <typename V> inline if_vec<V> mod289(V x) {
+        return map(x, [](float p) { return mod289(p); });
+    }
+
+    template <typename V> inline if_vec<V> permute289(V x) {
+        return mod289((x * 34.0f + 1.0f) * x);
+    }
+
+    /* 2D simplex noise [-1, 1], based on https://github.com/stegu/webgl-noise/
+     */
+    inline float simplexNoise(vec2 v) {
+        const vec4 C = vec4(
+            0.211324865405187f,   // (3.0-sqrt(3.0))/6.0
+            0.366025403784439f,   // 0.5*(sqrt(3.0)-1.0)
+            -0.577350269189626f,  // -1.0 + 2.0 * C.x
+            0.024390243902439f);  // 1.0 / 41.0
+
+        // First corner
+        vec2 i  = floor(v + dot(v, vec2(C.y)));
+        vec2 x0 = v -   i + dot(i, vec2(C.x));
+
+        // Other corners
+        vec2 i1  = x0.x > x0.y ? vec2(1.0f, 0.0f) : vec2(0.0f, 1.0f);
+        vec4 x12 = vec4(x0, x0) + vec4(C.x, C.x, C.z, C.z);
+        x12.x -= i1.x;
+        x12.y -= i1.y;
+
+        // Permutations
+        i = mod289(i); // Avoid truncation effects in permutation
+        vec3 p =
+            permute289(
+                permute289(
+                    i.y + vec3(0.0f, i1.y, 1.0f)
+                    ) + i.x + vec3(0.0f, i1.x, 1.0f)
+                );
+
+        vec3 m = max(0.5f - vec3(dot(x0, x0), dot(x12.xy(), x12.xy()), dot(x12.zw(), x12.zw())), 0.0f);
+        m = m*m;
+        m = m*m;
+
+        // Gradients: 41 points uniformly over a line, mapped onto a
+        // diamond.  The ring size 17*17 = 289 is close to a multiple of
+        // 41 (41*7 = 287)
+        vec3 x  = 2.0f * fract(p * C.w) - 1.0f;
+        vec3 h  = abs(x) - 0.5f;
+        vec3 ox = round(x);
+        vec3 a0 = x - ox;
+
+        // Normalise gradients implicitly by scaling m
+        m *= inversesqrt(a0 * a0 + h * h);
+
+        // Compute final noise value at P
+        vec3 g;
+        g.x = a0.x * x0.x  + h.x * x0.y;
+        g.y = a0.y * x12.x + h.y * x12.y;
+        g.z = a0.z * x12.z + h.z * x12.w;
+        return 130.0f * dot(m, g);
+    }
+
+    /* Generate a 2D fBM noise [0, 1]. See
+     * https://thebookofshaders.com/13/
+     */
+    inline float fBM(int octaves, float lowerBound, float upperBound, vec2 st) {
+        float value     = 0.0f;
+        float amplitude = 0.5f;
+
+        for (int i = 0; i < octaves; i++) {
+            value += amplitude * (simplexNoise(st) * 0.5f + 0.5f);
+
+            if (value >= upperBound) {
+                break;
+            }
+            else if (value + amplitude <= lowerBound) {
+                break;
+            }
+
+            st        *= 2.0f;
+            amplitude *= 0.5f;
+        }
+
+        return smoothstep(lowerBound, upperBound, value);
+    }
+
+    /* Unrolled specializations of fBM(). */
+    inline void fBMOctave(float &value, bool &active, float lowerBound, float upperBound, vec2 st, float amplitude) {
+        if (active) {
+            value += amplitude * (simplexNoise(st) * 0.5f + 0.5f);
+            active = value < upperBound && value + amplitude > lowerBound;
+        }
+    }
+
+    inline float fBM3(float lowerBound, float upperBound, vec2 st) {
+        float value  = 0.0f;
+        bool  active = true;
+        fBMOctave(value, active, lowerBound, upperBound, st       , 0.5f  );
+        fBMOctave(value, active, lowerBound, upperBound, st * 2.0f, 0.25f );
+        fBMOctave(value, active, lowerBound, upperBound, st * 4.0f, 0.125f);
+        return smoothstep(lowerBound, upperBound, value);
+    }
+
+    inline float fBM6(float lowerBound, float upperBound, vec2 st) {
+        float value  = 0.0f;
+        bool  active = true;
+        fBMOctave(value, active, lowerBound, upperBound, st        , 0.5f     );
+        fBMOctave(value, active, lowerBound, upperBound, st *  2.0f, 0.25f    );
+        fBMOctave(value, active, lowerBound, upperBound, st *  4.0f, 0.125f   );
+        fBMOctave(value, active, lowerBound, upperBound, st *  8.0f, 0.0625f  );
+        fBMOctave(value, active, lowerBound, upperBound, st * 16.0f, 0.03125f );
+        fBMOctave(value, active, lowerBound, upperBound, st * 32.0f, 0.015625f);
+        return smoothstep(lowerBound, upperBound, value);
+    }
+
+    inline float nyquistFade(float cyclesPerPixel) {
+        return 1.0f - smoothstep(0.25f, 0.5f, cyclesPerPixel);
+    }
+
+    inline float fBMFiltered(int octaves, float lowerBound, float upperBound, vec2 st, float footprint) {
+        float value     = 0.0f;
+        float amplitude = 0.5f;
+
+        for (int i = 0; i < octaves; i++) {
+            float fade = nyquistFade(footprint);
+            if (fade <= 0.0f) {
+                value += amplitude * (1.0f - std::exp2(static_cast<float>(i - octaves)));
+                break;
+            }
+            value += amplitude * mix(0.5f, simplexNoise(st) * 0.5f + 0.5f, fade);
+
+            if (value >= upperBound) {
+                break;
+            }
+            else if (value + amplitude <= lowerBound) {
+                break;
+            }
+
+            st        *= 2.0f;
+            footprint *= 2.0f;
+            amplitude *= 0.5f;
+        }
+
+        return smoothstep(lowerBound, upperBound, value);
+    }
+
+    /* Unrolled specializations of fBMFiltered(). */
+    inline void fBMFilteredOctave(float &value, bool &active, float lowerBound, float upperBound, vec2 st, float footprint, float amplitude, float lastAmplitude) {
+        if (active) {
+            float fade = nyquistFade(footprint);
+            if (fade <= 0.0f) {
+                value  += amplitude - 0.5f * lastAmplitude;
+                active  = false;
+            }
+            else {
+                value += amplitude * mix(0.5f, simplexNoise(st) * 0.5f + 0.5f, fade);
+                active = value < upperBound && value + amplitude > lowerBound;
+            }
+        }
+    }
+
+    inline float fBMFiltered3(float lowerBound, float upperBound, vec2 st, float footprint) {
+        float value  = 0.0f;
+        bool  active = true;
+        fBMFilteredOctave(value, active, lowerBound, upperBound, st       , footprint       , 0.5f  , 0.125f);
+        fBMFilteredOctave(value, active, lowerBound, upperBound, st * 2.0f, footprint * 2.0f, 0.25f , 0.125f);
+        fBMFilteredOctave(value, active, lowerBound, upperBound, st * 4.0f, footprint * 4.0f, 0.125f, 0.125f);
+        return smoothstep(lowerBound, upperBound, value);
+    }
+
+    inline float fBMFiltered6(float lowerBound, float upperBound, vec2 st, float footprint) {
+        float value  = 0.0f;
+        bool  active = true;
+        fBMFilteredOctave(value, active, lowerBound, upperBound, st        , footprint        , 0.5f     , 0.015625f);
+        fBMFilteredOctave(value, active, lowerBound, upperBound, st *  2.0f, footprint *  2.0f, 0.25f    , 0.015625f);
+        fBMFilteredOctave(value, active, lowerBound, upperBound, st *  4.0f, footprint *  4.0f, 0.125f   , 0.015625f);
+        fBMFilteredOctave(value, active, lowerBound, upperBound, st *  8.0f, footprint *  8.0f, 0.0625f  , 0.015625f);
+        fBMFilteredOctave(value, active, lowerBound, upperBound, st * 16.0f, footprint * 16.0f, 0.03125f , 0.015625f);
+        fBMFilteredOctave(value, active, lowerBound, upperBound, st * 32.0f, footprint * 32.0f, 0.015625f, 0.015625f);
+        return smoothstep(lowerBound, upperBound, value);
+    }
+
+    /* Port of simplexNoiseGrad(): the noise and its gradient as
+     * (value, d/dx, d/dy). */
+    inline vec3 simplexNoiseGrad(vec2 v) {
+        const vec4 C = vec4(
+            0.211324865405187f,   // (3.0-sqrt(3.0))/6.0
+            0.366025403784439f,   // 0.5*(sqrt(3.0)-1.0)
+            -0.577350269189626f,  // -1.0 + 2.0 * C.x
+            0.024390243902439f);  // 1.0 / 41.0
+
+        vec2 i  = floor(v + dot(v, vec2(C.y)));
+        vec2 x0 = v -   i + dot(i, vec2(C.x));
+
+        vec2 i1  = x0.x > x0.y ? vec2(1.0f, 0.0f) : vec2(0.0f, 1.0f);
+        vec4 x12 = vec4(x0, x0) + vec4(C.x, C.x, C.z, C.z);
+        x12.x -= i1.x;
+        x12.y -= i1.y;
+
+        i = mod289(i);
+        vec3 p =
+            permute289(
+                permute289(
+                    i.y + vec3(0.0f, i1.y, 1.0f)
+                    ) + i.x + vec3(0.0f, i1.x, 1.0f)
+                );
+
+        vec3 t  = max(0.5f - vec3(dot(x0, x0), dot(x12.xy(), x12.xy()), dot(x12.zw(), x12.zw())), 0.0f);
+        vec3 t2 = t * t;
+        vec3 t4 = t2 * t2;
+
+        vec3 x    = 2.0f * fract(p * C.w) - 1.0f;
+        vec3 h    = abs(x) - 0.5f;
+        vec3 ox   = round(x);
+        vec3 a0   = x - ox;
+        vec3 norm = inversesqrt(a0 * a0 + h * h);
+
+        vec2 g0 = vec2(a0.x, h.x) * norm.x;
+        vec2 g1 = vec2(a0.y, h.y) * norm.y;
+        vec2 g2 = vec2(a0.z, h.z) * norm.z;
+
+        vec3 gx = vec3(dot(g0, x0), dot(g1, x12.xy()), dot(g2, x12.zw()));
+        vec3 w  = -8.0f * t2 * t * gx;
+        vec2 grad =
+            t4.x * g0 + w.x * x0 +
+            t4.y * g1 + w.y * x12.xy() +
+            t4.z * g2 + w.z * x12.zw();
+
+        return 130.0f * vec3(dot(t4, gx), grad.x, grad.y);
+    }
+
+    /* Emulation of fBMQuad(). The original splits the octaves among
+     * the four fragments of a 2x2 quad and sums them up with
+     * derivatives. Here "stc", "offset", and "footprint" are what
+     * each of the four fragments would see, indexed by quadIndex(),
+     * where "offset" is the result of quadOffset(). The result of
+     * each fragment goes to "out".
+     */
+    inline void fBMQuad(int octaves, float lowerBound, float upperBound,
+                        const vec2 stc[4], const vec2 offset[4], const float footprint[4], float out[4]) {
+        vec3 value;
+
+        for (int lane = 0; lane < 4; lane++) {
+            for (int i = 0; i < (octaves + 3) / 4; i++) {
+                float octave    = static_cast<float>(lane + i * 4);
+                float frequency = std::exp2(octave);
+                float amplitude = octave < static_cast<float>(octaves) ? 0.5f / frequency : 0.0f;
+
+                float fade  = nyquistFade(footprint[lane] * frequency);
+                vec3  noise = simplexNoiseGrad(stc[lane] * frequency);
+                value.x += amplitude * mix(0.5f, noise.x * 0.5f + 0.5f, fade);
+                value.y += amplitude * fade * 0.5f * frequency * noise.y;
+                value.z += amplitude * fade * 0.5f * frequency * noise.z;
+            }
+        }
+
+        for (int lane = 0; lane < 4; lane++) {
+            out[lane] = smoothstep(lowerBound, upperBound, value.x + dot(vec2(value.y, value.z), offset[lane]));
+        }
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_NOISE_HPP_INCLUDED) */
@@ -0,0 +1,90 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_RAIN_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_RAIN_HPP_INCLUDED 1
+
+/* C++ port of src/shaders/glsl/natural-mystic-rain.h. Keep this in
+ * sync with the original. RIPPLES_DISTANCE is a parameter here
+ * because it's a configuration item.
+ */
+
+#include "glsl.hpp"
+#include "natural-mystic-noise.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    inline float wetness(float clearWeather, float sunLevel) {
+        const float shadowBorder = 0.80f;
+        const float shadowBlur   = 0.06f;
+
+        return (1.0f - clearWeather) * smoothstep(shadowBorder - shadowBlur, shadowBorder + shadowBlur, sunLevel);
+    }
+
+    const vec3 rippleResolution = vec3(vec2(0.16f), 0.5f);
+
+    /* The coordinate of the noise of ripples. */
+    inline vec2 rippleCoords(vec3 worldPos) {
+        return worldPos.xz() / rippleResolution.xy();
+    }
+
+    /* The offsets and the weights of the two layers of noise of
+     * ripples, which only depend on the time. */
+    inline void rippleLayers(float time, vec2 &gen, vec2 &weight) {
+        float t  = time / rippleResolution.z;
+        vec2  t2 = t + vec2(0.0f, 0.5f);
+        vec2  ph = fract(t2);
+        gen    = map(floor(t2), [](float p) { return std::fmod(p, 17.0f); }) * 23.0f;
+        weight = 1.0f - abs(ph * 2.0f - 1.0f);
+    }
+
+    /* Emulation of rippleNoiseQuad(). "stc" and "offset" are what
+     * each of the four fragments of a quad would see, indexed by
+     * quadIndex(), as in fBMQuad(). The result of each fragment goes
+     * to "out". */
+    inline void rippleNoiseQuad(const vec2 stc[4], const vec2 offset[4], vec2 gen, vec2 weight, float out[4]) {
+        vec3 noise = weight.x * simplexNoiseGrad(stc[0] + gen.x)
+                   + weight.y * simplexNoiseGrad(stc[1] - gen.y);
+
+        for (int lane = 0; lane < 4; lane++) {
+            out[lane] = noise.x + dot(vec2(noise.y, noise.z), offset[lane]);
+        }
+    }
+
+    /* "quadNoise" is the result of rippleNoiseQuad() for the
+     * fragment, or null to evaluate the noise per pixel. */
+    inline vec3 ripples(float ripplesDistance, float wet, vec3 incomingLight, vec3 worldPos, float cameraDepth,
+                        float time, vec3 normal, float footprint, const float *quadNoise = nullptr) {
+        const float minCosTheta = 0.1f;
+        float cosTheta = normal.y;
+        float slope    = smoothstep(minCosTheta, minCosTheta + 0.1f, cosTheta);
+
+        const float distThreshold = ripplesDistance;
+        const float distFadeStart = distThreshold * 0.8f;
+
+        float fade = nyquistFade(footprint / rippleResolution.x);
+
+        if (slope > 0.0f && wet > 0.0f && cameraDepth < distThreshold && fade > 0.0f) {
+            const float amount = 0.1f;
+
+            vec2 st = rippleCoords(worldPos);
+            vec2 gen, weight;
+            rippleLayers(time, gen, weight);
+
+            float r = quadNoise
+                ? *quadNoise
+                : dot(weight, vec2(simplexNoise(st + gen.x), simplexNoise(st - gen.y)));
+            r *= inversesqrt(dot(weight, weight));
+
+            r = (r + 0.8f) * 0.5f;
+            r = smoothstep(0.3f, 1.0f, r);
+
+            return incomingLight * wet * mix(0.2f, 1.0f, cosTheta) * slope * r * amount * fade *
+                (1.0f - smoothstep(distFadeStart, distThreshold, cameraDepth));
+        }
+        else {
+            return vec3(0.0f);
+        }
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_RAIN_HPP_INCLUDED) */
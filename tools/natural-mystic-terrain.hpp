@@ -0,0 +1,84 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_TERRAIN_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_TERRAIN_HPP_INCLUDED 1
+
+/* C++ port of src/shaders/glsl/natural-mystic-terrain.h. Keep this in
+ * sync with the original. Things the original selects with the
+ * preprocessor are parameters here.
+ */
+
+#include "glsl.hpp"
+#include "natural-mystic-hacks.hpp"
+#include "natural-mystic-light.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    inline float terrainDaylight(float lightmapDaylight) {
+        return smoothstep(0.4f, 1.0f, lightmapDaylight);
+    }
+
+    inline float terrainAmbientBrightness(float lightmapAmbient) {
+        return lightmapAmbient * 44.797f;
+    }
+
+    /* "fog" and "underwater" correspond to the FOG and UNDERWATER
+     * material defines. MCPE40059 is always assumed. */
+    inline void terrainLight(
+        bool fog, bool underwater, vec2 fogControl,
+        vec2 lightLevels, float daylight, float ambientBrightness,
+        vec4 fogColor, float clearWeather, float flickerFactor, bool alwaysLit,
+        vec3 &ambientColor, vec3 &dirLight, vec3 &undirLight) {
+
+        if (fog) {
+            if (isRenderDistanceFog(fogControl)) {
+                ambientColor = ambientLightColor(lightLevels.y, daylight);
+            }
+            else if (underwater) {
+                ambientColor = ambientLightColor(fogColor);
+                ambientBrightness *= mix(0.9f, 1.4f, daylight);
+            }
+            else {
+                ambientColor = mix(
+                    ambientLightColor(fogColor),
+                    ambientLightColor(lightLevels.y, daylight),
+                    clearWeather);
+                ambientBrightness *= mix(mix(0.9f, 1.4f, daylight), 1.0f, clearWeather);
+            }
+        }
+        else {
+            ambientColor = ambientLightColor(lightLevels.y, daylight);
+        }
+
+        dirLight   = vec3(0.0f);
+        undirLight = vec3(0.0f);
+
+        undirLight += ambientLight(ambientColor, ambientBrightness);
+        if (fog && !underwater) {
+            dirLight += sunlight(lightLevels.y, daylight) * clearWeather;
+            dirLight += moonlight(lightLevels.y, daylight) * clearWeather;
+        }
+        else {
+            dirLight += sunlight(lightLevels.y, daylight);
+            dirLight += moonlight(lightLevels.y, daylight);
+        }
+        undirLight += skylight(lightLevels.y, daylight);
+        undirLight += torchLight(lightLevels.x, lightLevels.y, daylight, flickerFactor);
+
+        if (alwaysLit) {
+            undirLight += emissiveLight(flickerFactor);
+        }
+    }
+
+    inline vec3 occlusionShadow(bool enabled, vec3 dirLight, float occlusion) {
+        if (enabled) {
+            const float occlShadow = 0.35f;
+            return dirLight * mix(occlShadow, 1.0f, occlusion);
+        }
+        else {
+            return dirLight;
+        }
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_TERRAIN_HPP_INCLUDED) */
@@ -0,0 +1,118 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_WATER_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_WATER_HPP_INCLUDED 1
+
+/* C++ port of src/shaders/glsl/natural-mystic-water.h. Keep this in
+ * sync with the original. The quad-shared variant isn't ported; see
+ * nm-pipeline.hpp for how it's emulated.
+ */
+
+#include "glsl.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    inline vec3 gerstnerWave(
+        vec3 wPos, float time, vec3 &normal,
+        float Q, float numWaves, float Ai, vec2 Di, float Li, float Si) {
+
+        const float wFactor = 9.80665f * 2.0f * 3.14159f;
+        float wi    = sqrt(wFactor / Li);
+        float Qi    = Q / (wi * Ai * numWaves);
+        float phi_i = Si * 2.0f / Li;
+
+        float theta    = wi * dot(Di, wPos.xz()) + phi_i * time;
+        float cosTheta = cos(theta);
+        float sinTheta = sin(theta);
+
+        wPos.x += Di.x * Qi * Ai * cosTheta;
+        wPos.z += Di.y * Qi * Ai * cosTheta;
+        wPos.y +=               Ai * sinTheta;
+
+        float wiAi = wi * Ai;
+        normal.x -= wiAi * Di.x * cosTheta;
+        normal.z -= wiAi * Di.y * cosTheta;
+        normal.y -= wiAi * Qi * sinTheta;
+
+        return wPos;
+    }
+
+    inline vec3 gerstnerWaveN(
+        vec3 wPos, float time, vec3 normal,
+        float Q, float numWaves, float Ai, vec2 Di, float Li, float Si) {
+
+        const float wFactor = 9.80665f * 2.0f * 3.14159f;
+        float wi    = sqrt(wFactor / Li);
+        float Qi    = Q / (wi * Ai * numWaves);
+        float phi_i = Si * 2.0f / Li;
+
+        float theta = wi * dot(Di, wPos.xz()) + phi_i * time;
+        float wiAi  = wi * Ai;
+        normal.x -= wiAi * Di.x * cos(theta);
+        normal.z -= wiAi * Di.y * cos(theta);
+        normal.y -= wiAi * Qi * sin(theta);
+        return normal;
+    }
+
+    inline vec2 deg2dir(float deg) {
+        float rad = radians(deg);
+        return vec2(cos(rad), sin(rad));
+    }
+
+    inline vec3 waterWaveGeometric(vec3 wPos, float time, vec3 &normal) {
+        const float Q        = 0.45f;
+        const float numWaves = 4.0f;
+
+        normal = vec3(0.0f, 1.0f, 0.0f);
+        wPos   = gerstnerWave(wPos, time, normal, Q, numWaves, 0.08f, deg2dir( 90.0f), 16.0f,  7.0f);
+        wPos   = gerstnerWave(wPos, time, normal, Q, numWaves, 0.08f, deg2dir(260.0f), 15.0f,  8.0f);
+        wPos   = gerstnerWave(wPos, time, normal, Q, numWaves, 0.05f, deg2dir( 70.0f),  8.0f, 13.0f);
+        wPos   = gerstnerWave(wPos, time, normal, Q, numWaves, 0.02f, deg2dir(200.0f),  7.0f, 14.0f);
+        return wPos;
+    }
+
+    inline vec3 waterWaveNormal(vec3 wPos, float time, vec3 normal) {
+        const float Q        = 0.45f;
+        const float numWaves = 3.0f;
+
+        normal = gerstnerWaveN(wPos, time, normal, Q, numWaves, 0.0058f, deg2dir( 85.0f), 0.75f,  1.0f);
+        normal = gerstnerWaveN(wPos, time, normal, Q, numWaves, 0.0058f, deg2dir(255.0f), 0.725f, 2.0f);
+        normal = gerstnerWaveN(wPos, time, normal, Q, numWaves, 0.0045f, deg2dir( 65.0f), 0.7f,   2.0f);
+        return normal;
+    }
+
+    inline vec4 waterSpecularLight(
+        float baseOpacity, vec3 incomingDirLight, vec3 incomingUndirLight,
+        vec3 worldPos, float time, vec3 normal) {
+
+        (void)time;
+
+        vec3 incomingLight = incomingDirLight + incomingUndirLight;
+        vec3 dirLightRatio = incomingDirLight / (incomingLight + vec3(0.001f));
+
+        const vec3 lightDir = normalize(vec3(-2.5f, 2.5f, 0.0f));
+
+        vec3        viewDir   = -normalize(worldPos);
+        const float shininess = 80.0f;
+
+        const float fresnel   = 0.02f;
+        vec3        halfDir   = normalize(viewDir + lightDir);
+        float       incident  = max(0.0f, dot(viewDir, halfDir));
+        float       reflAngle = max(0.0f, dot(halfDir, normal));
+        float       reflCoeff = fresnel + (1.0f - fresnel) * pow(1.0f - incident, 5.0f);
+        float       specCoeff = pow(reflAngle, shininess) * reflCoeff;
+        vec3        specular  = incomingLight * 180.0f * specCoeff;
+
+        float viewAngle = max(0.0f, dot(normal, viewDir));
+        float opacCoeff = fresnel + (1.0f - fresnel) * pow(1.0f - viewAngle, 5.0f);
+        float opacity   = mix(baseOpacity, min(1.0f, baseOpacity * 8.0f), opacCoeff);
+
+        float sharpOpac = smoothstep(0.1f, 0.2f, opacCoeff);
+        return vec4(
+            specular * dirLightRatio * sharpOpac +
+            opacCoeff * incomingLight * 0.15f,
+            mix(opacity, 1.0f, specCoeff));
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_WATER_HPP_INCLUDED) */
@@ -0,0 +1,384 @@
+// -*- c++ -*-
+/* nm-capture: Write frame captures for nm-replay.
+ *
+ * A capture (see nm-capture.hpp) is either one of the synthetic
+ * scenes of nm-golden, or world geometry exported from the game as a
+ * Wavefront OBJ file and lit like one of those scenes. The latter is
+ * what makes captures interesting: synthetic scenes don't have the
+ * mix of water, foliage, torches, and sky that real worlds have.
+ *
+ * Usage: nm-capture --scene=NAME [--size=WxH] OUTPUT
+ *        nm-capture --scene=NAME --obj=FILE --eye=X,Y,Z [--atlas=FILE]
+ *                   [--yaw=DEGREES] [--pitch=DEGREES] [--size=WxH] OUTPUT
+ *
+ * With --obj, the geometry comes from FILE and only the fog, the sky,
+ * the daylight, and the camera angles come from the scene. The
+ * coordinates in FILE are in blocks, and --eye is the position of the
+ * camera in the same coordinates. The following records are read and
+ * everything else is ignored:
+ *
+ *   v X Y Z [R G B]  A vertex with an optional color, which is what
+ *                    the game passes as COLOR (biome tint and ambient
+ *                    occlusion). It defaults to white.
+ *   vl TORCH SUN     The light levels [0, 1] of the vertex defined by
+ *                    the corresponding "v" record. This isn't
+ *                    standard OBJ, as OBJ has no second set of
+ *                    texture coordinates. They default to 0 and 1.
+ *   vt U V           Texture coordinates in the atlas, with V growing
+ *                    upwards as usual in OBJ.
+ *   usemtl NAME      Selects the layer of the following faces. Names
+ *                    containing "blend" or "water" are blended, and
+ *                    the ones containing "alpha" or "cutout" are
+ *                    alpha-tested. Everything else is opaque.
+ *   f V/VT ...       A convex polygon.
+ *
+ * The faces are split into 16x16x16 chunks like the game does.
+ * --atlas is an uncompressed 24-bit or 32-bit TGA image. Without it,
+ * the atlas is a single white texel.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "nm-capture.hpp"
+#include "nm-scenes.hpp"
+
+using namespace glsl;
+
+namespace {
+    /* Read an uncompressed true-color TGA image with or without
+     * alpha. */
+    bool readAtlas(const std::string &path, nm::texture &atlas) {
+        FILE *in = std::fopen(path.c_str(), "rb");
+        if (!in) {
+            std::perror(path.c_str());
+            return false;
+        }
+
+        unsigned char header[18];
+        bool ok = std::fread(header, sizeof(header), 1, in) == 1 &&
+                  header[1] == 0 && header[2] == 2 &&
+                  (header[16] == 24 || header[16] == 32) &&
+                  std::fseek(in, header[0], SEEK_CUR) == 0;
+        if (ok) {
+            const int  bytes   = header[16] / 8;
+            const bool topDown = header[17] & 0x20;
+            atlas.width  = header[12] | header[13] << 8;
+            atlas.height = header[14] | header[15] << 8;
+            atlas.texels.resize(static_cast<std::size_t>(atlas.width) * atlas.height);
+
+            std::vector<unsigned char> data(atlas.texels.size() * bytes);
+            ok = !data.empty() && std::fread(data.data(), data.size(), 1, in) == 1;
+            for (int y = 0; ok && y < atlas.height; y++) {
+                int row = topDown ? y : atlas.height - 1 - y;
+                for (int x = 0; x < atlas.width; x++) {
+                    const unsigned char *p = &data[(static_cast<std::size_t>(row) * atlas.width + x) * bytes];
+                    atlas.texels[static_cast<std::size_t>(y) * atlas.width + x] =
+                        vec4(p[2], p[1], p[0], bytes == 4 ? p[3] : 255) * (1.0f / 255.0f);
+                }
+            }
+        }
+        std::fclose(in);
+        if (!ok) {
+            std::fprintf(stderr, "%s: not an uncompressed 24-bit or 32-bit TGA image\n", path.c_str());
+        }
+        return ok;
+    }
+
+    /* World geometry read from an OBJ file, split into chunks and
+     * layers. */
+    class obj_world {
+    public:
+        bool read(const std::string &path) {
+            std::ifstream in(path);
+            if (!in) {
+                std::perror(path.c_str());
+                return false;
+            }
+
+            int layer = 0;
+            std::string line;
+            for (int lineNo = 1; std::getline(in, line); lineNo++) {
+                std::istringstream ss(line);
+                std::string        tag;
+                ss >> tag;
+                if (tag == "v") {
+                    vertex v;
+                    ss >> v.pos.x >> v.pos.y >> v.pos.z;
+                    if (!ss) {
+                        return fail(path, lineNo);
+                    }
+                    if (!(ss >> v.color.x >> v.color.y >> v.color.z)) {
+                        v.color = vec3(1.0f);
+                    }
+                    positions_.push_back(v);
+                }
+                else if (tag == "vl") {
+                    vec2 l;
+                    if (!(ss >> l.x >> l.y)) {
+                        return fail(path, lineNo);
+                    }
+                    lights_.push_back(l);
+                }
+                else if (tag == "vt") {
+                    vec2 t;
+                    if (!(ss >> t.x >> t.y)) {
+                        return fail(path, lineNo);
+                    }
+                    uvs_.push_back(vec2(t.x, 1.0f - t.y));
+                }
+                else if (tag == "usemtl") {
+                    std::string name;
+                    ss >> name;
+                    layer = layerOf(name);
+                }
+                else if (tag == "f") {
+                    std::vector<std::pair<long, long>> poly;
+                    std::string ref;
+                    while (ss >> ref) {
+                        long v = 0, t = 0;
+                        if (!parseRef(ref, v, t)) {
+                            return fail(path, lineNo);
+                        }
+                        poly.emplace_back(v, t);
+                    }
+                    if (poly.size() < 3) {
+                        return fail(path, lineNo);
+                    }
+                    for (std::size_t k = 1; k + 1 < poly.size(); k++) {
+                        triangle tri = {layer, {poly[0], poly[k], poly[k + 1]}};
+                        triangles_.push_back(tri);
+                    }
+                }
+            }
+            return true;
+        }
+
+        /* Replace the draws of "f" with the chunks of this world,
+         * seen from "eye". The uniforms other than
+         * CHUNK_ORIGIN_AND_SCALE are taken from the sky of "f". */
+        void build(nm::frame &f, vec3 eye, unsigned common) {
+            std::map<std::tuple<int, int, int, int>, std::size_t> index;
+            for (const triangle &tri: triangles_) {
+                vec3 centroid(0.0f);
+                for (const auto &ref: tri.refs) {
+                    centroid = centroid + positions_[ref.first].pos * (1.0f / 3.0f);
+                }
+                auto key = std::make_tuple(static_cast<int>(std::floor(centroid.x / 16.0f)),
+                                           static_cast<int>(std::floor(centroid.y / 16.0f)),
+                                           static_cast<int>(std::floor(centroid.z / 16.0f)),
+                                           tri.layer);
+                auto it = index.find(key);
+                if (it == index.end()) {
+                    it = index.emplace(key, meshes_.size()).first;
+                    meshes_.emplace_back();
+                    meshes_.back().origin = vec3(static_cast<float>(std::get<0>(key) * 16),
+                                                 static_cast<float>(std::get<1>(key) * 16),
+                                                 static_cast<float>(std::get<2>(key) * 16));
+                    meshes_.back().layer  = tri.layer;
+                }
+
+                mesh &m = meshes_[it->second];
+                for (const auto &ref: tri.refs) {
+                    const vertex &v = positions_[ref.first];
+                    vec2 light = ref.first < static_cast<long>(lights_.size())
+                        ? lights_[ref.first] : vec2(0.0f, 1.0f);
+                    vec2 uv    = ref.second >= 0 ? uvs_[ref.second] : vec2(0.0f);
+                    vec3 local = v.pos - m.origin;
+
+                    nm::terrain_vertex tv = {
+                        {local.x, local.y, local.z},
+                        {light.x, light.y},
+                        {v.color.x, v.color.y, v.color.z, 1.0f},
+                        {uv.x, uv.y},
+                    };
+                    m.indices.push_back(static_cast<std::uint32_t>(m.vertices.size()));
+                    m.vertices.push_back(tv);
+                }
+            }
+
+            const unsigned variants[3] = {common, common | nm::VARIANT_ALPHA_TEST, common | nm::VARIANT_BLEND};
+            f.draws.clear();
+            for (const mesh &m: meshes_) {
+                nm::draw d;
+                d.variant     = variants[m.layer];
+                d.u           = f.sky;
+                d.u.CHUNK_ORIGIN_AND_SCALE = vec4(m.origin - eye, 1.0f);
+                d.vertices    = m.vertices.data();
+                d.numVertices = m.vertices.size();
+                d.indices     = m.indices.data();
+                d.numIndices  = m.indices.size();
+                f.draws.push_back(d);
+            }
+        }
+
+    private:
+        struct vertex {
+            vec3 pos;
+            vec3 color;
+        };
+
+        struct triangle {
+            int                     layer;
+            std::pair<long, long>   refs[3]; // Indices of "v" and "vt", or -1.
+        };
+
+        struct mesh {
+            vec3                            origin;
+            int                             layer;
+            std::vector<nm::terrain_vertex> vertices;
+            std::vector<std::uint32_t>      indices;
+        };
+
+        static int layerOf(const std::string &name) {
+            if (name.find("blend") != std::string::npos || name.find("water") != std::string::npos) {
+                return 2;
+            }
+            else if (name.find("alpha") != std::string::npos || name.find("cutout") != std::string::npos) {
+                return 1;
+            }
+            return 0;
+        }
+
+        /* Parse "V", "V/VT", "V/VT/VN", or "V//VN" into 0-based
+         * indices. Negative indices are relative to the end. */
+        bool parseRef(const std::string &ref, long &v, long &t) const {
+            char *end;
+            v = std::strtol(ref.c_str(), &end, 10);
+            t = 0;
+            if (*end == '/' && end[1] != '/') {
+                t = std::strtol(end + 1, &end, 10);
+            }
+            v = v < 0 ? static_cast<long>(positions_.size()) + v : v - 1;
+            t = t < 0 ? static_cast<long>(uvs_.size()) + t : t - 1;
+            return v >= 0 && v < static_cast<long>(positions_.size()) &&
+                   t < static_cast<long>(uvs_.size());
+        }
+
+        static bool fail(const std::string &path, int lineNo) {
+            std::fprintf(stderr, "%s:%d: malformed or unsupported record\n", path.c_str(), lineNo);
+            return false;
+        }
+
+        std::vector<vertex>   positions_;
+        std::vector<vec2>     lights_;
+        std::vector<vec2>     uvs_;
+        std::vector<triangle> triangles_;
+        std::vector<mesh>     meshes_;
+    };
+
+    void usage(const char *prog) {
+        std::fprintf(stderr,
+                     "Usage: %s --scene=NAME [--size=WxH] OUTPUT\n"
+                     "       %s --scene=NAME --obj=FILE --eye=X,Y,Z [--atlas=FILE]\n"
+                     "          [--yaw=DEGREES] [--pitch=DEGREES] [--size=WxH] OUTPUT\n",
+                     prog, prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string sceneName;
+    std::string objPath;
+    std::string atlasPath;
+    std::string output;
+    bool        hasEye = false, hasYaw = false, hasPitch = false;
+    vec3        eye;
+    float       yaw = 0.0f, pitch = 0.0f;
+    int         width  = 320;
+    int         height = 180;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--scene=", 8) == 0) {
+            sceneName = argv[i] + 8;
+        }
+        else if (std::strncmp(argv[i], "--obj=", 6) == 0) {
+            objPath = argv[i] + 6;
+        }
+        else if (std::strncmp(argv[i], "--atlas=", 8) == 0) {
+            atlasPath = argv[i] + 8;
+        }
+        else if (std::strncmp(argv[i], "--eye=", 6) == 0) {
+            hasEye = std::sscanf(argv[i] + 6, "%f,%f,%f", &eye.x, &eye.y, &eye.z) == 3;
+            if (!hasEye) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--yaw=", 6) == 0) {
+            yaw    = radians(static_cast<float>(std::atof(argv[i] + 6)));
+            hasYaw = true;
+        }
+        else if (std::strncmp(argv[i], "--pitch=", 8) == 0) {
+            pitch    = radians(static_cast<float>(std::atof(argv[i] + 8)));
+            hasPitch = true;
+        }
+        else if (std::strncmp(argv[i], "--size=", 7) == 0) {
+            if (std::sscanf(argv[i] + 7, "%dx%d", &width, &height) != 2 ||
+                width < 16 || height < 16 || width > 4096 || height > 4096) {
+                usage(argv[0]);
+            }
+        }
+        else if (argv[i][0] != '-' && output.empty()) {
+            output = argv[i];
+        }
+        else {
+            usage(argv[0]);
+        }
+    }
+    if (sceneName.empty() || output.empty() || objPath.empty() != !hasEye ||
+        (objPath.empty() && (!atlasPath.empty() || hasYaw || hasPitch))) {
+        usage(argv[0]);
+    }
+
+    const nm::scene_desc *desc = nm::findScene(sceneName);
+    if (!desc) {
+        std::fprintf(stderr, "%s: unknown scene: %s\n", argv[0], sceneName.c_str());
+        return 1;
+    }
+
+    nm::scene         s(*desc, width, height);
+    nm::frame         f    = s.get();
+    nm::capture_view  view = {width, height, desc->yaw, desc->pitch, radians(70.0f)};
+    obj_world         obj;
+    nm::texture       atlas;
+
+    if (!objPath.empty()) {
+        if (!obj.read(objPath)) {
+            return 1;
+        }
+        if (atlasPath.empty()) {
+            atlas.width  = 1;
+            atlas.height = 1;
+            atlas.texels.assign(1, vec4(1.0f));
+        }
+        else if (!readAtlas(atlasPath, atlas)) {
+            return 1;
+        }
+        obj.build(f, eye, nm::VARIANT_FOG | nm::VARIANT_FANCY |
+                  (desc->underwater ? nm::VARIANT_UNDERWATER : 0u));
+        f.atlas = &atlas;
+        view.yaw   = hasYaw   ? yaw   : view.yaw;
+        view.pitch = hasPitch ? pitch : view.pitch;
+    }
+
+    if (!nm::writeCapture(output, f, view)) {
+        return 1;
+    }
+
+    std::size_t vertices = 0, triangles = 0;
+    for (const nm::draw &d: f.draws) {
+        vertices  += d.numVertices;
+        triangles += d.numIndices / 3;
+    }
+    std::printf("%s: %zu draws, %zu vertices, %zu triangles\n",
+                output.c_str(), f.draws.size(), vertices, triangles);
+    return 0;
+}
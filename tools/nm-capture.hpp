@@ -0,0 +1,340 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_CAPTURE_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_CAPTURE_HPP_INCLUDED 1
+
+/* Frame captures: a file holding everything nm-pipeline.hpp needs to
+ * render a frame, laid out so that it can be memory-mapped and
+ * rendered without parsing or copying the vertex buffers.
+ *
+ * The layout is the following, in the byte order of the machine
+ * that wrote it. Offsets are from the beginning of the file, and
+ * every section starts at a multiple of 8 bytes.
+ *
+ *   capture_header
+ *   capture_draw[numDraws]       at drawsOffset
+ *   RGBA8 texels of the atlas    at atlasOffset, from top to bottom
+ *   terrain_vertex[numVertices]  at verticesOffset of each draw
+ *   uint32_t[numIndices]         at indicesOffset of each draw
+ *
+ * Vertices are in the layout of terrain.material: POSITION,
+ * TEXCOORD_1, COLOR, and TEXCOORD_0, all as floats. Positions are
+ * relative to CHUNK_ORIGIN_AND_SCALE of the draw, which is in turn
+ * relative to the camera, as in the game. Draws are stored in the
+ * order the game issues them.
+ *
+ * Bump captureVersion whenever the layout changes. Readers reject
+ * files with a different version rather than trying to convert them.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nm-pipeline.hpp"
+
+namespace nm {
+    const char          captureMagic[8] = {'N', 'M', 'C', 'A', 'P', 'T', 'U', 'R'};
+    const std::uint32_t captureVersion  = 1;
+    const std::uint32_t captureByteOrder = 0x01020304;
+
+    /* "uniforms" with only fixed-size members. */
+    struct capture_uniforms {
+        float FOG_COLOR[4];
+        float FOG_CONTROL[2];
+        float RENDER_DISTANCE;
+        float FAR_CHUNKS_DISTANCE;
+        float RENDER_CHUNK_FOG_ALPHA;
+        float TOTAL_REAL_WORLD_TIME;
+        float CURRENT_COLOR[4];
+        float CHUNK_ORIGIN_AND_SCALE[4];
+        float lightmapDaylight; // TEXTURE_1 at (0, 1)
+        float lightmapAmbient;  // TEXTURE_1 at (0, 0)
+    };
+
+    struct capture_header {
+        char             magic[8];
+        std::uint32_t    version;
+        std::uint32_t    byteOrder;
+        std::int32_t     width, height;   // The size of the viewport.
+        float            yaw, pitch, fovY; // See "camera", in radians.
+        std::uint32_t    atlasWidth, atlasHeight;
+        std::uint32_t    numDraws;
+        capture_uniforms sky;
+        std::uint64_t    drawsOffset;
+        std::uint64_t    atlasOffset;
+        std::uint64_t    fileSize;
+    };
+
+    struct capture_draw {
+        std::uint32_t    variant; // variant_bits
+        std::uint32_t    reserved;
+        capture_uniforms u;
+        std::uint64_t    verticesOffset;
+        std::uint64_t    numVertices;
+        std::uint64_t    indicesOffset;
+        std::uint64_t    numIndices;
+    };
+
+    static_assert(sizeof(capture_uniforms) == 20 * 4, "capture_uniforms must not be padded");
+    static_assert(sizeof(capture_header)   == 152,    "capture_header must not be padded");
+    static_assert(sizeof(capture_draw)     == 120,    "capture_draw must not be padded");
+    static_assert(sizeof(terrain_vertex)   == 11 * 4, "terrain_vertex must not be padded");
+
+    namespace detail {
+        inline void store(float *dst, const float *src, int n) {
+            std::memcpy(dst, src, sizeof(float) * n);
+        }
+
+        inline capture_uniforms toCapture(const uniforms &u) {
+            capture_uniforms c;
+            store(c.FOG_COLOR,              &u.FOG_COLOR.x,              4);
+            store(c.FOG_CONTROL,            &u.FOG_CONTROL.x,            2);
+            store(c.CURRENT_COLOR,          &u.CURRENT_COLOR.x,          4);
+            store(c.CHUNK_ORIGIN_AND_SCALE, &u.CHUNK_ORIGIN_AND_SCALE.x, 4);
+            c.RENDER_DISTANCE        = u.RENDER_DISTANCE;
+            c.FAR_CHUNKS_DISTANCE    = u.FAR_CHUNKS_DISTANCE;
+            c.RENDER_CHUNK_FOG_ALPHA = u.RENDER_CHUNK_FOG_ALPHA;
+            c.TOTAL_REAL_WORLD_TIME  = u.TOTAL_REAL_WORLD_TIME;
+            c.lightmapDaylight       = u.lightmapDaylight;
+            c.lightmapAmbient        = u.lightmapAmbient;
+            return c;
+        }
+
+        inline uniforms fromCapture(const capture_uniforms &c) {
+            uniforms u = {};
+            store(&u.FOG_COLOR.x,              c.FOG_COLOR,              4);
+            store(&u.FOG_CONTROL.x,            c.FOG_CONTROL,            2);
+            store(&u.CURRENT_COLOR.x,          c.CURRENT_COLOR,          4);
+            store(&u.CHUNK_ORIGIN_AND_SCALE.x, c.CHUNK_ORIGIN_AND_SCALE, 4);
+            u.RENDER_DISTANCE        = c.RENDER_DISTANCE;
+            u.FAR_CHUNKS_DISTANCE    = c.FAR_CHUNKS_DISTANCE;
+            u.RENDER_CHUNK_FOG_ALPHA = c.RENDER_CHUNK_FOG_ALPHA;
+            u.TOTAL_REAL_WORLD_TIME  = c.TOTAL_REAL_WORLD_TIME;
+            u.lightmapDaylight       = c.lightmapDaylight;
+            u.lightmapAmbient        = c.lightmapAmbient;
+            return u;
+        }
+
+        inline std::uint64_t align8(std::uint64_t off) {
+            return (off + 7) & ~static_cast<std::uint64_t>(7);
+        }
+
+        inline unsigned char toUnorm8(float x) {
+            return static_cast<unsigned char>(clamp(x, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+
+    /* The viewport and the camera of a capture. */
+    struct capture_view {
+        int   width, height;
+        float yaw, pitch, fovY;
+    };
+
+    /* Write a frame to a capture file. Return false and print a
+     * message on failure. */
+    inline bool writeCapture(const std::string &path, const frame &f, const capture_view &view) {
+        std::vector<unsigned char> out;
+        auto reserve = [&out](std::uint64_t bytes) {
+            std::uint64_t off = detail::align8(out.size());
+            out.resize(off + bytes);
+            return off;
+        };
+
+        reserve(sizeof(capture_header));
+        std::uint64_t drawsOffset = reserve(sizeof(capture_draw) * f.draws.size());
+        std::uint64_t atlasOffset = reserve(f.atlas->texels.size() * 4);
+        for (std::size_t i = 0; i < f.atlas->texels.size(); i++) {
+            const vec4 &t = f.atlas->texels[i];
+            for (int c = 0; c < 4; c++) {
+                out[atlasOffset + i * 4 + c] = detail::toUnorm8(t[c]);
+            }
+        }
+
+        std::vector<capture_draw> draws(f.draws.size());
+        for (std::size_t i = 0; i < f.draws.size(); i++) {
+            const draw   &d = f.draws[i];
+            capture_draw &c = draws[i];
+            std::memset(&c, 0, sizeof(c));
+            c.variant        = d.variant;
+            c.u              = detail::toCapture(d.u);
+            c.numVertices    = d.numVertices;
+            c.numIndices     = d.numIndices;
+            c.verticesOffset = reserve(sizeof(terrain_vertex) * d.numVertices);
+            std::memcpy(&out[c.verticesOffset], d.vertices, sizeof(terrain_vertex) * d.numVertices);
+            c.indicesOffset  = reserve(sizeof(std::uint32_t) * d.numIndices);
+            std::memcpy(&out[c.indicesOffset], d.indices, sizeof(std::uint32_t) * d.numIndices);
+        }
+        if (!draws.empty()) {
+            std::memcpy(&out[drawsOffset], draws.data(), sizeof(capture_draw) * draws.size());
+        }
+
+        capture_header h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, captureMagic, sizeof(h.magic));
+        h.version     = captureVersion;
+        h.byteOrder   = captureByteOrder;
+        h.width       = view.width;
+        h.height      = view.height;
+        h.yaw         = view.yaw;
+        h.pitch       = view.pitch;
+        h.fovY        = view.fovY;
+        h.atlasWidth  = static_cast<std::uint32_t>(f.atlas->width);
+        h.atlasHeight = static_cast<std::uint32_t>(f.atlas->height);
+        h.numDraws    = static_cast<std::uint32_t>(f.draws.size());
+        h.sky         = detail::toCapture(f.sky);
+        h.drawsOffset = drawsOffset;
+        h.atlasOffset = atlasOffset;
+        h.fileSize    = out.size();
+        std::memcpy(out.data(), &h, sizeof(h));
+
+        FILE *fp = std::fopen(path.c_str(), "wb");
+        if (!fp) {
+            std::perror(path.c_str());
+            return false;
+        }
+        bool ok = std::fwrite(out.data(), out.size(), 1, fp) == 1;
+        ok = std::fclose(fp) == 0 && ok;
+        if (!ok) {
+            std::perror(path.c_str());
+        }
+        return ok;
+    }
+
+    /* A capture file mapped into memory. The draws of get() point
+     * directly into the mapping, so the object must outlive any use
+     * of the frame. Only the atlas is converted. */
+    class capture {
+    public:
+        capture() = default;
+        capture(const capture &) = delete;
+        capture &operator=(const capture &) = delete;
+
+        ~capture() {
+            if (base_) {
+                munmap(const_cast<unsigned char *>(base_), size_);
+            }
+        }
+
+        /* Map and validate a capture file. Return false and print a
+         * message on failure. */
+        bool open(const std::string &path) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::perror(path.c_str());
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                std::perror(path.c_str());
+                ::close(fd);
+                return false;
+            }
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ < sizeof(capture_header)) {
+                ::close(fd);
+                return fail(path, "too short to be a capture");
+            }
+            void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) {
+                std::perror(path.c_str());
+                return false;
+            }
+            base_ = static_cast<const unsigned char *>(p);
+            return load(path);
+        }
+
+        const frame        &get()  const { return frame_; }
+        const capture_view &view() const { return view_; }
+
+    private:
+        bool fail(const std::string &path, const char *reason) const {
+            std::fprintf(stderr, "%s: %s\n", path.c_str(), reason);
+            return false;
+        }
+
+        /* Whether [off, off + count * size) is within the file and
+         * aligned to "align". */
+        bool within(std::uint64_t off, std::uint64_t count, std::uint64_t size, std::uint64_t align) const {
+            return off % align == 0 && off <= size_ &&
+                (size == 0 || count <= (size_ - off) / size);
+        }
+
+        bool load(const std::string &path) {
+            const capture_header &h = *reinterpret_cast<const capture_header *>(base_);
+            if (std::memcmp(h.magic, captureMagic, sizeof(h.magic)) != 0) {
+                return fail(path, "not a capture");
+            }
+            if (h.byteOrder != captureByteOrder) {
+                return fail(path, "captured on a machine with a different byte order");
+            }
+            if (h.version != captureVersion) {
+                return fail(path, "unsupported version of captures");
+            }
+            if (h.fileSize != size_) {
+                return fail(path, "truncated");
+            }
+            if (h.width < 1 || h.height < 1 || h.atlasWidth < 1 || h.atlasHeight < 1 ||
+                !within(h.drawsOffset, h.numDraws, sizeof(capture_draw), 8) ||
+                !within(h.atlasOffset, static_cast<std::uint64_t>(h.atlasWidth) * h.atlasHeight, 4, 1)) {
+                return fail(path, "corrupted header");
+            }
+
+            view_ = {h.width, h.height, h.yaw, h.pitch, h.fovY};
+
+            atlas_.width  = static_cast<int>(h.atlasWidth);
+            atlas_.height = static_cast<int>(h.atlasHeight);
+            atlas_.texels.resize(static_cast<std::size_t>(h.atlasWidth) * h.atlasHeight);
+            const unsigned char *texels = base_ + h.atlasOffset;
+            for (std::size_t i = 0; i < atlas_.texels.size(); i++) {
+                atlas_.texels[i] = vec4(texels[i * 4 + 0], texels[i * 4 + 1],
+                                        texels[i * 4 + 2], texels[i * 4 + 3]) * (1.0f / 255.0f);
+            }
+
+            frame_.sky   = detail::fromCapture(h.sky);
+            frame_.atlas = &atlas_;
+            frame_.draws.resize(h.numDraws);
+
+            const capture_draw *draws = reinterpret_cast<const capture_draw *>(base_ + h.drawsOffset);
+            for (std::uint32_t i = 0; i < h.numDraws; i++) {
+                const capture_draw &c = draws[i];
+                if (!within(c.verticesOffset, c.numVertices, sizeof(terrain_vertex), 4) ||
+                    !within(c.indicesOffset, c.numIndices, sizeof(std::uint32_t), 4)) {
+                    return fail(path, "corrupted draw");
+                }
+
+                draw &d = frame_.draws[i];
+                d.variant     = c.variant;
+                d.u           = detail::fromCapture(c.u);
+                d.vertices    = reinterpret_cast<const terrain_vertex *>(base_ + c.verticesOffset);
+                d.numVertices = static_cast<std::size_t>(c.numVertices);
+                d.indices     = reinterpret_cast<const std::uint32_t *>(base_ + c.indicesOffset);
+                d.numIndices  = static_cast<std::size_t>(c.numIndices);
+
+                /* The rasterizer trusts indices. */
+                for (std::size_t k = 0; k < d.numIndices; k++) {
+                    if (d.indices[k] >= d.numVertices) {
+                        return fail(path, "index out of range");
+                    }
+                }
+            }
+            return true;
+        }
+
+        const unsigned char *base_ = nullptr;
+        std::size_t          size_ = 0;
+        capture_view         view_ = {};
+        texture              atlas_;
+        frame                frame_ = {};
+    };
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_CAPTURE_HPP_INCLUDED) */
@@ -0,0 +1,474 @@
+// -*- c++ -*-
+/* nm-cloud-tune: Search for the octaves and bounds of the noise of
+ * clouds.
+ *
+ * The density and the shade of clouds are both an fBM noise that
+ * stops adding octaves as soon as the value is known to be outside
+ * of its bounds, so the bounds decide the cost as much as the number
+ * of octaves does. The defaults were picked by eye. This program
+ * evaluates the noise of sky.fragment over the sky plane seen from
+ * a camera looking up, at frames spread over the time the clouds
+ * take to drift across a whole period of the noise, and counts the
+ * octaves each pixel evaluates. It then compares the final color of
+ * every pixel with that of a reference with many more octaves, for
+ * every combination of parameters around the current ones, and
+ * prints the ones that are the most accurate for their cost. The
+ * best one under the cost target is printed as configure options and
+ * as the defines they produce.
+ *
+ * Usage: nm-cloud-tune [--cost=F] [--scene=NAME] [--size=WxH]
+ *                      [--frames=N] [--reference-octaves=N]
+ *                      [--step=F] [--spread=F] [--threads=N]
+ *                      [CONFIGURE-OPTION]...
+ *
+ * --cost is the target as a fraction of the cost of the current
+ * parameters (default 1.0, i.e. the most accurate set that is no
+ * more expensive than the current one). The colors of the sky and
+ * clouds come from the scene of nm-golden (default "day"). --frames
+ * defaults to 6, and --reference-octaves to 10. The bounds are
+ * searched on a grid of --step (default 0.05) within --spread
+ * (default 0.2) of the current ones. --threads defaults to 0, which
+ * means one thread per core.
+ *
+ * CONFIGURE-OPTION is the same as that of nm-golden. The current
+ * parameters are taken from --with-cloud-density-fbm and
+ * --with-cloud-shade-fbm, so the search can be resumed from a
+ * previous result. --disable-band-limited-noise and
+ * --disable-cloud-shade are taken into account. Quad-shared noise
+ * has no early exit so it can't be tuned this way.
+ *
+ * Errors are the RMS difference of the final colors in units of
+ * 1/255, and costs are the mean number of octaves of noise evaluated
+ * per pixel. The exit status is 1 if nothing meets the cost target.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "nm-pipeline.hpp"
+#include "nm-scenes.hpp"
+
+using namespace glsl;
+
+namespace {
+    const int maxOctaves = 16;
+
+    /* A pixel of the sky plane at a frame. The octaves are those of
+     * the unrolled noise, already faded out by their footprint, so
+     * that any number of them and any bounds can be evaluated
+     * without computing the noise again. */
+    struct sample {
+        float            density[maxOctaves];
+        float            shade[maxOctaves];
+        int              live; // Octaves that evaluate the noise at all.
+        nm::sky_varyings v;
+        float            rise; // rayPos.y - worldPos.y
+    };
+
+    /* The octaves of cloudMapFiltered*() or cloudMap*() at a
+     * point. */
+    void octavesAt(const nm::config &cfg, float time, vec3 pos, float footprint, int octaves, float out[], int &live) {
+        vec2  st = nm::cloudCoords(time, pos);
+        float fp = cfg.bandLimitedNoise ? nm::cloudFootprint(footprint) : 0.0f;
+        live = 0;
+        for (int i = 0; i < octaves; i++) {
+            float fade   = nm::nyquistFade(fp);
+            float octave = 0.5f;
+            if (fade > 0.0f) {
+                octave = mix(octave, nm::simplexNoise(st) * 0.5f + 0.5f, fade);
+                live   = i + 1;
+            }
+            out[i] = octave;
+            st *= 2.0f;
+            fp *= 2.0f;
+        }
+    }
+
+    /* fBMFilteredOctave() unrolled p.octaves times, on precomputed
+     * octaves. Adds the number of octaves that evaluate the noise to
+     * cost. Faded out octaves end it like fBMFiltered() does. */
+    float fBMAt(const float octave[], int live, const nm::fbm_params &p, int &cost) {
+        float value     = 0.0f;
+        float amplitude = 0.5f;
+        for (int i = 0; i < p.octaves; i++) {
+            if (i >= live) {
+                value += amplitude * (1.0f - std::exp2(static_cast<float>(i - p.octaves)));
+                break;
+            }
+            value += amplitude * octave[i];
+            cost  += 1;
+            if (!(value < p.upperBound && value + amplitude > p.lowerBound)) {
+                break;
+            }
+            amplitude *= 0.5f;
+        }
+        return smoothstep(p.lowerBound, p.upperBound, value);
+    }
+
+    /* The rest of skyFragmentQuad() after the noise. */
+    vec3 composite(const nm::config &cfg, const sample &s, float density, float height) {
+        const nm::sky_varyings &v = s.v;
+        vec4 shadedCloud = mix(vec4(v.cloudColor.rgb(), 0.0f), v.cloudColor, density);
+
+        if (cfg.cloudShade && density > 0.0f) {
+            float inside     = max(0.0f, height - s.rise);
+            float brightness = v.cloudColor.x;
+            vec3  shaded     = mix(
+                shadedCloud.rgb() + 0.1f * brightness,
+                max(shadedCloud.rgb() - 0.2f * brightness, 0.0f),
+                inside);
+            shadedCloud = vec4(shaded, shadedCloud.w);
+        }
+        shadedCloud = vec4(mix(v.skyColor.rgb(), shadedCloud.rgb(), shadedCloud.w), shadedCloud.w);
+
+        return mix(shadedCloud, v.skyColor, smoothstep(0.9f, 1.0f, v.camDist)).rgb();
+    }
+
+    /* A bound as configure wants it: a decimal number with at least
+     * one digit after the point. */
+    std::string decimal(float x) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.3f", x);
+        std::string str(buf);
+        while (str.size() > 3 && str.back() == '0' && str[str.size() - 2] != '.') {
+            str.pop_back();
+        }
+        return str;
+    }
+
+    std::string paramsString(const nm::fbm_params &p) {
+        return std::to_string(p.octaves) + ":" + decimal(p.lowerBound) + ":" + decimal(p.upperBound);
+    }
+
+    /* Parameters around the current ones. The bounds go through
+     * decimal() so that they are exactly what the shader will see
+     * once configured. */
+    std::vector<nm::fbm_params> candidates(const nm::fbm_params &current, float step, float spread) {
+        const int n = static_cast<int>(std::floor(spread / step + 0.5f));
+        auto bound = [&](float base, int k) {
+            float x = base + k * step;
+            return std::fabs(x) < 0.0005f ? 0.0f : std::strtof(decimal(x).c_str(), nullptr);
+        };
+
+        std::vector<nm::fbm_params> params;
+        for (int octaves: {3, 6}) {
+            for (int i = -n; i <= n; i++) {
+                for (int j = -n; j <= n; j++) {
+                    nm::fbm_params p = {octaves, bound(current.lowerBound, i), bound(current.upperBound, j)};
+                    if (0.0f <= p.lowerBound && p.lowerBound < p.upperBound && p.upperBound <= 1.0f) {
+                        params.push_back(p);
+                    }
+                }
+            }
+        }
+        return params;
+    }
+
+    /* The values and costs of a candidate at every sample. */
+    struct evaluation {
+        std::vector<float>         value;
+        std::vector<unsigned char> cost;
+    };
+
+    std::vector<evaluation> evaluate(const std::vector<sample> &samples,
+                                     const std::vector<nm::fbm_params> &params,
+                                     bool shade,
+                                     const nm::scheduler &sched) {
+        std::vector<evaluation> evals(params.size());
+        sched.parallelFor(params.size(), [&](std::size_t c, unsigned) {
+            evaluation &e = evals[c];
+            e.value.resize(samples.size());
+            e.cost.resize(samples.size());
+            for (std::size_t i = 0; i < samples.size(); i++) {
+                const sample &s = samples[i];
+                int cost = 0;
+                e.value[i] = fBMAt(shade ? s.shade : s.density, s.live, params[c], cost);
+                e.cost[i]  = static_cast<unsigned char>(cost);
+            }
+        });
+        return evals;
+    }
+
+    struct result {
+        std::size_t density, shade; // Indices of the candidates.
+        double      cost, error;
+    };
+
+    void usage(const char *prog) {
+        std::fprintf(stderr,
+                     "Usage: %s [--cost=F] [--scene=NAME] [--size=WxH]\n"
+                     "       [--frames=N] [--reference-octaves=N]\n"
+                     "       [--step=F] [--spread=F] [--threads=N]\n"
+                     "       [CONFIGURE-OPTION]...\n",
+                     prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    float       costTarget = 1.0f;
+    std::string sceneName  = "day";
+    int         width      = 128;
+    int         height     = 72;
+    int         frames     = 6;
+    int         refOctaves = 10;
+    float       step       = 0.05f;
+    float       spread     = 0.2f;
+    int         threads    = 0;
+    nm::config  cfg;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--cost=", 7) == 0) {
+            costTarget = std::strtof(argv[i] + 7, nullptr);
+            if (!(costTarget > 0.0f)) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--scene=", 8) == 0) {
+            sceneName = argv[i] + 8;
+        }
+        else if (std::strncmp(argv[i], "--size=", 7) == 0) {
+            if (std::sscanf(argv[i] + 7, "%dx%d", &width, &height) != 2 ||
+                width < 16 || height < 16 || width > 4096 || height > 4096) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--frames=", 9) == 0) {
+            frames = std::atoi(argv[i] + 9);
+            if (frames < 1) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--reference-octaves=", 20) == 0) {
+            refOctaves = std::atoi(argv[i] + 20);
+            if (refOctaves < 6 || refOctaves > maxOctaves) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--step=", 7) == 0) {
+            step = std::strtof(argv[i] + 7, nullptr);
+            if (!(step >= 0.001f && step <= 0.5f)) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--spread=", 9) == 0) {
+            spread = std::strtof(argv[i] + 9, nullptr);
+            if (!(spread >= 0.0f && spread <= 1.0f)) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = std::atoi(argv[i] + 10);
+            if (threads < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (!cfg.parse(argv[i])) {
+            std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            usage(argv[0]);
+        }
+    }
+    if (!cfg.fbmClouds || cfg.quadSharedNoise) {
+        std::fprintf(stderr, "%s: clouds must be enabled, and quad-shared noise disabled\n", argv[0]);
+        return 1;
+    }
+
+    const nm::scene_desc *desc = nm::findScene(sceneName);
+    if (!desc) {
+        std::fprintf(stderr, "%s: unknown scene: %s\n", argv[0], sceneName.c_str());
+        return 1;
+    }
+    nm::uniforms u = {};
+    u.FOG_COLOR     = desc->fogColor;
+    u.CURRENT_COLOR = desc->skyColor;
+
+    /* Look up enough to see most of the sky plane, from its center
+     * to the horizon. */
+    const nm::camera cam(width, height, desc->yaw, 0.6f, radians(70.0f));
+
+    /* The clouds drift along the z axis by 3/512 units of the noise
+     * lattice per second, and the permutation of the noise repeats
+     * every 289 units. */
+    const float period = 289.0f * 512.0f / 3.0f;
+
+    const nm::scheduler sched(static_cast<unsigned>(threads));
+    const double        start = nm::detail::seconds();
+
+    /* Sample every frame in 2x2 quads as drawSky() does, since the
+     * footprint comes from the neighbours. */
+    const int quadsX = (width  + 1) / 2;
+    const int quadsY = (height + 1) / 2;
+    std::vector<std::vector<sample>> rows(static_cast<std::size_t>(frames) * quadsY);
+    sched.parallelFor(rows.size(), [&](std::size_t r, unsigned) {
+        const int   frame = static_cast<int>(r / quadsY);
+        const int   qy    = static_cast<int>(r % quadsY) * 2;
+        const float time  = period * (frame + 0.5f) / frames;
+
+        for (int qx = 0; qx < quadsX * 2; qx += 2) {
+            vec3  worldPos[4];
+            bool  covered[4];
+            nm::sky_varyings v[4];
+            for (int lane = 0; lane < 4; lane++) {
+                int   ix   = qx + (lane & 1), iy = qy + (lane >> 1);
+                vec3  dir  = cam.ray(ix + 0.5f, iy + 0.5f);
+                float dy   = std::max(dir.y, 1e-4f);
+                vec3  hit  = dir * (nm::skyPlaneHeight / dy);
+                vec3  pos  = vec3(hit.x, 0.0f, hit.z);
+                float dist = length(pos);
+                covered[lane]  = ix < width && iy < height && dir.y > 0.0f && dist <= 1.0f;
+                worldPos[lane] = pos;
+                nm::skyVertex(u, pos, std::min(dist, 1.0f), v[lane]);
+            }
+
+            const vec3 sunMoonPos = vec3(-0.3f, 4.0f, 0.0f);
+            for (int lane = 0; lane < 4; lane++) {
+                if (!covered[lane]) {
+                    continue;
+                }
+                float footprint = cfg.bandLimitedNoise ? nm::quadFootprint(worldPos, lane) : 0.0f;
+                vec3  rayPos    = worldPos[lane] + normalize(sunMoonPos - worldPos[lane]) * 0.2f;
+
+                /* Both take the footprint of worldPos, so the same
+                 * octaves of them are live. */
+                sample s;
+                int    shadeLive;
+                octavesAt(cfg, time, worldPos[lane], footprint, refOctaves, s.density, s.live);
+                octavesAt(cfg, time, rayPos,         footprint, refOctaves, s.shade,   shadeLive);
+                s.v    = v[lane];
+                s.rise = rayPos.y - worldPos[lane].y;
+                rows[r].push_back(s);
+            }
+        }
+    });
+    std::vector<sample> samples;
+    for (const auto &row: rows) {
+        samples.insert(samples.end(), row.begin(), row.end());
+    }
+    if (samples.empty()) {
+        std::fprintf(stderr, "%s: the sky plane isn't visible\n", argv[0]);
+        return 1;
+    }
+
+    /* The reference has the current bounds and many more
+     * octaves. */
+    const nm::fbm_params refDensity = {refOctaves, cfg.cloudDensityFBM.lowerBound, cfg.cloudDensityFBM.upperBound};
+    const nm::fbm_params refShade   = {refOctaves, cfg.cloudShadeFBM.lowerBound,   cfg.cloudShadeFBM.upperBound};
+    std::vector<vec3> reference(samples.size());
+    for (std::size_t i = 0; i < samples.size(); i++) {
+        int   cost    = 0;
+        float density = fBMAt(samples[i].density, samples[i].live, refDensity, cost);
+        float shade   = fBMAt(samples[i].shade,   samples[i].live, refShade,   cost);
+        reference[i]  = composite(cfg, samples[i], density, shade);
+    }
+
+    /* Evaluate each candidate for the density and for the shade
+     * separately, then every combination of them. Without the shade
+     * only the current parameters of it take part. */
+    const std::vector<nm::fbm_params> densities = candidates(cfg.cloudDensityFBM, step, spread);
+    const std::vector<nm::fbm_params> shades    = cfg.cloudShade
+        ? candidates(cfg.cloudShadeFBM, step, spread)
+        : std::vector<nm::fbm_params>(1, cfg.cloudShadeFBM);
+    const std::vector<evaluation> densityEvals = evaluate(samples, densities, false, sched);
+    const std::vector<evaluation> shadeEvals   = evaluate(samples, shades,    true,  sched);
+
+    std::vector<result> results(densities.size() * shades.size());
+    sched.parallelFor(densities.size(), [&](std::size_t d, unsigned) {
+        const evaluation &de = densityEvals[d];
+        for (std::size_t sh = 0; sh < shades.size(); sh++) {
+            const evaluation &se = shadeEvals[sh];
+            std::size_t cost = 0;
+            double      sqError = 0.0;
+            for (std::size_t i = 0; i < samples.size(); i++) {
+                float density = de.value[i];
+                cost += de.cost[i];
+                /* The shade is only evaluated where there are
+                 * clouds. */
+                if (cfg.cloudShade && density > 0.0f) {
+                    cost += se.cost[i];
+                }
+                vec3 diff = (composite(cfg, samples[i], density, se.value[i]) - reference[i]) * 255.0f;
+                sqError += dot(diff, diff) / 3.0;
+            }
+            result &res = results[d * shades.size() + sh];
+            res.density = d;
+            res.shade   = sh;
+            res.cost    = static_cast<double>(cost) / samples.size();
+            res.error   = std::sqrt(sqError / samples.size());
+        }
+    });
+
+    auto same = [](const nm::fbm_params &a, const nm::fbm_params &b) {
+        return a.octaves == b.octaves && a.lowerBound == b.lowerBound && a.upperBound == b.upperBound;
+    };
+    const result *current = nullptr;
+    for (const result &res: results) {
+        if (same(densities[res.density], cfg.cloudDensityFBM) && same(shades[res.shade], cfg.cloudShadeFBM)) {
+            current = &res;
+        }
+    }
+    if (!current) {
+        /* Not on the grid only if the bounds aren't representable
+         * by decimal(). */
+        std::fprintf(stderr, "%s: the current parameters have too many digits\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%dx%d, %d frames over %.0f seconds, %zu samples, %zu x %zu candidates, %.1f seconds\n",
+                width, height, frames, period, samples.size(), densities.size(), shades.size(),
+                nm::detail::seconds() - start);
+    std::printf("reference: %d octaves\n\n", refOctaves);
+
+    /* The Pareto front: sets that are more accurate than every
+     * cheaper one. */
+    std::vector<const result *> sorted;
+    for (const result &res: results) {
+        sorted.push_back(&res);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const result *a, const result *b) {
+        return a->cost != b->cost ? a->cost < b->cost : a->error < b->error;
+    });
+    std::printf("%8s %8s  %-14s %-14s\n", "cost", "error", "density", "shade");
+    double best = HUGE_VAL;
+    for (const result *res: sorted) {
+        if (res->error < best) {
+            best = res->error;
+            std::printf("%8.3f %8.3f  %-14s %-14s%s\n",
+                        res->cost, res->error,
+                        paramsString(densities[res->density]).c_str(),
+                        paramsString(shades[res->shade]).c_str(),
+                        res == current ? "  (current)" : "");
+        }
+    }
+    std::printf("\ncurrent: %.3f octaves per pixel, error %.3f\n", current->cost, current->error);
+
+    const double  budget = current->cost * costTarget;
+    const result *chosen = nullptr;
+    for (const result *res: sorted) {
+        if (res->cost <= budget && (!chosen || res->error < chosen->error)) {
+            chosen = res;
+        }
+    }
+    if (!chosen) {
+        std::printf("nothing costs %.3f octaves per pixel or less\n", budget);
+        return 1;
+    }
+
+    const nm::fbm_params &density = densities[chosen->density];
+    const nm::fbm_params &shade   = shades[chosen->shade];
+    std::printf("best within %.3f octaves per pixel: %.3f octaves per pixel, error %.3f\n\n",
+                budget, chosen->cost, chosen->error);
+    std::printf("  --with-cloud-density-fbm=%s --with-cloud-shade-fbm=%s\n\n",
+                paramsString(density).c_str(), paramsString(shade).c_str());
+    std::printf("#define CLOUD_DENSITY_OCTAVES %d\n",     density.octaves);
+    std::printf("#define CLOUD_DENSITY_LOWER_BOUND %s\n", decimal(density.lowerBound).c_str());
+    std::printf("#define CLOUD_DENSITY_UPPER_BOUND %s\n", decimal(density.upperBound).c_str());
+    std::printf("#define CLOUD_SHADE_OCTAVES %d\n",       shade.octaves);
+    std::printf("#define CLOUD_SHADE_LOWER_BOUND %s\n",   decimal(shade.lowerBound).c_str());
+    std::printf("#define CLOUD_SHADE_UPPER_BOUND %s\n",   decimal(shade.upperBound).c_str());
+    return 0;
+}
@@ -0,0 +1,373 @@
+// -*- c++ -*-
+/* nm-compile-bench: Measure how long it takes to compile every
+ * shader the game compiles when a world loads.
+ *
+ * The game compiles each variant of each material when it loads a
+ * world, which is where users on slow devices see a long stall. This
+ * program expands materials into their variants the way the game
+ * does (see nm-material.hpp), for both "#version 100" and "#version
+ * 300 es", and compiles every vertex and fragment shader of them with
+ * an offline compiler, using all of the cores. It then reports the
+ * total compile time, which is what the game would spend on a single
+ * thread, and the most expensive variants.
+ *
+ * Usage: nm-compile-bench [--material=FILE]... [--front-end=COMMAND]
+ *                         [--back-end=COMMAND] [--iterations=N]
+ *                         [--top=N] [--threads=N] [--output=DIR]
+ *                         [--dry-run] PACK-DIR...
+ *
+ * PACK-DIR is a resource pack to look up materials and shaders in,
+ * in the order given. As the pack only has the files it modifies,
+ * pass the build directory of "src" for the generated headers, "src"
+ * itself, and then an extracted copy of the vanilla resource pack,
+ * which has the headers the shaders of the pack share with the
+ * vanilla ones.
+ *
+ * --material names a file under "materials/" (default terrain.material
+ * and sky.material). COMMAND is run through the shell with "{file}",
+ * "{version}" (100 or 300), and "{stage}" (vert or frag) replaced. The
+ * file is appended if COMMAND has no "{file}". The front end defaults
+ * to "glslangValidator", which only parses and validates shaders. The
+ * back end is disabled by default. An example with the standalone
+ * compiler of Mesa, which also runs its optimization passes, is:
+ *
+ *   --back-end='glsl_compiler --version {version} --dump-lir {file}'
+ *
+ * Its time is reported separately from the front end, after
+ * subtracting the time of the front end, so that the startup time of
+ * the compiler cancels out. Each shader is compiled N times (default
+ * 3) and the fastest run counts. --output keeps the expanded shaders
+ * in DIR instead of a temporary directory. --dry-run only expands
+ * them and reports their sizes.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "nm-material.hpp"
+#include "nm-scheduler.hpp"
+
+namespace {
+    const int versions[] = {100, 300};
+
+    /* A shader of a program, compiled for a version. */
+    struct compile_job {
+        std::size_t      program;
+        int              version;
+        nm::shader_stage stage;
+        std::string      path;
+        std::size_t      size  = 0;
+        double           front = 0.0;
+        double           back  = 0.0;
+        bool             failed = false;
+        std::string      log;
+    };
+
+    double seconds() {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::string replaceAll(std::string s, const std::string &from, const std::string &to) {
+        for (std::size_t p = s.find(from); p != std::string::npos; p = s.find(from, p + to.size())) {
+            s.replace(p, from.size(), to);
+        }
+        return s;
+    }
+
+    std::string commandFor(const std::string &command, const compile_job &job) {
+        std::string cmd = command;
+        if (cmd.find("{file}") == std::string::npos) {
+            cmd += " {file}";
+        }
+        cmd = replaceAll(cmd, "{file}", "'" + job.path + "'");
+        cmd = replaceAll(cmd, "{version}", std::to_string(job.version));
+        cmd = replaceAll(cmd, "{stage}", job.stage == nm::STAGE_VERTEX ? "vert" : "frag");
+        return cmd + " 2>&1";
+    }
+
+    /* Run a command and return how long it took, or a negative
+     * value if it failed. Its output goes to "log". */
+    double run(const std::string &cmd, std::string &log) {
+        double start = seconds();
+        FILE  *pipe  = popen(cmd.c_str(), "r");
+        if (!pipe) {
+            log = std::strerror(errno);
+            return -1.0;
+        }
+        log.clear();
+        char        buf[4096];
+        std::size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), pipe)) > 0) {
+            log.append(buf, n);
+        }
+        int status = pclose(pipe);
+        double elapsed = seconds() - start;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1.0;
+    }
+
+    /* The fastest of "iterations" runs, or a negative value if any
+     * of them failed. */
+    double fastest(const std::string &cmd, int iterations, std::string &log) {
+        double best = -1.0;
+        for (int i = 0; i < iterations; i++) {
+            double t = run(cmd, log);
+            if (t < 0.0) {
+                return t;
+            }
+            best = i == 0 ? t : std::min(best, t);
+        }
+        return best;
+    }
+
+    bool writeFile(const std::string &path, const std::string &text) {
+        FILE *out = std::fopen(path.c_str(), "wb");
+        if (!out) {
+            std::perror(path.c_str());
+            return false;
+        }
+        bool ok = std::fwrite(text.data(), 1, text.size(), out) == text.size();
+        ok = std::fclose(out) == 0 && ok;
+        if (!ok) {
+            std::perror(path.c_str());
+        }
+        return ok;
+    }
+
+    void usage(const char *prog) {
+        std::fprintf(stderr,
+                     "Usage: %s [--material=FILE]... [--front-end=COMMAND]\n"
+                     "       [--back-end=COMMAND] [--iterations=N] [--top=N]\n"
+                     "       [--threads=N] [--output=DIR] [--dry-run] PACK-DIR...\n",
+                     prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> packs;
+    std::vector<std::string> materials;
+    std::string              frontEnd   = "glslangValidator";
+    std::string              backEnd;
+    std::string              output;
+    int                      iterations = 3;
+    int                      top        = 20;
+    int                      threads    = 0;
+    bool                     dryRun     = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--material=", 11) == 0) {
+            materials.push_back(argv[i] + 11);
+        }
+        else if (std::strncmp(argv[i], "--front-end=", 12) == 0) {
+            frontEnd = argv[i] + 12;
+        }
+        else if (std::strncmp(argv[i], "--back-end=", 11) == 0) {
+            backEnd = argv[i] + 11;
+        }
+        else if (std::strncmp(argv[i], "--iterations=", 13) == 0) {
+            iterations = std::atoi(argv[i] + 13);
+            if (iterations < 1) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--top=", 6) == 0) {
+            top = std::atoi(argv[i] + 6);
+            if (top < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = std::atoi(argv[i] + 10);
+            if (threads < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        }
+        else if (std::strcmp(argv[i], "--dry-run") == 0) {
+            dryRun = true;
+        }
+        else if (argv[i][0] != '-') {
+            packs.push_back(argv[i]);
+        }
+        else {
+            std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            usage(argv[0]);
+        }
+    }
+    if (packs.empty() || frontEnd.empty()) {
+        usage(argv[0]);
+    }
+    if (materials.empty()) {
+        materials = {"terrain.material", "sky.material"};
+    }
+
+    std::vector<nm::material_program> programs;
+    for (const std::string &m: materials) {
+        std::string path;
+        if (!nm::findPackFile(packs, "materials/" + m, path)) {
+            std::fprintf(stderr, "%s: materials/%s: not found in any of the resource packs\n",
+                         argv[0], m.c_str());
+            return 1;
+        }
+        if (!nm::loadMaterialPrograms(path, programs)) {
+            return 1;
+        }
+    }
+
+    /* Expand every shader up front, as the expander caches files
+     * and isn't thread-safe. */
+    bool temporary = output.empty();
+    if (temporary) {
+        const char *tmp = std::getenv("TMPDIR");
+        std::string tmpl = std::string(tmp && *tmp ? tmp : "/tmp") + "/nm-compile-bench.XXXXXX";
+        std::vector<char> buf(tmpl.begin(), tmpl.end());
+        buf.push_back('\0');
+        if (!mkdtemp(buf.data())) {
+            std::perror(tmpl.c_str());
+            return 1;
+        }
+        output = buf.data();
+    }
+    else if (mkdir(output.c_str(), 0777) != 0 && errno != EEXIST) {
+        std::perror(output.c_str());
+        return 1;
+    }
+
+    nm::shader_expander      expander(packs);
+    std::vector<compile_job> jobs;
+    for (std::size_t p = 0; p < programs.size(); p++) {
+        const nm::material_program &prog = programs[p];
+        for (int version: versions) {
+            for (nm::shader_stage stage: {nm::STAGE_VERTEX, nm::STAGE_FRAGMENT}) {
+                compile_job job;
+                job.program = p;
+                job.version = version;
+                job.stage   = stage;
+
+                std::string name = replaceAll(prog.name(), "/", ".");
+                job.path = output + "/" + name + "." + std::to_string(version) +
+                    (stage == nm::STAGE_VERTEX ? ".vert" : ".frag");
+
+                std::string source;
+                if (!expander.expand(stage == nm::STAGE_VERTEX ? prog.vertexShader : prog.fragmentShader,
+                                     version, prog.defines, source)) {
+                    std::fprintf(stderr, "%s: %s\n", prog.name().c_str(), expander.error().c_str());
+                    return 1;
+                }
+                if (!writeFile(job.path, source)) {
+                    return 1;
+                }
+                job.size = source.size();
+                jobs.push_back(job);
+            }
+        }
+    }
+
+    nm::scheduler sched(static_cast<unsigned>(threads));
+    std::printf("%zu programs, %zu shaders, %u threads\n", programs.size(), jobs.size(), sched.threads());
+
+    double start = seconds();
+    if (!dryRun) {
+        sched.parallelFor(jobs.size(), [&](std::size_t i, unsigned) {
+            compile_job &job = jobs[i];
+            job.front = fastest(commandFor(frontEnd, job), iterations, job.log);
+            if (job.front >= 0.0 && !backEnd.empty()) {
+                double full = fastest(commandFor(backEnd, job), iterations, job.log);
+                job.back = full < 0.0 ? full : std::max(full - job.front, 0.0);
+            }
+            job.failed = job.front < 0.0 || job.back < 0.0;
+        });
+    }
+    double wall = seconds() - start;
+
+    /* A program costs its vertex and fragment shaders together. */
+    struct program_cost {
+        std::size_t program;
+        int         version;
+        std::size_t size  = 0;
+        double      front = 0.0;
+        double      back  = 0.0;
+        double total() const { return front + back; }
+    };
+    std::vector<program_cost> costs;
+    double      totals[2][2] = {{0.0, 0.0}, {0.0, 0.0}}; // [version][front, back]
+    std::size_t sizes[2]     = {0, 0};
+    std::size_t failures     = 0;
+    for (std::size_t i = 0; i < jobs.size(); i += 2) {
+        program_cost c;
+        c.program = jobs[i].program;
+        c.version = jobs[i].version;
+        for (std::size_t k = i; k < i + 2; k++) {
+            const compile_job &job = jobs[k];
+            int v = job.version >= 300 ? 1 : 0;
+            c.size       += job.size;
+            c.front      += std::max(job.front, 0.0);
+            c.back       += std::max(job.back, 0.0);
+            totals[v][0] += std::max(job.front, 0.0);
+            totals[v][1] += std::max(job.back, 0.0);
+            sizes[v]     += job.size;
+            failures     += job.failed ? 1 : 0;
+        }
+        costs.push_back(c);
+    }
+    const double total = totals[0][0] + totals[0][1] + totals[1][0] + totals[1][1];
+
+    std::stable_sort(costs.begin(), costs.end(), [dryRun](const program_cost &a, const program_cost &b) {
+        return dryRun ? a.size > b.size : a.total() > b.total();
+    });
+    if (top > 0 && costs.size() > static_cast<std::size_t>(top)) {
+        costs.resize(top);
+    }
+
+    std::printf("\n%-48s %7s %9s %10s %10s %7s\n",
+                "program", "version", "bytes", "front ms", "back ms", "share");
+    for (const program_cost &c: costs) {
+        std::printf("%-48s %7d %9zu %10.2f %10.2f %6.1f%%\n",
+                    programs[c.program].name().c_str(), c.version, c.size,
+                    c.front * 1000.0, c.back * 1000.0,
+                    total > 0.0 ? 100.0 * c.total() / total : 0.0);
+    }
+
+    std::printf("\n%-48s %7s %9s %10s %10s\n", "total", "version", "bytes", "front ms", "back ms");
+    for (int v = 0; v < 2; v++) {
+        std::printf("%-48s %7d %9zu %10.2f %10.2f\n", "", versions[v], sizes[v],
+                    totals[v][0] * 1000.0, totals[v][1] * 1000.0);
+    }
+    if (!dryRun) {
+        /* A device only ever compiles one of the versions. */
+        std::printf("\nLoad-time compile cost on a single thread: %.2f s with #version 100, "
+                    "%.2f s with #version 300 es (%.2f s wall time for both on %u threads)\n",
+                    totals[0][0] + totals[0][1], totals[1][0] + totals[1][1], wall, sched.threads());
+    }
+
+    for (const compile_job &job: jobs) {
+        if (job.failed) {
+            std::printf("\nFAILED: %s (%s)\n%s", programs[job.program].name().c_str(),
+                        job.path.c_str(), job.log.c_str());
+        }
+    }
+
+    if (temporary && failures) {
+        std::printf("\nThe expanded shaders are kept in %s\n", output.c_str());
+    }
+    else if (temporary) {
+        for (const compile_job &job: jobs) {
+            std::remove(job.path.c_str());
+        }
+        rmdir(output.c_str());
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,793 @@
+// -*- c++ -*-
+/* nm-depth-check: Check that the depth-only terrain vertex path puts
+ * vertices exactly where the full one does.
+ *
+ * The game draws terrain in depth-only passes with
+ * BYPASS_PIXEL_SHADER defined, and then again with the full shader,
+ * testing the depth for equality. renderchunk.vertex computes almost
+ * nothing in the former, but it still has to displace grass and water
+ * exactly as the latter does, or waving vertices would fail the
+ * depth test and flicker. This program runs both paths over every
+ * vertex of every scene of nm-golden, at several times, with and
+ * without ENABLE_CAMERA_MOVEMENT_MITIGATION, and with the sunlight
+ * level of TEXCOORD_1 overridden at levels where it damps the waves,
+ * as the scenes are mostly in full sunlight. It fails if any
+ * gl_Position differs in any bit. It also fails if no vertex has
+ * been displaced at all, as the check would then prove nothing.
+ *
+ * The above only checks the C++ port against itself, so with --pack
+ * the program instead checks renderchunk.vertex itself. It
+ * preprocesses the shader for every variant of terrain.material,
+ * with and without FANCY, for GLSL ES 1.00 and 3.00, and each of them
+ * with and without BYPASS_PIXEL_SHADER. It then takes the statements
+ * of main() that gl_Position depends on, along with the conditions
+ * around them, the declarations of the variables they use, and the
+ * functions they call, and fails unless they are the same with and
+ * without BYPASS_PIXEL_SHADER. The dependencies are found by name,
+ * regardless of the order of statements, so the check errs on the
+ * side of failing. It also fails unless gl_Position is declared
+ * invariant, as the compiler may otherwise optimize the same
+ * statements differently in the two shaders.
+ *
+ * Usage: nm-depth-check [CONFIGURE-OPTION]...
+ *        nm-depth-check --pack=DIR...
+ *
+ * CONFIGURE-OPTION is the same as that of nm-golden. DIR is a
+ * resource pack to look up materials/terrain.material and the
+ * shaders in, the first one first. Headers that are in none of them,
+ * such as those of the vanilla pack, are skipped.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "nm-material.hpp"
+#include "nm-preprocessor.hpp"
+#include "nm-scenes.hpp"
+
+using namespace glsl;
+
+namespace {
+    /* Values of TOTAL_REAL_WORLD_TIME to try. */
+    const float times[] = {0.0f, 1000.0f, 86399.5f};
+
+    /* Sunlight levels to try besides that of each vertex. */
+    const float sunLevels[] = {0.6f, 0.8f};
+
+    bool sameBits(vec4 a, vec4 b) {
+        return std::memcmp(&a, &b, sizeof(vec4)) == 0;
+    }
+
+    /* ------------------------------------------------------------
+     * The check of the shader source
+     * ------------------------------------------------------------ */
+
+    typedef std::vector<std::string> tokens;
+
+    bool isIdentStart(char c) {
+        return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    bool isIdent(const std::string &t) {
+        return !t.empty() && isIdentStart(t[0]);
+    }
+
+    void tokenize(const std::string &s, tokens &out) {
+        static const char *const operators[] = {
+            "==", "!=", "<=", ">=", "&&", "||", "^^", "++", "--",
+            "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", "<<", ">>",
+        };
+        std::size_t i = 0;
+        while (i < s.size()) {
+            char c = s[i];
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                i++;
+            }
+            else if (isIdentStart(c)) {
+                std::size_t e = i;
+                while (e < s.size() && (std::isalnum(static_cast<unsigned char>(s[e])) || s[e] == '_')) {
+                    e++;
+                }
+                out.push_back(s.substr(i, e - i));
+                i = e;
+            }
+            else if (std::isdigit(static_cast<unsigned char>(c)) ||
+                     (c == '.' && i + 1 < s.size() && std::isdigit(static_cast<unsigned char>(s[i + 1])))) {
+                std::size_t e = i;
+                while (e < s.size() &&
+                       (std::isalnum(static_cast<unsigned char>(s[e])) || s[e] == '.' ||
+                        ((s[e] == '+' || s[e] == '-') && (s[e - 1] == 'e' || s[e - 1] == 'E')))) {
+                    e++;
+                }
+                out.push_back(s.substr(i, e - i));
+                i = e;
+            }
+            else {
+                std::string op(1, c);
+                for (const char *o: operators) {
+                    if (s.compare(i, 2, o) == 0) {
+                        op = o;
+                    }
+                }
+                out.push_back(op);
+                i += op.size();
+            }
+        }
+    }
+
+    std::string join(tokens::const_iterator begin, tokens::const_iterator end) {
+        std::string out;
+        for (auto it = begin; it != end; ++it) {
+            out += (out.empty() ? "" : " ") + *it;
+        }
+        return out;
+    }
+
+    std::string join(const tokens &ts) {
+        return join(ts.begin(), ts.end());
+    }
+
+    /* The index of the token closing the bracket at "open". */
+    std::size_t matching(const tokens &ts, std::size_t open) {
+        int depth = 0;
+        for (std::size_t i = open; i < ts.size(); i++) {
+            if (ts[i] == "(" || ts[i] == "[" || ts[i] == "{") {
+                depth++;
+            }
+            else if (ts[i] == ")" || ts[i] == "]" || ts[i] == "}") {
+                if (--depth == 0) {
+                    return i;
+                }
+            }
+        }
+        return ts.size();
+    }
+
+    /* Qualifiers that don't change what a variable computes. */
+    bool isStorageQualifier(const std::string &t) {
+        return t == "varying" || t == "out" || t == "flat" || t == "smooth" ||
+            t == "centroid" || t == "_centroid" || t == "invariant";
+    }
+
+    /* Qualifiers of variables that the shader can't assign to. */
+    bool isReadOnlyQualifier(const std::string &t) {
+        return t == "attribute" || t == "in" || t == "uniform" || t == "const";
+    }
+
+    /* A statement of main(), or a control statement with a condition
+     * and its bodies. */
+    struct statement {
+        tokens                 text;    // The statement, or the keyword and the condition.
+        std::vector<statement> body;
+        std::vector<statement> orElse;
+        bool                   control = false;
+        bool                   kept    = false;
+    };
+
+    class shader_slice {
+    public:
+        /* Parse the output of nm::preprocessor. Return false and set
+         * error() on failure. */
+        bool parse(const std::string &preprocessed) {
+            tokens ts;
+            std::size_t pos = 0;
+            while (pos < preprocessed.size()) {
+                std::size_t end = preprocessed.find('\n', pos);
+                end = end == std::string::npos ? preprocessed.size() : end;
+                std::string line = preprocessed.substr(pos, end - pos);
+                pos = end + 1;
+
+                if (line.compare(0, 8, "#define ") == 0) {
+                    std::string rest = line.substr(8);
+                    std::size_t e = 0;
+                    while (e < rest.size() && (std::isalnum(static_cast<unsigned char>(rest[e])) || rest[e] == '_')) {
+                        e++;
+                    }
+                    std::string name = rest.substr(0, e);
+                    if (e < rest.size() && rest[e] == '(') {
+                        functionMacros_[name] = line;
+                        macros_.erase(name);
+                    }
+                    else {
+                        tokens body;
+                        tokenize(rest.substr(e), body);
+                        macros_[name] = body;
+                        functionMacros_.erase(name);
+                    }
+                }
+                else if (line.compare(0, 7, "#undef ") == 0) {
+                    std::string name = line.substr(7);
+                    macros_.erase(name);
+                    functionMacros_.erase(name);
+                }
+                else if (!line.empty() && line[0] != '#') {
+                    tokens lineTokens;
+                    tokenize(line, lineTokens);
+                    std::set<std::string> expanding;
+                    expand(lineTokens, ts, expanding);
+                }
+            }
+            return parseTopLevel(ts);
+        }
+
+        /* Find what gl_Position depends on, and describe it in a form
+         * that can be compared between variants. */
+        std::string slice(std::size_t &numKept) {
+            relevant_ = {"gl_Position"};
+            for (bool changed = true; changed; ) {
+                changed = mark(main_, {});
+                for (const auto &f: functions_) {
+                    if (relevant_.count(f.first) && f.first != "main") {
+                        changed = addAll(f.second) || changed;
+                    }
+                }
+            }
+
+            std::string out = "main:\n";
+            numKept = 0;
+            print(main_, 1, out, numKept);
+
+            out += "declarations:\n";
+            for (const std::string &name: relevant_) {
+                auto range = declarations_.equal_range(name);
+                for (auto it = range.first; it != range.second; ++it) {
+                    out += "  " + it->second + "\n";
+                }
+            }
+            out += "functions:\n";
+            for (const std::string &name: relevant_) {
+                auto it = functions_.find(name);
+                if (it != functions_.end() && name != "main") {
+                    out += "  " + join(it->second) + "\n";
+                }
+                auto m = functionMacros_.find(name);
+                if (m != functionMacros_.end()) {
+                    out += "  " + m->second + "\n";
+                }
+            }
+            out += "precision:\n";
+            for (const std::string &p: precisions_) {
+                out += "  " + p + "\n";
+            }
+            return out;
+        }
+
+        bool invariantPosition() const { return invariantPosition_; }
+
+        const std::string &error() const { return error_; }
+
+    private:
+        void expand(const tokens &in, tokens &out, std::set<std::string> &expanding) {
+            for (const std::string &t: in) {
+                auto it = macros_.find(t);
+                if (it != macros_.end() && !expanding.count(t)) {
+                    expanding.insert(t);
+                    expand(it->second, out, expanding);
+                    expanding.erase(t);
+                }
+                else {
+                    out.push_back(t);
+                }
+            }
+        }
+
+        bool parseTopLevel(const tokens &ts) {
+            std::size_t begin = 0;
+            for (std::size_t i = 0; i < ts.size(); i++) {
+                if (ts[i] == "(" || ts[i] == "[") {
+                    i = matching(ts, i);
+                }
+                else if (ts[i] == "{") {
+                    std::size_t close = matching(ts, i);
+                    if (i > begin && ts[i - 1] == ")") {
+                        /* A function definition. */
+                        tokens def(ts.begin() + static_cast<std::ptrdiff_t>(begin),
+                                   ts.begin() + static_cast<std::ptrdiff_t>(std::min(close + 1, ts.size())));
+                        auto paren = std::find(def.begin(), def.end(), "(");
+                        if (paren == def.begin()) {
+                            return fail("malformed function definition: " + join(def));
+                        }
+                        const std::string &name = *(paren - 1);
+                        tokens &f = functions_[name];
+                        f.insert(f.end(), def.begin(), def.end());
+                        if (name == "main") {
+                            tokens body(ts.begin() + static_cast<std::ptrdiff_t>(i + 1),
+                                        ts.begin() + static_cast<std::ptrdiff_t>(std::min(close, ts.size())));
+                            std::size_t p = 0;
+                            if (!parseBlock(body, p, main_)) {
+                                return false;
+                            }
+                        }
+                        begin = close + 1;
+                    }
+                    i = close;
+                }
+                else if (ts[i] == ";") {
+                    declare(tokens(ts.begin() + static_cast<std::ptrdiff_t>(begin),
+                                   ts.begin() + static_cast<std::ptrdiff_t>(i)));
+                    begin = i + 1;
+                }
+            }
+            return true;
+        }
+
+        /* Record a declaration, with the qualifiers that make no
+         * difference removed. */
+        void declare(const tokens &decl) {
+            if (decl.empty()) {
+                return;
+            }
+            if (decl[0] == "precision") {
+                precisions_.push_back(join(decl));
+                return;
+            }
+            if (decl.size() == 2 && decl[0] == "invariant" && decl[1] == "gl_Position") {
+                invariantPosition_ = true;
+                return;
+            }
+            tokens      normalized;
+            std::string name;
+            bool        readOnly = false;
+            for (const std::string &t: decl) {
+                if (t == "=") {
+                    break;
+                }
+                if (isStorageQualifier(t)) {
+                    continue;
+                }
+                readOnly = readOnly || isReadOnlyQualifier(t);
+                normalized.push_back(t);
+                if (isIdent(t)) {
+                    name = t;
+                }
+            }
+            if (!name.empty()) {
+                declarations_.emplace(name, join(normalized));
+                if (readOnly) {
+                    readOnly_.insert(name);
+                }
+            }
+        }
+
+        bool parseBlock(const tokens &ts, std::size_t &p, std::vector<statement> &out) {
+            while (p < ts.size() && ts[p] != "}") {
+                if (!parseStatement(ts, p, out)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool parseBody(const tokens &ts, std::size_t &p, std::vector<statement> &out) {
+            if (p < ts.size() && ts[p] == "{") {
+                p++;
+                if (!parseBlock(ts, p, out)) {
+                    return false;
+                }
+                if (p >= ts.size()) {
+                    return fail("unterminated block");
+                }
+                p++;
+                return true;
+            }
+            return parseStatement(ts, p, out);
+        }
+
+        bool parseStatement(const tokens &ts, std::size_t &p, std::vector<statement> &out) {
+            const std::string &t = ts[p];
+            if (t == "{") {
+                /* A plain block. Its scope doesn't matter here. */
+                return parseBody(ts, p, out);
+            }
+            if (t == "if" || t == "for" || t == "while") {
+                if (p + 1 >= ts.size() || ts[p + 1] != "(") {
+                    return fail("malformed " + t);
+                }
+                std::size_t close = matching(ts, p + 1);
+                statement s;
+                s.control = true;
+                s.text.assign(ts.begin() + static_cast<std::ptrdiff_t>(p),
+                              ts.begin() + static_cast<std::ptrdiff_t>(std::min(close + 1, ts.size())));
+                p = close + 1;
+                if (p >= ts.size() || !parseBody(ts, p, s.body)) {
+                    return fail("missing the body of " + t);
+                }
+                if (t == "if" && p < ts.size() && ts[p] == "else") {
+                    p++;
+                    if (p >= ts.size() || !parseBody(ts, p, s.orElse)) {
+                        return fail("missing the body of else");
+                    }
+                }
+                out.push_back(s);
+                return true;
+            }
+            statement s;
+            while (p < ts.size() && ts[p] != ";") {
+                if (ts[p] == "(" || ts[p] == "[") {
+                    std::size_t close = matching(ts, p);
+                    s.text.insert(s.text.end(),
+                                  ts.begin() + static_cast<std::ptrdiff_t>(p),
+                                  ts.begin() + static_cast<std::ptrdiff_t>(std::min(close + 1, ts.size())));
+                    p = close + 1;
+                }
+                else if (ts[p] == "{" || ts[p] == "}") {
+                    return fail("unexpected " + ts[p] + " in " + join(s.text));
+                }
+                else {
+                    s.text.push_back(ts[p++]);
+                }
+            }
+            if (p >= ts.size()) {
+                return fail("missing ; after " + join(s.text));
+            }
+            p++;
+            auto assign = std::find(s.text.begin(), s.text.end(), "=");
+            bool declaration = assign - s.text.begin() >= 2 &&
+                std::all_of(s.text.begin(), assign, [](const std::string &w) { return isIdent(w); });
+            if (declaration) {
+                declare(s.text);
+            }
+            /* A declaration without an initializer computes nothing. */
+            if (!declaration || assign != s.text.end()) {
+                out.push_back(s);
+            }
+            return true;
+        }
+
+        /* Whether any overload of the function "name" has an out or
+         * inout parameter at "index". Built-in functions have none
+         * that the vertex shader uses. */
+        bool isOutParameter(const std::string &name, std::size_t index) const {
+            auto it = functions_.find(name);
+            if (it == functions_.end()) {
+                return false;
+            }
+            const tokens &def = it->second;
+            for (std::size_t i = 0; i + 1 < def.size(); i++) {
+                if (!(def[i] == name && def[i + 1] == "(")) {
+                    continue;
+                }
+                std::size_t close = matching(def, i + 1);
+                std::size_t param = 0;
+                for (std::size_t k = i + 2; k < close; k++) {
+                    if (def[k] == ",") {
+                        param++;
+                    }
+                    else if (param == index && (def[k] == "out" || def[k] == "inout")) {
+                        return true;
+                    }
+                }
+                i = close;
+            }
+            return false;
+        }
+
+        /* The variables a statement may assign to: the left-hand side
+         * of an assignment, and variables passed to out and inout
+         * parameters of functions. */
+        std::set<std::string> writes(const tokens &text) const {
+            std::set<std::string> out;
+            for (std::size_t i = 0; i < text.size(); i++) {
+                const std::string &t = text[i];
+                if (t == "=" || t == "+=" || t == "-=" || t == "*=" || t == "/=") {
+                    for (std::size_t k = i; k-- > 0; ) {
+                        if (isIdent(text[k]) && (k == 0 || text[k - 1] != ".")) {
+                            out.insert(text[k]);
+                            break;
+                        }
+                    }
+                    break;
+                }
+            }
+            for (std::size_t i = 0; i + 1 < text.size(); i++) {
+                if (!isIdent(text[i]) || text[i + 1] != "(") {
+                    continue;
+                }
+                std::size_t close = matching(text, i + 1);
+                std::size_t argBegin = i + 2, index = 0;
+                for (std::size_t k = i + 2; k <= close && k < text.size(); k++) {
+                    if (k < close && (text[k] == "(" || text[k] == "[")) {
+                        k = matching(text, k);
+                    }
+                    else if (text[k] == "," || k == close) {
+                        if (argBegin < k && isIdent(text[argBegin]) && isOutParameter(text[i], index)) {
+                            out.insert(text[argBegin]);
+                        }
+                        argBegin = k + 1;
+                        index++;
+                    }
+                }
+            }
+            for (auto it = out.begin(); it != out.end(); ) {
+                bool assignable = declarations_.count(*it) && !readOnly_.count(*it);
+                it = assignable || *it == "gl_Position" ? std::next(it) : out.erase(it);
+            }
+            return out;
+        }
+
+        bool addAll(const tokens &text) {
+            bool changed = false;
+            for (const std::string &t: text) {
+                if (isIdent(t)) {
+                    changed = relevant_.insert(t).second || changed;
+                }
+            }
+            return changed;
+        }
+
+        /* Mark the statements assigning to anything gl_Position
+         * depends on, and add what they depend on in turn. Return
+         * true if anything has been added. */
+        bool mark(std::vector<statement> &stmts, const std::vector<const statement *> &outer) {
+            bool changed = false;
+            for (statement &s: stmts) {
+                if (s.control) {
+                    std::vector<const statement *> inner = outer;
+                    inner.push_back(&s);
+                    changed = mark(s.body, inner) || changed;
+                    changed = mark(s.orElse, inner) || changed;
+                    bool kept = std::any_of(s.body.begin(), s.body.end(), [](const statement &c) { return c.kept; }) ||
+                        std::any_of(s.orElse.begin(), s.orElse.end(), [](const statement &c) { return c.kept; });
+                    if (kept && !s.kept) {
+                        s.kept  = true;
+                        changed = true;
+                    }
+                    continue;
+                }
+                std::set<std::string> w = writes(s.text);
+                bool hit = std::any_of(w.begin(), w.end(), [&](const std::string &n) { return relevant_.count(n) > 0; });
+                if (hit) {
+                    changed = !s.kept || changed;
+                    s.kept  = true;
+                    changed = addAll(s.text) || changed;
+                    for (const statement *c: outer) {
+                        changed = addAll(c->text) || changed;
+                    }
+                }
+            }
+            return changed;
+        }
+
+        static void print(const std::vector<statement> &stmts, int depth, std::string &out, std::size_t &numKept) {
+            const std::string indent(static_cast<std::size_t>(depth) * 2, ' ');
+            for (const statement &s: stmts) {
+                if (!s.kept) {
+                    continue;
+                }
+                if (s.control) {
+                    out += indent + join(s.text) + " {\n";
+                    print(s.body, depth + 1, out, numKept);
+                    out += indent + "} else {\n";
+                    print(s.orElse, depth + 1, out, numKept);
+                    out += indent + "}\n";
+                }
+                else {
+                    out += indent + join(s.text) + ";\n";
+                    numKept++;
+                }
+            }
+        }
+
+        bool fail(const std::string &what) {
+            error_ = what;
+            return false;
+        }
+
+        std::map<std::string, tokens>      macros_;
+        std::map<std::string, std::string> functionMacros_;
+        std::map<std::string, tokens>      functions_;
+        std::multimap<std::string, std::string> declarations_;
+        std::set<std::string>              readOnly_;
+        std::vector<std::string>           precisions_;
+        std::vector<statement>             main_;
+        std::set<std::string>              relevant_;
+        bool                               invariantPosition_ = false;
+        std::string                        error_;
+    };
+
+    /* Preprocess renderchunk.vertex and slice it. Return false on
+     * failure. */
+    bool sliceShader(nm::shader_expander &expander, int version, const std::set<std::string> &defines,
+                     std::string &slice, std::size_t &numKept, bool &invariant) {
+        std::string body;
+        if (!expander.expand("shaders/renderchunk.vertex", version, {}, body)) {
+            std::fprintf(stderr, "%s\n", expander.error().c_str());
+            return false;
+        }
+        std::map<std::string, std::string> predefined = {
+            {"__VERSION__", std::to_string(version)},
+            {"GL_ES", "1"},
+        };
+        for (const std::string &d: defines) {
+            predefined[d] = "";
+        }
+        nm::preprocessor pp(predefined);
+        std::string      out;
+        if (!pp.run(body, out)) {
+            std::fprintf(stderr, "renderchunk.vertex: %s\n", pp.error().c_str());
+            return false;
+        }
+        shader_slice s;
+        if (!s.parse(out)) {
+            std::fprintf(stderr, "renderchunk.vertex: %s\n", s.error().c_str());
+            return false;
+        }
+        slice     = s.slice(numKept);
+        invariant = s.invariantPosition();
+        return true;
+    }
+
+    /* Print the first line where "a" and "b" differ. */
+    void printDifference(const std::string &a, const std::string &b) {
+        std::size_t pa = 0, pb = 0;
+        while (pa < a.size() || pb < b.size()) {
+            std::size_t ea = a.find('\n', pa), eb = b.find('\n', pb);
+            std::string la = pa < a.size() ? a.substr(pa, ea - pa) : std::string();
+            std::string lb = pb < b.size() ? b.substr(pb, eb - pb) : std::string();
+            if (la != lb) {
+                std::printf("  full:       %s\n  depth-only: %s\n", la.c_str(), lb.c_str());
+                return;
+            }
+            pa = ea == std::string::npos ? a.size() : ea + 1;
+            pb = eb == std::string::npos ? b.size() : eb + 1;
+        }
+    }
+
+    int checkSource(const std::vector<std::string> &packs) {
+        std::string path;
+        std::vector<nm::material_program> programs;
+        if (!nm::findPackFile(packs, "materials/terrain.material", path)) {
+            std::fprintf(stderr, "materials/terrain.material: not found in any of the resource packs\n");
+            return 1;
+        }
+        if (!nm::loadMaterialPrograms(path, programs)) {
+            return 1;
+        }
+
+        std::set<std::set<std::string>> variants;
+        for (const nm::material_program &p: programs) {
+            if (p.vertexShader != "shaders/renderchunk.vertex") {
+                continue;
+            }
+            std::set<std::string> defines(p.defines.begin(), p.defines.end());
+            defines.erase("BYPASS_PIXEL_SHADER");
+            /* The game defines FANCY by itself. */
+            variants.insert(defines);
+            defines.insert("FANCY");
+            variants.insert(defines);
+        }
+
+        nm::shader_expander expander(packs, true);
+        std::size_t compared = 0, differ = 0, maxKept = 0;
+        bool        invariant = true;
+        for (const std::set<std::string> &defines: variants) {
+            for (int version: {100, 300}) {
+                std::set<std::string> depthOnly = defines;
+                depthOnly.insert("BYPASS_PIXEL_SHADER");
+
+                std::string full, depth;
+                std::size_t keptFull, keptDepth;
+                bool        invFull, invDepth;
+                if (!sliceShader(expander, version, defines, full, keptFull, invFull) ||
+                    !sliceShader(expander, version, depthOnly, depth, keptDepth, invDepth)) {
+                    return 1;
+                }
+                compared++;
+                maxKept   = std::max(maxKept, keptFull);
+                invariant = invariant && invFull && invDepth;
+                if (full != depth) {
+                    differ++;
+                    std::string names;
+                    for (const std::string &d: defines) {
+                        names += " " + d;
+                    }
+                    std::printf("FAILED: version %d,%s:\n", version, names.c_str());
+                    printDifference(full, depth);
+                }
+            }
+        }
+
+        for (const std::string &s: expander.skipped()) {
+            std::printf("skipped %s\n", s.c_str());
+        }
+        std::printf("%zu variants compared, up to %zu statements computing gl_Position, %zu differ\n",
+                    compared, maxKept, differ);
+        if (!invariant) {
+            std::printf("FAILED: gl_Position isn't declared invariant\n");
+            return 1;
+        }
+        if (compared == 0 || maxKept == 0) {
+            std::printf("FAILED: nothing has been compared\n");
+            return 1;
+        }
+        return differ == 0 ? 0 : 1;
+    }
+
+    void usage(const char *prog) {
+        std::fprintf(stderr, "Usage: %s [CONFIGURE-OPTION]...\n"
+                             "       %s --pack=DIR...\n", prog, prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    nm::config               cfg;
+    std::vector<std::string> packs;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--pack=", 7) == 0) {
+            packs.push_back(argv[i] + 7);
+        }
+        else if (!cfg.parse(argv[i])) {
+            std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            usage(argv[0]);
+        }
+    }
+    if (!packs.empty()) {
+        return checkSource(packs);
+    }
+
+    std::size_t totalDisplaced  = 0;
+    std::size_t totalMismatched = 0;
+
+    std::printf("%-10s %10s %10s %10s\n", "scene", "runs", "displaced", "mismatched");
+    for (const nm::scene_desc &desc: nm::scenes()) {
+        nm::scene   s(desc, 320, 180);
+        std::size_t runs = 0, displaced = 0, mismatched = 0;
+
+        for (int mitigation = 0; mitigation <= 1; mitigation++) {
+            nm::config c = cfg;
+            c.cameraMovementMitigation = mitigation;
+
+            for (float time: times) {
+                for (const nm::draw &d: s.get().draws) {
+                    nm::uniforms u = d.u;
+                    u.TOTAL_REAL_WORLD_TIME = time;
+
+                    for (std::size_t i = 0; i < d.numVertices; i++) {
+                        vec4 still = s.cam().project(
+                            vec3(d.vertices[i].position[0], d.vertices[i].position[1], d.vertices[i].position[2]) *
+                            u.CHUNK_ORIGIN_AND_SCALE.w + u.CHUNK_ORIGIN_AND_SCALE.xyz());
+
+                        for (int level = -1; level < 2; level++) {
+                            nm::terrain_vertex in = d.vertices[i];
+                            if (level >= 0) {
+                                in.uv1[1] = sunLevels[level];
+                            }
+                            nm::terrain_varyings v;
+
+                            vec4 full  = nm::terrainVertex(c, d.variant, u, s.cam(), in, v);
+                            vec4 depth = nm::terrainVertexDepthOnly(c, d.variant, u, s.cam(), in);
+
+                            runs++;
+                            displaced  += sameBits(full, still) ? 0 : 1;
+                            mismatched += sameBits(full, depth) ? 0 : 1;
+                        }
+                    }
+                }
+            }
+        }
+
+        std::printf("%-10s %10zu %10zu %10zu\n", desc.name, runs, displaced, mismatched);
+        totalDisplaced  += displaced;
+        totalMismatched += mismatched;
+    }
+
+    if (totalMismatched > 0) {
+        std::printf("FAILED: %zu positions differ between the paths\n", totalMismatched);
+        return 1;
+    }
+    if (totalDisplaced == 0 && cfg.waves) {
+        std::printf("FAILED: no vertex was displaced\n");
+        return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
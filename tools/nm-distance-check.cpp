@@ -0,0 +1,103 @@
+// -*- c++ -*-
+/* nm-distance-check: Check that ripples and wave normals are cut off
+ * at a fixed distance.
+ *
+ * Rain ripples and the wave normals of water are only computed within
+ * RIPPLES_DISTANCE and WAVE_NORMAL_DISTANCE blocks of the camera. They
+ * used to be fractions of the render distance, which made them more
+ * expensive the farther the player could see. This program renders
+ * the rain and ocean scenes of nm-golden at several render distances,
+ * counts the visible fragments that computed each of the effects, and
+ * fails unless the counts are non-zero and the same at every render
+ * distance.
+ *
+ * Usage: nm-distance-check [--size=WxH] [--threads=N] [CONFIGURE-OPTION]...
+ *
+ * --threads defaults to 0, which means one thread per core.
+ * CONFIGURE-OPTION is the same as that of nm-golden.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "nm-scenes.hpp"
+
+using namespace glsl;
+
+namespace {
+    /* The render distances to try, in blocks. Only the uniforms
+     * change with them, not the geometry of the scenes. */
+    const float renderDistances[] = {64.0f, 128.0f, 256.0f, 512.0f};
+
+    struct effect {
+        const char                     *name;
+        const char                     *scene;
+        std::size_t nm::stage_timings::*count;
+    };
+
+    const effect effects[] = {
+        {"ripples",     "rain",  &nm::stage_timings::ripples},
+        {"wave-normal", "ocean", &nm::stage_timings::waveNormals},
+    };
+
+    void usage(const char *prog) {
+        std::fprintf(stderr, "Usage: %s [--size=WxH] [--threads=N] [CONFIGURE-OPTION]...\n", prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int        width   = 320;
+    int        height  = 180;
+    int        threads = 0;
+    nm::config cfg;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--size=", 7) == 0) {
+            if (std::sscanf(argv[i] + 7, "%dx%d", &width, &height) != 2 ||
+                width < 16 || height < 16 || width > 4096 || height > 4096) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = std::atoi(argv[i] + 10);
+            if (threads < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (!cfg.parse(argv[i])) {
+            std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            usage(argv[0]);
+        }
+    }
+
+    bool failed = false;
+
+    std::printf("%-12s %-6s %8s %8s  %s\n", "effect", "scene", "distance", "pixels", "result");
+    for (const effect &e: effects) {
+        nm::scene       s(*nm::findScene(e.scene), width, height);
+        nm::renderer    r(cfg, s.cam(), static_cast<unsigned>(threads));
+        nm::framebuffer fb(width, height);
+        nm::frame       f = s.get();
+
+        std::size_t expected = 0;
+        for (std::size_t i = 0; i < sizeof(renderDistances) / sizeof(renderDistances[0]); i++) {
+            f.sky.RENDER_DISTANCE = f.sky.FAR_CHUNKS_DISTANCE = renderDistances[i];
+            for (nm::draw &d: f.draws) {
+                d.u.RENDER_DISTANCE = d.u.FAR_CHUNKS_DISTANCE = renderDistances[i];
+            }
+            std::size_t n = r.render(f, fb).*e.count;
+            if (i == 0) {
+                expected = n;
+            }
+            bool pass = n > 0 && n == expected;
+            failed = failed || !pass;
+            std::printf("%-12s %-6s %8.0f %8zu  %s\n",
+                        e.name, e.scene, renderDistances[i], n, pass ? "ok" : "FAILED");
+        }
+    }
+
+    return failed ? 1 : 0;
+}
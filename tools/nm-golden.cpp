@@ -0,0 +1,277 @@
+// -*- c++ -*-
+/* nm-golden: Check optimizations of the shaders against golden images.
+ *
+ * Optimizations like band-limited or quad-shared noise trade a bit of
+ * image quality for speed, and it's hard to tell by eye whether a
+ * change stayed within what's acceptable. This program renders a set
+ * of fixed scenes (day, dusk, night, rain, underwater, ocean, and a
+ * torch-lit cave) with a software rasterizer running C++ ports of the
+ * terrain and sky shaders, compares them with reference images using
+ * the mean SSIM of luma, and reports the speedup next to the
+ * difference. Each scene has its own budget, although they are
+ * currently all the same (see scene_desc::ssimBudget).
+ *
+ * Usage: nm-golden [--reference=DIR [--update]] [--output=DIR]
+ *                  [--size=WxH] [--iterations=N] [--threads=N]
+ *                  [--scene=NAME]... [--baseline=CONFIGURE-OPTION]...
+ *                  [CONFIGURE-OPTION]...
+ *
+ * CONFIGURE-OPTION is an option of the configure script such as
+ * --enable-quad-shared-noise, which selects the candidate
+ * configuration. Without --reference the candidate is compared with
+ * the baseline configuration rendered in the same run, which is the
+ * default one unless changed with --baseline. Options that change the
+ * look on purpose, such as --disable-band-limited-noise, exceed the
+ * budgets against the default, so an optimization on top of them
+ * has to be checked against a baseline with the same options. With
+ * --reference the images are compared with DIR/NAME.tga instead, and
+ * --update (re)creates them from the candidate. tools/golden has
+ * those of the default configuration, which "make check" compares
+ * the default and the optimizations with. As with everything here,
+ * they only cover the C++ port, not what a GPU renders. Timings are always
+ * relative to the baseline configuration. With --output the candidate
+ * images are written to DIR/NAME.tga too. --threads renders with N
+ * threads instead of one, or with all of the cores if N is 0. It
+ * doesn't change the images, but makes timings less reliable. The
+ * exit status is 1 if any of the scenes exceeds its budget.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "nm-image.hpp"
+#include "nm-scenes.hpp"
+
+using namespace glsl;
+using nm::image;
+
+namespace {
+    /* The mean SSIM of luma, with an 11x11 Gaussian window of
+     * sigma 1.5 as in the original paper. */
+    double meanSSIM(const image &a, const image &b) {
+        const int    W = a.width, H = a.height;
+        const int    radius = 5;
+        const double C1 = 0.01 * 0.01, C2 = 0.03 * 0.03;
+
+        double kernel[2 * radius + 1], sum = 0.0;
+        for (int i = -radius; i <= radius; i++) {
+            kernel[i + radius] = std::exp(-(i * i) / (2.0 * 1.5 * 1.5));
+            sum += kernel[i + radius];
+        }
+        for (double &k: kernel) {
+            k /= sum;
+        }
+
+        auto luma = [W, H](const image &img) {
+            std::vector<double> y(static_cast<std::size_t>(W) * H);
+            for (std::size_t i = 0; i < y.size(); i++) {
+                y[i] = (0.299 * img.rgb[i * 3] + 0.587 * img.rgb[i * 3 + 1] + 0.114 * img.rgb[i * 3 + 2]) / 255.0;
+            }
+            return y;
+        };
+        std::vector<double> x = luma(a), y = luma(b);
+
+        /* Separable blurs of x, y, x^2, y^2, and xy. */
+        std::vector<double> src[5], tmp(x.size()), blurred[5];
+        src[0] = x;
+        src[1] = y;
+        for (int k = 2; k < 5; k++) {
+            src[k].resize(x.size());
+        }
+        for (std::size_t i = 0; i < x.size(); i++) {
+            src[2][i] = x[i] * x[i];
+            src[3][i] = y[i] * y[i];
+            src[4][i] = x[i] * y[i];
+        }
+        for (int k = 0; k < 5; k++) {
+            blurred[k].resize(x.size());
+            for (int j = 0; j < H; j++) {
+                for (int i = 0; i < W; i++) {
+                    double s = 0.0;
+                    for (int d = -radius; d <= radius; d++) {
+                        int ii = std::min(std::max(i + d, 0), W - 1);
+                        s += kernel[d + radius] * src[k][static_cast<std::size_t>(j) * W + ii];
+                    }
+                    tmp[static_cast<std::size_t>(j) * W + i] = s;
+                }
+            }
+            for (int j = 0; j < H; j++) {
+                for (int i = 0; i < W; i++) {
+                    double s = 0.0;
+                    for (int d = -radius; d <= radius; d++) {
+                        int jj = std::min(std::max(j + d, 0), H - 1);
+                        s += kernel[d + radius] * tmp[static_cast<std::size_t>(jj) * W + i];
+                    }
+                    blurred[k][static_cast<std::size_t>(j) * W + i] = s;
+                }
+            }
+        }
+
+        double total = 0.0;
+        for (std::size_t i = 0; i < x.size(); i++) {
+            double mx = blurred[0][i], my = blurred[1][i];
+            double vx = blurred[2][i] - mx * mx;
+            double vy = blurred[3][i] - my * my;
+            double cv = blurred[4][i] - mx * my;
+            total += ((2.0 * mx * my + C1) * (2.0 * cv + C2)) /
+                     ((mx * mx + my * my + C1) * (vx + vy + C2));
+        }
+        return total / x.size();
+    }
+
+    /* Render a scene with two configurations a few times, and keep
+     * the fastest run of each. The runs are interleaved so that
+     * changes in the load of the machine affect both of them
+     * equally. */
+    void render(const nm::config &cfgA, const nm::config &cfgB, const nm::scene &s,
+                int iterations, unsigned threads, nm::framebuffer &fbA, nm::framebuffer &fbB,
+                nm::stage_timings &bestA, nm::stage_timings &bestB) {
+        nm::renderer rA(cfgA, s.cam(), threads);
+        nm::renderer rB(cfgB, s.cam(), threads);
+        for (int i = 0; i < iterations; i++) {
+            nm::stage_timings tA = rA.render(s.get(), fbA);
+            nm::stage_timings tB = rB.render(s.get(), fbB);
+            if (i == 0 || tA.total() < bestA.total()) {
+                bestA = tA;
+            }
+            if (i == 0 || tB.total() < bestB.total()) {
+                bestB = tB;
+            }
+        }
+    }
+
+    void usage(const char *prog) {
+        std::fprintf(stderr,
+                     "Usage: %s [--reference=DIR [--update]] [--output=DIR] [--size=WxH]\n"
+                     "       [--iterations=N] [--threads=N] [--scene=NAME]...\n"
+                     "       [--baseline=CONFIGURE-OPTION]... [CONFIGURE-OPTION]...\n",
+                     prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string              reference;
+    std::string              output;
+    bool                     update     = false;
+    int                      width      = 320;
+    int                      height     = 180;
+    int                      iterations = 5;
+    int                      threads    = 1;
+    std::vector<std::string> only;
+    nm::config               baseline;
+    nm::config               candidate;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--reference=", 12) == 0) {
+            reference = argv[i] + 12;
+        }
+        else if (std::strcmp(argv[i], "--update") == 0) {
+            update = true;
+        }
+        else if (std::strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        }
+        else if (std::strncmp(argv[i], "--size=", 7) == 0) {
+            if (std::sscanf(argv[i] + 7, "%dx%d", &width, &height) != 2 ||
+                width < 16 || height < 16 || width > 4096 || height > 4096) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--iterations=", 13) == 0) {
+            iterations = std::atoi(argv[i] + 13);
+            if (iterations < 1) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = std::atoi(argv[i] + 10);
+            if (threads < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--scene=", 8) == 0) {
+            only.push_back(argv[i] + 8);
+        }
+        else if (std::strncmp(argv[i], "--baseline=", 11) == 0) {
+            if (!baseline.parse(argv[i] + 11)) {
+                std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i] + 11);
+                usage(argv[0]);
+            }
+        }
+        else if (!candidate.parse(argv[i])) {
+            std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            usage(argv[0]);
+        }
+    }
+    if (update && reference.empty()) {
+        usage(argv[0]);
+    }
+    for (const std::string &name: only) {
+        if (!nm::findScene(name)) {
+            std::fprintf(stderr, "%s: unknown scene: %s\n", argv[0], name.c_str());
+            return 1;
+        }
+    }
+
+    bool failed = false;
+
+    std::printf("%-10s %7s %7s %10s %10s %8s  %s\n",
+                "scene", "ssim", "budget", "base ms", "cand ms", "speedup", "result");
+    for (const nm::scene_desc &desc: nm::scenes()) {
+        if (!only.empty() && std::find(only.begin(), only.end(), desc.name) == only.end()) {
+            continue;
+        }
+
+        nm::scene       s(desc, width, height);
+        nm::framebuffer baseFB(width, height), candFB(width, height);
+        nm::stage_timings baseT, candT;
+        render(baseline, candidate, s, iterations, static_cast<unsigned>(threads),
+               baseFB, candFB, baseT, candT);
+        image cand = nm::toImage(candFB);
+
+        if (!output.empty() && !nm::writeTGA(output + "/" + desc.name + ".tga", cand)) {
+            return 1;
+        }
+
+        image ref;
+        if (reference.empty()) {
+            ref = nm::toImage(baseFB);
+        }
+        else {
+            std::string path = reference + "/" + desc.name + ".tga";
+            if (update) {
+                if (!nm::writeTGA(path, cand)) {
+                    return 1;
+                }
+                std::printf("%-10s updated %s\n", desc.name, path.c_str());
+                continue;
+            }
+            if (!nm::readTGA(path, ref)) {
+                return 1;
+            }
+            if (ref.width != width || ref.height != height) {
+                std::fprintf(stderr, "%s: the size is %dx%d, not %dx%d\n",
+                             path.c_str(), ref.width, ref.height, width, height);
+                return 1;
+            }
+        }
+
+        double ssim = meanSSIM(ref, cand);
+        bool   pass = ssim >= desc.ssimBudget;
+        failed = failed || !pass;
+        std::printf("%-10s %7.4f %7.4f %10.2f %10.2f %7.2fx  %s\n",
+                    desc.name, ssim, desc.ssimBudget,
+                    baseT.total() * 1000.0, candT.total() * 1000.0,
+                    baseT.total() / candT.total(),
+                    pass ? "ok" : "FAILED");
+        std::printf("%-10s vertex %.2f ms, setup %.2f ms, terrain %.2f ms, sky %.2f ms\n",
+                    "", candT.vertex * 1000.0, candT.setup * 1000.0,
+                    candT.terrain * 1000.0, candT.sky * 1000.0);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_IMAGE_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_IMAGE_HPP_INCLUDED 1
+
+/* 8-bit RGB images rendered by nm-pipeline.hpp, and just enough of
+ * the TGA format to store them.
+ */
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nm-pipeline.hpp"
+
+namespace nm {
+    /* An 8-bit RGB image from bottom to top. */
+    struct image {
+        int                        width  = 0;
+        int                        height = 0;
+        std::vector<unsigned char> rgb;
+    };
+
+    inline unsigned char quantize(float x) {
+        return static_cast<unsigned char>(clamp(x, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    inline image toImage(const framebuffer &fb) {
+        image img;
+        img.width  = fb.width;
+        img.height = fb.height;
+        img.rgb.resize(fb.color.size() * 3);
+        for (std::size_t i = 0; i < fb.color.size(); i++) {
+            img.rgb[i * 3 + 0] = quantize(fb.color[i].x);
+            img.rgb[i * 3 + 1] = quantize(fb.color[i].y);
+            img.rgb[i * 3 + 2] = quantize(fb.color[i].z);
+        }
+        return img;
+    }
+
+    inline bool writeTGA(const std::string &path, const image &img) {
+        FILE *out = std::fopen(path.c_str(), "wb");
+        if (!out) {
+            std::perror(path.c_str());
+            return false;
+        }
+
+        unsigned char header[18] = {0};
+        header[2]  = 2;  // Uncompressed true-color image.
+        header[12] = static_cast<unsigned char>(img.width  & 0xff);
+        header[13] = static_cast<unsigned char>(img.width  >> 8);
+        header[14] = static_cast<unsigned char>(img.height & 0xff);
+        header[15] = static_cast<unsigned char>(img.height >> 8);
+        header[16] = 24; // Bits per pixel, bottom-left origin.
+
+        std::vector<unsigned char> bgr(img.rgb.size());
+        for (std::size_t i = 0; i < img.rgb.size(); i += 3) {
+            bgr[i + 0] = img.rgb[i + 2];
+            bgr[i + 1] = img.rgb[i + 1];
+            bgr[i + 2] = img.rgb[i + 0];
+        }
+
+        bool ok = std::fwrite(header, sizeof(header), 1, out) == 1 &&
+                  std::fwrite(bgr.data(), bgr.size(), 1, out) == 1;
+        ok = std::fclose(out) == 0 && ok;
+        if (!ok) {
+            std::perror(path.c_str());
+        }
+        return ok;
+    }
+
+    /* Only reads what writeTGA() writes. */
+    inline bool readTGA(const std::string &path, image &img) {
+        FILE *in = std::fopen(path.c_str(), "rb");
+        if (!in) {
+            std::perror(path.c_str());
+            return false;
+        }
+
+        unsigned char header[18];
+        bool ok = std::fread(header, sizeof(header), 1, in) == 1 &&
+                  header[0] == 0 && header[1] == 0 && header[2] == 2 &&
+                  header[16] == 24 && (header[17] & 0x20) == 0;
+        if (ok) {
+            img.width  = header[12] | header[13] << 8;
+            img.height = header[14] | header[15] << 8;
+            img.rgb.resize(static_cast<std::size_t>(img.width) * img.height * 3);
+            ok = std::fread(img.rgb.data(), img.rgb.size(), 1, in) == 1;
+            for (std::size_t i = 0; ok && i < img.rgb.size(); i += 3) {
+                std::swap(img.rgb[i], img.rgb[i + 2]);
+            }
+        }
+        std::fclose(in);
+        if (!ok) {
+            std::fprintf(stderr, "%s: not a 24-bit TGA image written by writeTGA()\n", path.c_str());
+        }
+        return ok;
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_IMAGE_HPP_INCLUDED) */
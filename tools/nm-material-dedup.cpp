@@ -0,0 +1,609 @@
+// -*- c++ -*-
+/* nm-material-dedup: Rewrite materials so that variants compiling to
+ * the same shaders share them.
+ *
+ * Many variants of a material differ only in defines that the
+ * shaders, under a given natural-mystic-config.h, never look at. The
+ * game still compiles each distinct list of defines separately when
+ * a world loads. This program expands every program of the given
+ * materials for all the versions and capabilities a device may have
+ * (see nm-material.hpp and nm-preprocessor.hpp), and drops each
+ * define that makes no difference to any of them. It then rewrites
+ * the materials with "-defines" (and "+defines" where a parent has
+ * dropped a define a child still needs) so that the game compiles
+ * each distinct shader only once, and reports how many compiles that
+ * saves. A material where that saves nothing is left as it is.
+ *
+ * The game defines some macros by itself depending on the device and
+ * its settings, such as TEXEL_AA_FEATURE and FANCY, and the program
+ * tries both ways for those it knows about. A define that a shader
+ * tests together with a macro it doesn't know about is never
+ * dropped.
+ *
+ * Usage: nm-material-dedup [--material=FILE]... [--output=DIR]
+ *                          PACK-DIR...
+ *
+ * PACK-DIR and --material are the same as those of nm-compile-bench.
+ * The rewritten materials are written to DIR/materials/FILE. Without
+ * --output it only reports. The rewritten materials are checked to
+ * expand to the same shaders as the original ones before being
+ * written.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "nm-material.hpp"
+#include "nm-preprocessor.hpp"
+
+namespace {
+    /* Macros a device, or the game depending on its settings and on
+     * the pass, may or may not define regardless of the material. */
+    const char *const capabilities[] = {
+        "GL_FRAGMENT_PRECISION_HIGH",
+        "GL_OES_standard_derivatives",
+        "TEXEL_AA_FEATURE",
+        "FANCY",
+        "BYPASS_PIXEL_SHADER",
+    };
+
+    std::uint64_t fnv1a(std::uint64_t h, const std::string &s) {
+        for (unsigned char c: s) {
+            h ^= c;
+            h *= 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    std::string programKey(const std::string &vertexShader, const std::string &fragmentShader,
+                           std::vector<std::string> defines) {
+        std::sort(defines.begin(), defines.end());
+        std::string key = vertexShader + "\n" + fragmentShader;
+        for (const std::string &d: defines) {
+            key += "\n" + d;
+        }
+        return key;
+    }
+
+    std::string programKey(const nm::material_program &p) {
+        return programKey(p.vertexShader, p.fragmentShader, p.defines);
+    }
+
+    /* Computes a hash of everything a program compiles to. */
+    class signer {
+    public:
+        explicit signer(const std::vector<std::string> &packs)
+            : expander_(packs) {}
+
+        bool sign(const std::string &vertexShader, const std::string &fragmentShader,
+                  const std::vector<std::string> &defines, std::uint64_t &sig) {
+            std::string key = programKey(vertexShader, fragmentShader, defines);
+            auto it = signatures_.find(key);
+            if (it != signatures_.end()) {
+                sig = it->second;
+                return true;
+            }
+
+            sig = 0xcbf29ce484222325ull;
+            for (const std::string *shader: {&vertexShader, &fragmentShader}) {
+                for (int version: {100, 300}) {
+                    const shader_body *body = expand(*shader, version);
+                    if (!body) {
+                        return false;
+                    }
+                    for (unsigned caps = 0; caps < 1u << body->capabilities.size(); caps++) {
+                        std::map<std::string, std::string> predefined = {
+                            {"__VERSION__", std::to_string(version)},
+                            {"GL_ES", "1"},
+                        };
+                        for (std::size_t c = 0; c < body->capabilities.size(); c++) {
+                            if (caps & (1u << c)) {
+                                predefined[body->capabilities[c]] = "1";
+                            }
+                        }
+                        for (const std::string &d: defines) {
+                            predefined[d] = "";
+                        }
+                        nm::preprocessor pp(predefined);
+                        std::string      out;
+                        if (!pp.run(body->text, out)) {
+                            std::fprintf(stderr, "%s: %s\n", shader->c_str(), pp.error().c_str());
+                            return false;
+                        }
+                        sig = fnv1a(sig, out);
+                        /* A define that survives as a token makes a
+                         * difference even if nothing tests it. */
+                        for (const std::string &d: defines) {
+                            if (usesIdentifier(out, d)) {
+                                sig = fnv1a(sig, "\n#uses " + d);
+                            }
+                        }
+                    }
+                }
+            }
+            signatures_[key] = sig;
+            return true;
+        }
+
+        bool sign(const nm::material_program &p, std::uint64_t &sig) {
+            return sign(p.vertexShader, p.fragmentShader, p.defines, sig);
+        }
+
+        /* Every define any material being rewritten has. The
+         * shaders may test them alongside each other. */
+        void setMaterialDefines(const std::set<std::string> &defines) {
+            materialDefines_ = defines;
+        }
+
+        /* The defines of "p" without those that make no difference,
+         * in their original order. A define tested together with a
+         * macro that is neither a material define, nor a capability,
+         * nor defined by the shaders themselves is kept, as it is
+         * likely something the game defines that this program doesn't
+         * know about. */
+        bool minimize(const nm::material_program &p, std::vector<std::string> &defines) {
+            std::uint64_t sig;
+            if (!sign(p, sig)) {
+                return false;
+            }
+            std::set<std::string> live;
+            for (const std::string *shader: {&p.vertexShader, &p.fragmentShader}) {
+                for (int version: {100, 300}) {
+                    const shader_body *body = expand(*shader, version);
+                    if (!body) {
+                        return false;
+                    }
+                    keepUnresolved(*shader, *body, live);
+                }
+            }
+            defines = p.defines;
+            for (const std::string &d: p.defines) {
+                if (live.count(d)) {
+                    continue;
+                }
+                std::vector<std::string> trial;
+                for (const std::string &e: defines) {
+                    if (e != d) {
+                        trial.push_back(e);
+                    }
+                }
+                std::uint64_t trialSig;
+                if (!sign(p.vertexShader, p.fragmentShader, trial, trialSig)) {
+                    return false;
+                }
+                if (trialSig == sig) {
+                    defines = trial;
+                }
+            }
+            return true;
+        }
+
+    private:
+        struct shader_body {
+            std::string                           text;
+            /* The capabilities the shader mentions. Only these
+             * are enumerated. */
+            std::vector<std::string>              capabilities;
+            /* The identifiers each conditional directive tests. */
+            std::vector<std::vector<std::string>> conditions;
+            /* The macros the shader defines or undefines anywhere,
+             * even in a comment, which is how natural-mystic-config.h
+             * lists a disabled option. These can all be resolved. */
+            std::set<std::string>                 macros;
+        };
+
+        /* The shader with its #include files but without defines,
+         * which are given to the preprocessor instead. */
+        const shader_body *expand(const std::string &shader, int version) {
+            std::string key = shader + "@" + std::to_string(version);
+            auto it = bodies_.find(key);
+            if (it == bodies_.end()) {
+                shader_body body;
+                if (!expander_.expand(shader, version, {}, body.text)) {
+                    std::fprintf(stderr, "%s\n", expander_.error().c_str());
+                    return nullptr;
+                }
+                for (const char *c: capabilities) {
+                    if (usesIdentifier(body.text, c)) {
+                        body.capabilities.push_back(c);
+                    }
+                }
+                body.conditions = nm::preprocessor::conditions(body.text);
+                for (const char *directive: {"#define", "#undef"}) {
+                    for (std::size_t p = body.text.find(directive); p != std::string::npos;
+                         p = body.text.find(directive, p + 1)) {
+                        std::size_t b = body.text.find_first_not_of(" \t", p + std::strlen(directive));
+                        std::size_t e = b;
+                        while (e < body.text.size() &&
+                               (std::isalnum(static_cast<unsigned char>(body.text[e])) || body.text[e] == '_')) {
+                            e++;
+                        }
+                        if (b != std::string::npos && e > b) {
+                            body.macros.insert(body.text.substr(b, e - b));
+                        }
+                    }
+                }
+                it = bodies_.emplace(key, std::move(body)).first;
+            }
+            return &it->second;
+        }
+
+        /* Add to "live" the material defines "body" tests in a
+         * condition together with a macro it can't resolve. */
+        void keepUnresolved(const std::string &shader, const shader_body &body, std::set<std::string> &live) {
+            for (const std::vector<std::string> &idents: body.conditions) {
+                std::string unknown;
+                for (const std::string &i: idents) {
+                    bool known = i == "__VERSION__" || i == "GL_ES" ||
+                        materialDefines_.count(i) || body.macros.count(i) ||
+                        std::find_if(std::begin(capabilities), std::end(capabilities),
+                                     [&](const char *c) { return i == c; }) != std::end(capabilities);
+                    if (!known) {
+                        unknown = i;
+                        break;
+                    }
+                }
+                if (unknown.empty()) {
+                    continue;
+                }
+                for (const std::string &i: idents) {
+                    if (materialDefines_.count(i) && live.insert(i).second &&
+                        warned_.insert(shader + "\n" + i + "\n" + unknown).second) {
+                        std::fprintf(stderr, "%s: keeping %s, as it is tested together with unknown %s\n",
+                                     shader.c_str(), i.c_str(), unknown.c_str());
+                    }
+                }
+            }
+        }
+
+        static bool usesIdentifier(const std::string &text, const std::string &name) {
+            auto isIdent = [](char c) {
+                return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+            };
+            for (std::size_t p = text.find(name); p != std::string::npos; p = text.find(name, p + 1)) {
+                bool before = p > 0 && isIdent(text[p - 1]);
+                bool after  = p + name.size() < text.size() && isIdent(text[p + name.size()]);
+                if (!before && !after) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        nm::shader_expander                  expander_;
+        std::map<std::string, shader_body>   bodies_;
+        std::map<std::string, std::uint64_t> signatures_;
+        std::set<std::string>                materialDefines_;
+        std::set<std::string>                warned_;
+    };
+
+    std::string join(const std::vector<std::string> &strs) {
+        std::string out;
+        for (const std::string &s: strs) {
+            out += (out.empty() ? "" : ", ") + s;
+        }
+        return out;
+    }
+
+    /* In-place edits of the text of a material file. */
+    class material_editor {
+    public:
+        explicit material_editor(const std::string &path, const std::string &text)
+            : path_(path), text_(text) {}
+
+        const std::string &text() const { return text_; }
+
+        bool parse() {
+            root_ = nm::json_value();
+            nm::json_parser parser(text_);
+            if (!parser.parse(root_)) {
+                std::fprintf(stderr, "%s: %s\n", path_.c_str(), parser.error().c_str());
+                return false;
+            }
+            return true;
+        }
+
+        bool programs(std::vector<nm::material_program> &out) const {
+            out.clear();
+            return nm::parseMaterialPrograms(path_, text_, out);
+        }
+
+        /* The body of the i-th member of the materials. */
+        const nm::json_value &body(std::size_t i) const {
+            return nm::materialDefinitions(root_).members[i];
+        }
+
+        std::size_t size() const {
+            return nm::materialDefinitions(root_).keys.size();
+        }
+
+        /* The name of the i-th material without its parent. */
+        std::string name(std::size_t i) const {
+            const std::string &key = nm::materialDefinitions(root_).keys[i];
+            return key.substr(0, key.find(':'));
+        }
+
+        /* Append JSON values to an array member of the i-th material,
+         * creating it if it doesn't exist. Invalidates body(). */
+        void append(std::size_t i, const std::string &key, const std::vector<std::string> &items) {
+            const nm::json_value &obj = body(i);
+            std::string list = join(items);
+
+            if (const nm::json_value *arr = obj.find(key)) {
+                if (arr->elements.empty()) {
+                    text_.insert(arr->begin + 1, " " + list + " ");
+                }
+                else {
+                    text_.insert(arr->elements.back().end, ", " + list);
+                }
+            }
+            else if (obj.members.empty()) {
+                std::string indent = indentOf(obj.begin);
+                text_.replace(obj.begin, obj.end - obj.begin,
+                              "{\n" + indent + "  \"" + key + "\": [ " + list + " ]\n" + indent + "}");
+            }
+            else {
+                std::string indent = indentOf(obj.members.back().begin);
+                text_.insert(obj.members.back().end,
+                             ",\n" + indent + "\"" + key + "\": [ " + list + " ]");
+            }
+            parse();
+        }
+
+    private:
+        /* The whitespace at the beginning of the line containing
+         * "offset". */
+        std::string indentOf(std::size_t offset) const {
+            std::size_t lineBegin = text_.rfind('\n', offset);
+            lineBegin = lineBegin == std::string::npos ? 0 : lineBegin + 1;
+            std::size_t e = text_.find_first_not_of(" \t", lineBegin);
+            return text_.substr(lineBegin, std::min(e, offset) - lineBegin);
+        }
+
+        std::string     path_;
+        std::string     text_;
+        nm::json_value  root_;
+    };
+
+    std::vector<std::string> quoted(const std::vector<std::string> &strs) {
+        std::vector<std::string> out;
+        for (const std::string &s: strs) {
+            out.push_back("\"" + s + "\"");
+        }
+        return out;
+    }
+
+    /* The defines to remove from and to add to "from" to get "to". */
+    void difference(const std::vector<std::string> &from, const std::vector<std::string> &to,
+                    std::vector<std::string> &remove, std::vector<std::string> &add) {
+        remove.clear();
+        add.clear();
+        for (const std::string &d: from) {
+            if (std::find(to.begin(), to.end(), d) == to.end()) {
+                remove.push_back(d);
+            }
+        }
+        for (const std::string &d: to) {
+            if (std::find(from.begin(), from.end(), d) == from.end()) {
+                add.push_back(d);
+            }
+        }
+    }
+
+    /* Rewrite the text of a material file so that each program has
+     * the defines in "targets", keyed by the name of the program. */
+    bool rewrite(material_editor &editor, const std::map<std::string, std::vector<std::string>> &targets) {
+        if (!editor.parse()) {
+            return false;
+        }
+        std::vector<nm::material_program> programs;
+        for (std::size_t i = 0; i < editor.size(); i++) {
+            if (editor.body(i).type != nm::JSON_OBJECT) {
+                continue;
+            }
+            const std::string material = editor.name(i);
+
+            /* The material itself first, as its variants inherit
+             * its defines, and then each of its variants. Each edit
+             * changes what the following ones start from. */
+            for (std::size_t k = 0; ; k++) {
+                if (!editor.programs(programs)) {
+                    return false;
+                }
+                auto it = std::find_if(programs.begin(), programs.end(), [&](const nm::material_program &p) {
+                    return p.material == material;
+                });
+                std::size_t remaining = static_cast<std::size_t>(
+                    std::count_if(programs.begin(), programs.end(), [&](const nm::material_program &p) {
+                        return p.material == material;
+                    }));
+                if (k >= remaining) {
+                    break;
+                }
+                const nm::material_program &p = *(it + static_cast<std::ptrdiff_t>(k));
+
+                std::vector<std::string> remove, add;
+                difference(p.defines, targets.at(p.name()), remove, add);
+                if (remove.empty() && add.empty()) {
+                    continue;
+                }
+                if (p.variant.empty()) {
+                    if (!remove.empty()) {
+                        editor.append(i, "-defines", quoted(remove));
+                    }
+                    if (!add.empty()) {
+                        editor.append(i, "+defines", quoted(add));
+                    }
+                }
+                else {
+                    std::string v = "{ \"" + p.variant + "\": { ";
+                    std::vector<std::string> parts;
+                    if (!remove.empty()) {
+                        parts.push_back("\"-defines\": [ " + join(quoted(remove)) + " ]");
+                    }
+                    if (!add.empty()) {
+                        parts.push_back("\"+defines\": [ " + join(quoted(add)) + " ]");
+                    }
+                    v += join(parts) + " } }";
+                    editor.append(i, "+variants", {v});
+                }
+            }
+        }
+        return true;
+    }
+
+    bool makeDirectory(const std::string &path) {
+        if (mkdir(path.c_str(), 0777) != 0 && errno != EEXIST) {
+            std::perror(path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void usage(const char *prog) {
+        std::fprintf(stderr,
+                     "Usage: %s [--material=FILE]... [--output=DIR] PACK-DIR...\n",
+                     prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> packs;
+    std::vector<std::string> materials;
+    std::string              output;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--material=", 11) == 0) {
+            materials.push_back(argv[i] + 11);
+        }
+        else if (std::strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        }
+        else if (argv[i][0] != '-') {
+            packs.push_back(argv[i]);
+        }
+        else {
+            std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            usage(argv[0]);
+        }
+    }
+    if (packs.empty()) {
+        usage(argv[0]);
+    }
+    if (materials.empty()) {
+        materials = {"terrain.material", "sky.material"};
+    }
+    if (!output.empty() && (!makeDirectory(output) || !makeDirectory(output + "/materials"))) {
+        return 1;
+    }
+
+    signer      sign(packs);
+    std::size_t totalPrograms = 0, totalBefore = 0, totalAfter = 0;
+    for (const std::string &m: materials) {
+        std::string path, text;
+        if (!nm::findPackFile(packs, "materials/" + m, path)) {
+            std::fprintf(stderr, "%s: materials/%s: not found in any of the resource packs\n",
+                         argv[0], m.c_str());
+            return 1;
+        }
+        if (!nm::readFile(path, text)) {
+            std::perror(path.c_str());
+            return 1;
+        }
+
+        material_editor                   editor(path, text);
+        std::vector<nm::material_program> original;
+        if (!editor.programs(original)) {
+            return 1;
+        }
+
+        std::set<std::string> materialDefines;
+        for (const nm::material_program &p: original) {
+            materialDefines.insert(p.defines.begin(), p.defines.end());
+        }
+        sign.setMaterialDefines(materialDefines);
+
+        std::map<std::string, std::vector<std::string>> targets;
+        std::set<std::string>                           before;
+        for (const nm::material_program &p: original) {
+            std::vector<std::string> defines;
+            if (!sign.minimize(p, defines)) {
+                return 1;
+            }
+            targets[p.name()] = defines;
+            before.insert(programKey(p));
+        }
+
+        std::vector<nm::material_program> rewritten;
+        if (!rewrite(editor, targets) || !editor.programs(rewritten)) {
+            return 1;
+        }
+
+        /* Check that every program still expands to the same
+         * shaders, in case the rewriting went wrong. */
+        std::set<std::string> after;
+        bool                  same = rewritten.size() == original.size();
+        for (std::size_t i = 0; same && i < rewritten.size(); i++) {
+            const nm::material_program &p = rewritten[i];
+            const nm::material_program &q = original[i];
+            std::uint64_t a, b;
+            if (!sign.sign(p, a) || !sign.sign(q, b)) {
+                return 1;
+            }
+            std::vector<std::string> got = p.defines, want = targets[q.name()];
+            std::sort(got.begin(), got.end());
+            std::sort(want.begin(), want.end());
+            same = p.name() == q.name() && a == b && got == want;
+            after.insert(programKey(p));
+        }
+        if (!same) {
+            std::fprintf(stderr, "%s: rewriting changed the shaders of a program; this is a bug\n", path.c_str());
+            return 1;
+        }
+
+        /* Dropping defines that merge no programs saves nothing, and
+         * the game may still look at them in ways this program can't
+         * see, so leave such a material as it is. */
+        bool merged = after.size() < before.size();
+        std::printf("%s: %zu programs, %zu distinct before, %zu after%s\n",
+                    m.c_str(), original.size(), before.size(), after.size(),
+                    merged ? "" : "; left as it is");
+        totalPrograms += original.size();
+        totalBefore   += before.size();
+        totalAfter    += merged ? after.size() : before.size();
+
+        if (!output.empty()) {
+            const std::string &result = merged ? editor.text() : text;
+            std::string out = output + "/materials/" + m;
+            FILE *fp = std::fopen(out.c_str(), "wb");
+            if (!fp) {
+                std::perror(out.c_str());
+                return 1;
+            }
+            bool ok = std::fwrite(result.data(), 1, result.size(), fp) == result.size();
+            ok = std::fclose(fp) == 0 && ok;
+            if (!ok) {
+                std::perror(out.c_str());
+                return 1;
+            }
+        }
+    }
+
+    /* A device compiles every distinct program once, for either of
+     * the versions. */
+    std::printf("%zu programs, %zu compiles saved at load time (%zu -> %zu)\n",
+                totalPrograms, totalBefore - totalAfter, totalBefore, totalAfter);
+    return 0;
+}
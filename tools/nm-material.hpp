@@ -0,0 +1,636 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_MATERIAL_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_MATERIAL_HPP_INCLUDED 1
+
+/* Materials and shaders as the game sees them: a reader of .material
+ * files that expands every material into the programs the game
+ * compiles, and an expander that turns a program into the GLSL
+ * source the game hands to the driver.
+ *
+ * The game isn't documented, so the rules here are what we could
+ * infer from the vanilla materials:
+ *
+ *   - A material named "child:parent" starts as a copy of "parent",
+ *     which must be defined earlier in the same file.
+ *   - "defines" and "variants" replace those of the parent, and
+ *     "+defines", "-defines", and "+variants" modify them.
+ *   - Every material is compiled once by itself, and once for each
+ *     of its variants. A variant named "a.b" applies the variant "a"
+ *     first. A variant defined again by a child is merged into the
+ *     inherited one.
+ *   - Shaders named "shaders/NAME" are looked up as
+ *     "shaders/glsl/NAME" in each resource pack in turn, and so are
+ *     their #include files.
+ *   - The loader replaces the "// __multiversion__" line with either
+ *     "#version 100" or "#version 300 es", and puts the defines of
+ *     the program right after it.
+ *
+ * The loader expands #include directives textually, regardless of
+ * the preprocessor conditions around them. We expand each file only
+ * once per shader, which is equivalent as long as every header has
+ * an include guard.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace nm {
+    enum json_type {
+        JSON_NULL,
+        JSON_BOOL,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT
+    };
+
+    /* A JSON value. Objects keep the order of their members. */
+    struct json_value {
+        json_type                type    = JSON_NULL;
+        bool                     boolean = false;
+        double                   number  = 0.0;
+        std::string              string;
+        std::vector<json_value>  elements; // JSON_ARRAY
+        std::vector<std::string> keys;     // JSON_OBJECT
+        std::vector<json_value>  members;  // JSON_OBJECT, in the order of keys
+        std::size_t              begin   = 0;  // Offsets of the value in the text,
+        std::size_t              end     = 0;  // so that it can be edited in place.
+
+        /* The member named "key", or nullptr if there isn't one. */
+        const json_value *find(const std::string &key) const {
+            for (std::size_t i = 0; i < keys.size(); i++) {
+                if (keys[i] == key) {
+                    return &members[i];
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    /* A parser for the dialect of JSON used in materials, which
+     * allows comments and trailing commas. */
+    class json_parser {
+    public:
+        explicit json_parser(const std::string &text)
+            : text_(text) {}
+
+        /* Parse the whole text. Return false and set error() on
+         * failure. */
+        bool parse(json_value &out) {
+            if (!value(out)) {
+                return false;
+            }
+            skip();
+            return pos_ == text_.size() || fail("garbage after the end");
+        }
+
+        const std::string &error() const { return error_; }
+
+    private:
+        bool fail(const char *what) {
+            error_ = "line " + std::to_string(line_) + ": " + what;
+            return false;
+        }
+
+        /* Skip whitespace and comments. */
+        void skip() {
+            while (pos_ < text_.size()) {
+                char c = text_[pos_];
+                if (c == '\n') {
+                    line_++;
+                    pos_++;
+                }
+                else if (c == ' ' || c == '\t' || c == '\r') {
+                    pos_++;
+                }
+                else if (text_.compare(pos_, 2, "//") == 0) {
+                    pos_ = text_.find('\n', pos_);
+                    if (pos_ == std::string::npos) {
+                        pos_ = text_.size();
+                    }
+                }
+                else if (text_.compare(pos_, 2, "/*") == 0) {
+                    std::size_t end = text_.find("*/", pos_ + 2);
+                    end = end == std::string::npos ? text_.size() : end + 2;
+                    line_ += static_cast<int>(std::count(text_.begin() + pos_, text_.begin() + end, '\n'));
+                    pos_  = end;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        bool literal(const char *word) {
+            std::string w(word);
+            if (text_.compare(pos_, w.size(), w) != 0) {
+                return fail("unexpected character");
+            }
+            pos_ += w.size();
+            return true;
+        }
+
+        bool value(json_value &out) {
+            skip();
+            out.begin = pos_;
+            bool ok = scalarOrCompound(out);
+            out.end = pos_;
+            return ok;
+        }
+
+        bool scalarOrCompound(json_value &out) {
+            if (pos_ == text_.size()) {
+                return fail("unexpected end of file");
+            }
+            switch (text_[pos_]) {
+            case '{':
+                return object(out);
+            case '[':
+                return array(out);
+            case '"':
+                out.type = JSON_STRING;
+                return string(out.string);
+            case 't':
+                out.type    = JSON_BOOL;
+                out.boolean = true;
+                return literal("true");
+            case 'f':
+                out.type    = JSON_BOOL;
+                out.boolean = false;
+                return literal("false");
+            case 'n':
+                out.type = JSON_NULL;
+                return literal("null");
+            default:
+                return number(out);
+            }
+        }
+
+        bool number(json_value &out) {
+            const char *begin = text_.c_str() + pos_;
+            char       *end;
+            out.type   = JSON_NUMBER;
+            out.number = std::strtod(begin, &end);
+            if (end == begin) {
+                return fail("unexpected character");
+            }
+            pos_ += static_cast<std::size_t>(end - begin);
+            return true;
+        }
+
+        bool string(std::string &out) {
+            out.clear();
+            pos_++; // '"'
+            while (pos_ < text_.size() && text_[pos_] != '"') {
+                char c = text_[pos_++];
+                if (c == '\n') {
+                    return fail("newline in a string");
+                }
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+                if (pos_ == text_.size()) {
+                    break;
+                }
+                switch (c = text_[pos_++]) {
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    if (pos_ + 4 > text_.size()) {
+                        return fail("truncated \\u escape");
+                    }
+                    unsigned long cp = std::strtoul(text_.substr(pos_, 4).c_str(), nullptr, 16);
+                    pos_ += 4;
+                    /* Surrogate pairs don't appear in materials, so
+                     * they are encoded separately. */
+                    if (cp < 0x80) {
+                        out += static_cast<char>(cp);
+                    }
+                    else if (cp < 0x800) {
+                        out += static_cast<char>(0xc0 | (cp >> 6));
+                        out += static_cast<char>(0x80 | (cp & 0x3f));
+                    }
+                    else {
+                        out += static_cast<char>(0xe0 | (cp >> 12));
+                        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                        out += static_cast<char>(0x80 | (cp & 0x3f));
+                    }
+                    break;
+                }
+                default:
+                    out += c;
+                }
+            }
+            if (pos_ == text_.size()) {
+                return fail("unterminated string");
+            }
+            pos_++; // '"'
+            return true;
+        }
+
+        bool array(json_value &out) {
+            out.type = JSON_ARRAY;
+            pos_++; // '['
+            while (true) {
+                skip();
+                if (pos_ < text_.size() && text_[pos_] == ']') {
+                    pos_++;
+                    return true;
+                }
+                out.elements.emplace_back();
+                if (!value(out.elements.back())) {
+                    return false;
+                }
+                skip();
+                if (pos_ < text_.size() && text_[pos_] == ',') {
+                    pos_++;
+                }
+                else if (pos_ < text_.size() && text_[pos_] != ']') {
+                    return fail("expected ',' or ']'");
+                }
+            }
+        }
+
+        bool object(json_value &out) {
+            out.type = JSON_OBJECT;
+            pos_++; // '{'
+            while (true) {
+                skip();
+                if (pos_ < text_.size() && text_[pos_] == '}') {
+                    pos_++;
+                    return true;
+                }
+                if (pos_ == text_.size() || text_[pos_] != '"') {
+                    return fail("expected a member name");
+                }
+                out.keys.emplace_back();
+                if (!string(out.keys.back())) {
+                    return false;
+                }
+                skip();
+                if (pos_ == text_.size() || text_[pos_] != ':') {
+                    return fail("expected ':'");
+                }
+                pos_++;
+                out.members.emplace_back();
+                if (!value(out.members.back())) {
+                    return false;
+                }
+                skip();
+                if (pos_ < text_.size() && text_[pos_] == ',') {
+                    pos_++;
+                }
+                else if (pos_ < text_.size() && text_[pos_] != '}') {
+                    return fail("expected ',' or '}'");
+                }
+            }
+        }
+
+        const std::string &text_;
+        std::size_t        pos_  = 0;
+        int                line_ = 1;
+        std::string        error_;
+    };
+
+    inline bool readFile(const std::string &path, std::string &out) {
+        FILE *in = std::fopen(path.c_str(), "rb");
+        if (!in) {
+            return false;
+        }
+        out.clear();
+        char        buf[8192];
+        std::size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), in)) > 0) {
+            out.append(buf, n);
+        }
+        bool ok = !std::ferror(in);
+        std::fclose(in);
+        return ok;
+    }
+
+    /* Find "rel" in the first resource pack that has it. */
+    inline bool findPackFile(const std::vector<std::string> &packs, const std::string &rel, std::string &path) {
+        for (const std::string &pack: packs) {
+            std::string candidate = pack + "/" + rel;
+            if (FILE *fp = std::fopen(candidate.c_str(), "rb")) {
+                std::fclose(fp);
+                path = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* A program the game compiles for a variant of a material. */
+    struct material_program {
+        std::string              material;       // Without the parent, e.g. "terrain_blend".
+        std::string              variant;        // Empty for the material itself.
+        std::string              vertexShader;   // As written, e.g. "shaders/renderchunk.vertex".
+        std::string              fragmentShader;
+        std::vector<std::string> defines;
+
+        std::string name() const {
+            return variant.empty() ? material : material + "/" + variant;
+        }
+    };
+
+    namespace detail {
+        /* A material with its parents applied. */
+        struct resolved_material {
+            std::string              vertexShader;
+            std::string              fragmentShader;
+            std::vector<std::string> defines;
+            /* The bodies of each variant, in the order they apply. */
+            std::vector<std::pair<std::string, std::vector<const json_value *>>> variants;
+        };
+
+        inline void addDefines(std::vector<std::string> &defines, const json_value *list) {
+            if (!list) {
+                return;
+            }
+            for (const json_value &d: list->elements) {
+                if (std::find(defines.begin(), defines.end(), d.string) == defines.end()) {
+                    defines.push_back(d.string);
+                }
+            }
+        }
+
+        inline void removeDefines(std::vector<std::string> &defines, const json_value *list) {
+            if (!list) {
+                return;
+            }
+            for (const json_value &d: list->elements) {
+                defines.erase(std::remove(defines.begin(), defines.end(), d.string), defines.end());
+            }
+        }
+
+        /* Apply the shaders and the defines of a material or a
+         * variant. */
+        inline void applyProgram(const json_value &body, std::string &vertexShader,
+                                 std::string &fragmentShader, std::vector<std::string> &defines) {
+            if (const json_value *v = body.find("vertexShader")) {
+                vertexShader = v->string;
+            }
+            if (const json_value *v = body.find("fragmentShader")) {
+                fragmentShader = v->string;
+            }
+            if (const json_value *v = body.find("defines")) {
+                defines.clear();
+                addDefines(defines, v);
+            }
+            addDefines(defines, body.find("+defines"));
+            removeDefines(defines, body.find("-defines"));
+        }
+
+        inline void addVariants(resolved_material &m, const json_value *list) {
+            if (!list) {
+                return;
+            }
+            for (const json_value &v: list->elements) {
+                for (std::size_t i = 0; i < v.keys.size(); i++) {
+                    auto it = std::find_if(m.variants.begin(), m.variants.end(),
+                                           [&v, i](const std::pair<std::string, std::vector<const json_value *>> &p) {
+                                               return p.first == v.keys[i];
+                                           });
+                    if (it == m.variants.end()) {
+                        m.variants.emplace_back(v.keys[i], std::vector<const json_value *>());
+                        it = m.variants.end() - 1;
+                    }
+                    it->second.push_back(&v.members[i]);
+                }
+            }
+        }
+    }
+
+    /* The object holding the materials of a .material file. Some
+     * files wrap them in "materials", along with a "version"
+     * string. */
+    inline const json_value &materialDefinitions(const json_value &root) {
+        const json_value *defs = root.find("materials");
+        return defs && defs->type == JSON_OBJECT ? *defs : root;
+    }
+
+    /* Parse the text of a .material file and append the programs of
+     * all of its materials to "out". Materials without a vertex or a
+     * fragment shader, which only exist to be inherited, are
+     * skipped. Return false and print a message mentioning "path" on
+     * failure. */
+    inline bool parseMaterialPrograms(const std::string &path, const std::string &text,
+                                      std::vector<material_program> &out) {
+        json_value  root;
+        json_parser parser(text);
+        if (!parser.parse(root)) {
+            std::fprintf(stderr, "%s: %s\n", path.c_str(), parser.error().c_str());
+            return false;
+        }
+        const json_value *defs = &materialDefinitions(root);
+
+        std::map<std::string, detail::resolved_material> resolved;
+        for (std::size_t i = 0; i < defs->keys.size(); i++) {
+            const json_value &body = defs->members[i];
+            if (body.type != JSON_OBJECT) {
+                continue;
+            }
+            std::string name  = defs->keys[i];
+            std::size_t colon = name.find(':');
+            detail::resolved_material m;
+            if (colon != std::string::npos) {
+                std::string parent = name.substr(colon + 1);
+                name = name.substr(0, colon);
+                auto it = resolved.find(parent);
+                if (it == resolved.end()) {
+                    std::fprintf(stderr, "%s: %s: unknown parent material: %s\n",
+                                 path.c_str(), name.c_str(), parent.c_str());
+                    return false;
+                }
+                m = it->second;
+            }
+            detail::applyProgram(body, m.vertexShader, m.fragmentShader, m.defines);
+            if (const json_value *v = body.find("variants")) {
+                m.variants.clear();
+                detail::addVariants(m, v);
+            }
+            detail::addVariants(m, body.find("+variants"));
+
+            if (!m.vertexShader.empty() && !m.fragmentShader.empty()) {
+                material_program base;
+                base.material       = name;
+                base.vertexShader   = m.vertexShader;
+                base.fragmentShader = m.fragmentShader;
+                base.defines        = m.defines;
+                out.push_back(base);
+
+                for (const auto &variant: m.variants) {
+                    material_program p = base;
+                    p.variant = variant.first;
+                    /* "a.b" is a variant of the variant "a". */
+                    for (const auto &other: m.variants) {
+                        if (variant.first.compare(0, other.first.size() + 1, other.first + ".") == 0) {
+                            for (const json_value *b: other.second) {
+                                detail::applyProgram(*b, p.vertexShader, p.fragmentShader, p.defines);
+                            }
+                        }
+                    }
+                    for (const json_value *b: variant.second) {
+                        detail::applyProgram(*b, p.vertexShader, p.fragmentShader, p.defines);
+                    }
+                    out.push_back(p);
+                }
+            }
+            resolved[name] = m;
+        }
+        return true;
+    }
+
+    /* Read a .material file. See parseMaterialPrograms(). */
+    inline bool loadMaterialPrograms(const std::string &path, std::vector<material_program> &out) {
+        std::string text;
+        if (!readFile(path, text)) {
+            std::perror(path.c_str());
+            return false;
+        }
+        return parseMaterialPrograms(path, text, out);
+    }
+
+    enum shader_stage {
+        STAGE_VERTEX,
+        STAGE_FRAGMENT
+    };
+
+    /* Expands shaders of materials into what the driver compiles. */
+    class shader_expander {
+    public:
+        /* With "skipMissing", an #include of a file that is in none
+         * of the packs is dropped instead of being an error. This is
+         * for checks that only look at our own shaders and have to
+         * work without the vanilla pack. The dropped files are listed
+         * in skipped(). */
+        explicit shader_expander(const std::vector<std::string> &packs, bool skipMissing = false)
+            : packs_(packs), skipMissing_(skipMissing) {}
+
+        /* Expand a shader named as in a material, e.g.
+         * "shaders/renderchunk.vertex", for "#version <version>"
+         * (100 or 300). Return false and set error() on failure. */
+        bool expand(const std::string &shader, int version,
+                    const std::vector<std::string> &defines, std::string &out) {
+            const std::string prefix = "shaders/";
+            std::string name = shader.compare(0, prefix.size(), prefix) == 0
+                ? shader.substr(prefix.size())
+                : shader;
+
+            std::string body;
+            std::set<std::string> included;
+            if (!include(name, body, included, 0)) {
+                return false;
+            }
+
+            out = version >= 300 ? "#version 300 es\n" : "#version 100\n";
+            for (const std::string &d: defines) {
+                out += "#define " + d + "\n";
+            }
+            std::size_t marker = body.find("// __multiversion__");
+            if (marker == std::string::npos) {
+                error_ = shader + ": not a multiversion shader";
+                return false;
+            }
+            body.erase(marker, body.find('\n', marker) - marker);
+            out += body;
+            return true;
+        }
+
+        const std::string &error() const { return error_; }
+
+        const std::set<std::string> &skipped() const { return skipped_; }
+
+    private:
+        /* Read a file under shaders/glsl/, caching it because every
+         * variant includes the same headers. */
+        const std::string *load(const std::string &name) {
+            auto it = files_.find(name);
+            if (it == files_.end()) {
+                std::string path, text;
+                if (!findPackFile(packs_, "shaders/glsl/" + name, path) || !readFile(path, text)) {
+                    return nullptr;
+                }
+                it = files_.emplace(name, text).first;
+            }
+            return &it->second;
+        }
+
+        bool include(const std::string &name, std::string &out,
+                     std::set<std::string> &included, int depth) {
+            if (depth > 32) {
+                error_ = name + ": #include nested too deeply";
+                return false;
+            }
+            const std::string *text = load(name);
+            if (!text && skipMissing_ && depth > 0) {
+                skipped_.insert(name);
+                return true;
+            }
+            if (!text) {
+                error_ = name + ": not found in any of the resource packs";
+                return false;
+            }
+            included.insert(name);
+
+            std::size_t pos = 0;
+            while (pos < text->size()) {
+                std::size_t end = text->find('\n', pos);
+                end = end == std::string::npos ? text->size() : end + 1;
+
+                std::string header;
+                if (includedHeader(*text, pos, end, header)) {
+                    if (!included.count(header) && !include(header, out, included, depth + 1)) {
+                        error_ = name + ": " + error_;
+                        return false;
+                    }
+                }
+                else {
+                    out.append(*text, pos, end - pos);
+                }
+                pos = end;
+            }
+            if (!out.empty() && out.back() != '\n') {
+                out += '\n';
+            }
+            return true;
+        }
+
+        /* Whether the line [begin, end) is #include "header". */
+        static bool includedHeader(const std::string &text, std::size_t begin, std::size_t end, std::string &header) {
+            std::size_t p = text.find_first_not_of(" \t", begin);
+            if (p >= end || text[p] != '#') {
+                return false;
+            }
+            p = text.find_first_not_of(" \t", p + 1);
+            if (p >= end || text.compare(p, 7, "include") != 0) {
+                return false;
+            }
+            std::size_t open  = text.find('"', p + 7);
+            std::size_t close = open < end ? text.find('"', open + 1) : std::string::npos;
+            if (close >= end) {
+                return false;
+            }
+            header = text.substr(open + 1, close - open - 1);
+            return true;
+        }
+
+        std::vector<std::string>           packs_;
+        bool                               skipMissing_;
+        std::map<std::string, std::string> files_;
+        std::set<std::string>              skipped_;
+        std::string                        error_;
+    };
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_MATERIAL_HPP_INCLUDED) */
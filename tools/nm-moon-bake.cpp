@@ -0,0 +1,266 @@
+// -*- c++ -*-
+/* nm-moon-bake: Generate textures/environment/moon_phases.tga.
+ *
+ * The shader-generated moon never changes its surface, yet
+ * sun_moon.fragment used to evaluate simplex noise and a diffuse
+ * sphere for every pixel of its quad every frame. This program
+ * renders the moon with the very same formulas, once for each of the
+ * 8 phases, and lays them out in a 4x2 grid like the vanilla
+ * moon_phases texture so the shader only needs four texture
+ * fetches.
+ *
+ * Usage: nm-moon-bake [--size=N] [-o FILE]
+ *        nm-moon-bake [--size=N] --check
+ *
+ * N is the width and height of a single phase in pixels. The texture
+ * goes to the standard output (or FILE) as an uncompressed 32-bit
+ * TGA image.
+ *
+ * With --check, the program instead reconstructs the baked texture
+ * the way moonTexture() in sun_moon.fragment does, compares it with
+ * the procedural moon at 4x4 points per texel, and prints the maximum
+ * and RMS errors of each phase in 1/255 units. Each point finds its
+ * cell from the UV the quad of the moon would interpolate to it, as
+ * moonCell() does, so the whole disc has to come out of the right
+ * phase. It fails if any point finds a wrong cell, if the maximum
+ * exceeds 4/255, or if RMS exceeds 1/255. At the default size the
+ * rounding costs at most half a unit, and the rest comes from
+ * interpolating across the rim of the moon, which is about 8 texels
+ * wide. Point sampling the same texture would be off by tens of units
+ * at the rim.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "natural-mystic-noise.hpp"
+
+using namespace glsl;
+
+namespace {
+    /* These must match renderMoon() in sun_moon.fragment. */
+    const float moonRadius     = 0.11f;
+    const float moonSharpness  = 0.15f;
+    const vec3  moonBaseColor  = vec3(1.0f, 0.95f, 0.81f);
+    const vec2  moonResolution = vec2(0.06f);
+
+    /* And this must match MOON_EXTENT in sun_moon.fragment. A single
+     * phase covers [-MOON_EXTENT, MOON_EXTENT] in the model-local
+     * space. It has to be slightly larger than the radius so that
+     * the border of each cell is fully transparent. */
+    const float moonExtent     = 0.125f;
+
+    float diffuseSphere(vec2 pos, float radius, vec3 light) {
+        float sq = radius*radius - pos.x*pos.x - pos.y*pos.y;
+
+        if (sq < 0.0f) {
+            return 0.0f;
+        }
+        else {
+            float z      = sqrt(sq);
+            vec3  normal = normalize(vec3(pos, z));
+            return max(0.0f, dot(normal, light));
+        }
+    }
+
+    /* The brightness of the moon, without CURRENT_COLOR.a. */
+    float moonBrightness(vec2 pos, float phase) {
+        float pDistance = length(pos);
+
+        vec3  light      = vec3(sin(phase), 0.0f, -cos(phase));
+        float diffuse    = diffuseSphere(pos, moonRadius, light);
+        float brightness = smoothstep(0.2f, 0.8f, min(diffuse + 0.3f, 1.0f));
+
+        float tex = nm::simplexNoise(pos / moonResolution);
+        brightness *= 1.0f - clamp(tex, 0.0f, 1.0f) * 0.05f;
+
+        brightness *= 1.0f - smoothstep(moonRadius - moonRadius * moonSharpness, moonRadius, pDistance);
+
+        return clamp(brightness, 0.0f, 1.0f);
+    }
+
+    /* Same as moonCell() in sun_moon.fragment. */
+    vec2 moonCell(vec2 texUV) {
+        vec2 cell = floor(texUV * vec2(4.0f, 2.0f));
+        return vec2(std::min(cell.x, 3.0f), std::min(cell.y, 1.0f));
+    }
+
+    /* Same as moonPhase() in sun_moon.fragment. */
+    float moonPhase(int column, int row) {
+        return (column * 0.25f + row) * 3.14159f;
+    }
+
+    /* The color of the moon as a premultiplied RGBA. */
+    vec4 moonColor(vec2 pos, float phase) {
+        float b = moonBrightness(pos, phase);
+        return vec4(moonBaseColor * b, b);
+    }
+
+    unsigned char quantize(float x) {
+        return static_cast<unsigned char>(clamp(x, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    /* BGRA, top to bottom. */
+    std::vector<unsigned char> bake(int size) {
+        const int width  = size * 4;
+        const int height = size * 2;
+
+        std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 4);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int   column = x / size;
+                int   row    = y / size;
+                /* Sample at the center of each texel so that bilinear
+                 * filtering reconstructs the original function. */
+                vec2  st     = vec2((x % size + 0.5f) / size, (y % size + 0.5f) / size);
+                vec2  pos    = (st * 2.0f - 1.0f) * moonExtent;
+                vec4  c      = moonColor(pos, moonPhase(column, row));
+
+                unsigned char *px = &pixels[(static_cast<size_t>(y) * width + x) * 4];
+                px[0] = quantize(c.z);
+                px[1] = quantize(c.y);
+                px[2] = quantize(c.x);
+                px[3] = quantize(c.w);
+            }
+        }
+        return pixels;
+    }
+
+    /* Same as moonTexel() and moonTexture() in sun_moon.fragment,
+     * with the point filter. */
+    vec4 moonTexel(const std::vector<unsigned char> &pixels, int size,
+                   int column, int row, int x, int y) {
+        const unsigned char *px =
+            &pixels[(static_cast<size_t>(row * size + y) * size * 4 + column * size + x) * 4];
+        return vec4(px[2], px[1], px[0], px[3]) / 255.0f;
+    }
+
+    vec4 moonTexture(const std::vector<unsigned char> &pixels, int size,
+                     int column, int row, vec2 st) {
+        float n     = static_cast<float>(size);
+        vec2  texel = clamp(st * n - 0.5f, 0.0f, n - 1.0f);
+        int   x     = std::min(static_cast<int>(std::floor(texel.x)), size - 2);
+        int   y     = std::min(static_cast<int>(std::floor(texel.y)), size - 2);
+        vec2  f     = texel - vec2(x, y);
+        return mix(mix(moonTexel(pixels, size, column, row, x    , y    ),
+                       moonTexel(pixels, size, column, row, x + 1, y    ), f.x),
+                   mix(moonTexel(pixels, size, column, row, x    , y + 1),
+                       moonTexel(pixels, size, column, row, x + 1, y + 1), f.x),
+                   f.y);
+    }
+
+    int check(int size) {
+        const std::vector<unsigned char> pixels = bake(size);
+        const int   samples   = size * 4;
+        const float maxBudget = 4.0f;
+        const float rmsBudget = 1.0f;
+
+        bool ok = true;
+        for (int row = 0; row < 2; row++) {
+            for (int column = 0; column < 4; column++) {
+                float       phase     = moonPhase(column, row);
+                float       maxErr    = 0.0f;
+                double      sqErr     = 0.0;
+                std::size_t wrongCell = 0;
+
+                for (int y = 0; y < samples; y++) {
+                    for (int x = 0; x < samples; x++) {
+                        vec2 st    = vec2((x + 0.5f) / samples, (y + 0.5f) / samples);
+                        vec2 pos   = (st * 2.0f - 1.0f) * moonExtent;
+                        /* The quad spans exactly one cell of the
+                         * texture. */
+                        vec2 cell  = moonCell((vec2(column, row) + st) / vec2(4.0f, 2.0f));
+                        if (cell.x != column || cell.y != row) {
+                            wrongCell++;
+                        }
+                        vec4 baked = moonTexture(pixels, size,
+                                                 static_cast<int>(cell.x), static_cast<int>(cell.y), st);
+                        vec4 proc  = moonColor(pos, phase);
+                        vec4 diff  = abs(baked - proc) * 255.0f;
+
+                        maxErr = std::max({maxErr, diff.x, diff.y, diff.z, diff.w});
+                        sqErr += dot(diff, diff) / 4.0f;
+                    }
+                }
+
+                float rms  = static_cast<float>(std::sqrt(sqErr / (static_cast<double>(samples) * samples)));
+                bool  pass = wrongCell == 0 && maxErr <= maxBudget && rms <= rmsBudget;
+                std::printf("phase %d: max %.2f, rms %.3f, %zu points in a wrong cell: %s\n",
+                            row * 4 + column, maxErr, rms, wrongCell, pass ? "ok" : "FAIL");
+                ok = ok && pass;
+            }
+        }
+        return ok ? 0 : 1;
+    }
+
+    void usage(const char *prog) {
+        std::fprintf(stderr, "Usage: %s [--size=N] [-o FILE]\n"
+                             "       %s [--size=N] --check\n", prog, prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int         size   = 128;
+    const char *output = nullptr;
+    bool        doCheck = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--size=", 7) == 0) {
+            size = std::atoi(argv[i] + 7);
+            if (size < 8 || size > 1024) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strcmp(argv[i], "--check") == 0) {
+            doCheck = true;
+        }
+        else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else {
+            usage(argv[0]);
+        }
+    }
+
+    if (doCheck) {
+        return check(size);
+    }
+
+    const int width  = size * 4;
+    const int height = size * 2;
+    const std::vector<unsigned char> pixels = bake(size);
+
+    FILE *out = stdout;
+    if (output) {
+        out = std::fopen(output, "wb");
+        if (!out) {
+            std::perror(output);
+            return 1;
+        }
+    }
+
+    unsigned char header[18] = {0};
+    header[2]  = 2;  // Uncompressed true-color image.
+    header[12] = static_cast<unsigned char>(width  & 0xff);
+    header[13] = static_cast<unsigned char>(width  >> 8);
+    header[14] = static_cast<unsigned char>(height & 0xff);
+    header[15] = static_cast<unsigned char>(height >> 8);
+    header[16] = 32; // Bits per pixel.
+    header[17] = 8 | 0x20; // 8 bits of alpha, top-left origin.
+
+    if (std::fwrite(header, sizeof(header), 1, out) != 1 ||
+        std::fwrite(pixels.data(), pixels.size(), 1, out) != 1) {
+        std::perror(output ? output : "stdout");
+        return 1;
+    }
+    if (out != stdout && std::fclose(out) != 0) {
+        std::perror(output);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,1443 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_PIPELINE_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_PIPELINE_HPP_INCLUDED 1
+
+/* A small software rasterizer running C++ ports of renderchunk.vertex,
+ * renderchunk.fragment, and sky.fragment. It exists so that changes
+ * to the shaders can be checked against reference images and timed
+ * without a device. It is nowhere near the real thing in speed, but
+ * the relative cost of shader features is roughly preserved.
+ *
+ * The shaders below must be kept in sync with the originals. Things
+ * the originals select with the preprocessor are runtime parameters
+ * here: configuration items are in "config", and material defines
+ * are bits of a variant. MCPE40059 is always assumed, and neither
+ * SEASONS nor AS_ENTITY_RENDERER are supported.
+ *
+ * Fragments are shaded in 2x2 quads like GPUs do, with helper
+ * fragments outside of the triangle, so that dFdx() and dFdy() can be
+ * computed as "fine" derivatives. Quad-shared noise is emulated by
+ * evaluating it once per quad. The screen is rendered in tiles, which
+ * can be spread over threads to render large batches of images.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "glsl.hpp"
+#include "natural-mystic-cloud.hpp"
+#include "natural-mystic-color.hpp"
+#include "natural-mystic-fog.hpp"
+#include "natural-mystic-hacks.hpp"
+#include "natural-mystic-light.hpp"
+#include "natural-mystic-rain.hpp"
+#include "natural-mystic-terrain.hpp"
+#include "natural-mystic-water.hpp"
+#include "nm-scheduler.hpp"
+
+namespace nm {
+    using namespace glsl;
+
+    /* The octaves and bounds of an fBM noise, as given to
+     * --with-cloud-density-fbm and the like. */
+    struct fbm_params {
+        int   octaves;
+        float lowerBound, upperBound;
+    };
+
+    /* Runtime equivalent of natural-mystic-config.h. The defaults
+     * are the same as those of configure. */
+    struct config {
+        enum fog_type { FOG_NONE, FOG_LINEAR, FOG_EXP, FOG_EXP2 };
+
+        bool     fancyWater               = true;
+        bool     waves                    = true;
+        bool     occlusionShadows         = true;
+        bool     specular                 = true;
+        bool     ripples                  = true;
+        bool     cameraMovementMitigation = false;
+        bool     fbmClouds                = true;
+        bool     cloudShade               = true;
+        bool     bandLimitedNoise         = true;
+        bool     quadSharedNoise          = false;
+        bool     vertexLighting           = false;
+        bool     baseFog                  = true;
+        fog_type fogType                  = FOG_EXP2;
+        float    ripplesDistance          = 16.0f;
+        float    waveNormalDistance       = 96.0f;
+
+        fbm_params cloudDensityFBM = {6, 0.5f, 0.85f};
+        fbm_params cloudShadeFBM   = {3, 0.4f, 1.0f};
+
+        /* Apply an option in the form of the configure script, such
+         * as "--disable-waves" or "--with-fog-type=linear". Options
+         * that don't affect the ported shaders are accepted and
+         * ignored. Return false if the option is unknown or
+         * invalid. */
+        bool parse(const std::string &arg) {
+            static const struct {
+                const char *name;
+                bool config::*flag;
+            } flags[] = {
+                {"fancy-water",                &config::fancyWater},
+                {"waves",                      &config::waves},
+                {"occlusion-shadows",          &config::occlusionShadows},
+                {"specular",                   &config::specular},
+                {"ripples",                    &config::ripples},
+                {"camera-movement-mitigation", &config::cameraMovementMitigation},
+                {"fbm-clouds",                 &config::fbmClouds},
+                {"cloud-shade",                &config::cloudShade},
+                {"band-limited-noise",         &config::bandLimitedNoise},
+                {"quad-shared-noise",          &config::quadSharedNoise},
+                {"vertex-lighting",            &config::vertexLighting},
+                {"base-fog",                   &config::baseFog},
+            };
+            static const char *const ignored[] = {
+                "torch-flicker", "random-stars", "shader-sun-moon", "baked-moon",
+                "lightweight-entities",
+            };
+
+            bool        enable;
+            std::string name;
+            if (arg.compare(0, 9, "--enable-") == 0) {
+                enable = true;
+                name   = arg.substr(9);
+            }
+            else if (arg.compare(0, 10, "--disable-") == 0) {
+                enable = false;
+                name   = arg.substr(10);
+            }
+            else if (arg.compare(0, 7, "--with-") == 0) {
+                return parseWith(arg.substr(7));
+            }
+            else if (arg.compare(0, 10, "--without-") == 0) {
+                return parseWith(arg.substr(10) + "=no");
+            }
+            else {
+                return false;
+            }
+
+            std::string::size_type eq = name.find('=');
+            if (eq != std::string::npos) {
+                std::string value = name.substr(eq + 1);
+                name.erase(eq);
+                if (value == "no") {
+                    enable = false;
+                }
+                else if (value != "yes") {
+                    return false;
+                }
+            }
+
+            for (const auto &f: flags) {
+                if (name == f.name) {
+                    this->*f.flag = enable;
+                    return true;
+                }
+            }
+            for (const char *ign: ignored) {
+                if (name == ign) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        bool parseWith(const std::string &arg) {
+            std::string::size_type eq = arg.find('=');
+            std::string name  = arg.substr(0, eq);
+            std::string value = eq == std::string::npos ? "yes" : arg.substr(eq + 1);
+
+            if (name == "fog-type") {
+                if      (value == "no")                     fogType = FOG_NONE;
+                else if (value == "linear")                 fogType = FOG_LINEAR;
+                else if (value == "exp")                    fogType = FOG_EXP;
+                else if (value == "yes" || value == "exp2") fogType = FOG_EXP2;
+                else return false;
+                return true;
+            }
+            else if (name == "ripples-distance") {
+                return parseDistance(value, 16.0f, ripplesDistance);
+            }
+            else if (name == "wave-normal-distance") {
+                return parseDistance(value, 96.0f, waveNormalDistance);
+            }
+            else if (name == "cloud-density-fbm") {
+                return parseFBM(value, {6, 0.5f, 0.85f}, cloudDensityFBM);
+            }
+            else if (name == "cloud-shade-fbm") {
+                return parseFBM(value, {3, 0.4f, 1.0f}, cloudShadeFBM);
+            }
+            else {
+                return false;
+            }
+        }
+
+        static bool parseDistance(const std::string &value, float def, float &dist) {
+            if (value == "yes" || value.empty()) {
+                dist = def;
+            }
+            else if (value == "no") {
+                dist = 0.0f;
+            }
+            else if (value.find_first_not_of("0123456789") == std::string::npos) {
+                dist = static_cast<float>(std::atoi(value.c_str()));
+            }
+            else {
+                return false;
+            }
+            return true;
+        }
+
+        static bool parseFBM(const std::string &value, fbm_params def, fbm_params &params) {
+            if (value == "yes" || value.empty()) {
+                params = def;
+                return true;
+            }
+            fbm_params p;
+            char       rest;
+            if (std::sscanf(value.c_str(), "%d:%f:%f%c", &p.octaves, &p.lowerBound, &p.upperBound, &rest) != 3 ||
+                (p.octaves != 3 && p.octaves != 6) ||
+                !(0.0f <= p.lowerBound && p.lowerBound < p.upperBound && p.upperBound <= 1.0f)) {
+                return false;
+            }
+            params = p;
+            return true;
+        }
+    };
+
+    /* Material defines that the ported shaders care about. */
+    enum variant_bits : unsigned {
+        VARIANT_FOG        = 1u << 0,
+        VARIANT_UNDERWATER = 1u << 1,
+        VARIANT_BLEND      = 1u << 2,
+        VARIANT_ALPHA_TEST = 1u << 3,
+        VARIANT_ALWAYS_LIT = 1u << 4,
+        VARIANT_FANCY      = 1u << 5,
+        VARIANT_ALLOW_FADE = 1u << 6,
+    };
+
+    /* A vertex in the layout of the terrain vertex buffers, in the
+     * order of the attributes of renderchunk.vertex. This is a POD so
+     * that it can be written to and mapped from a file as is. */
+    struct terrain_vertex {
+        float position[3]; // POSITION, relative to the chunk origin.
+        float uv1[2];      // TEXCOORD_1: the torch and sunlight levels.
+        float color[4];    // COLOR
+        float uv0[2];      // TEXCOORD_0: the coordinates in the atlas.
+    };
+
+    /* Uniforms the ported shaders read. TEXTURE_1 is only ever read
+     * at two texels, so they are here too. */
+    struct uniforms {
+        vec4  FOG_COLOR;
+        vec2  FOG_CONTROL;
+        float RENDER_DISTANCE;
+        float FAR_CHUNKS_DISTANCE;
+        float RENDER_CHUNK_FOG_ALPHA;
+        float TOTAL_REAL_WORLD_TIME;
+        vec4  CURRENT_COLOR;
+        vec4  CHUNK_ORIGIN_AND_SCALE;
+        float lightmapDaylight; // TEXTURE_1 at (0, 1)
+        float lightmapAmbient;  // TEXTURE_1 at (0, 0)
+    };
+
+    /* A single draw call of renderchunk. It doesn't own the
+     * buffers. Every three indices form a triangle. */
+    struct draw {
+        unsigned              variant;
+        uniforms              u;
+        const terrain_vertex *vertices;
+        std::size_t           numVertices;
+        const std::uint32_t  *indices;
+        std::size_t           numIndices;
+    };
+
+    /* An RGBA texture sampled with the nearest filter and the repeat
+     * wrap mode. */
+    struct texture {
+        int               width  = 0;
+        int               height = 0;
+        std::vector<vec4> texels; // Top to bottom.
+
+        vec4 sample(vec2 uv) const {
+            int x = static_cast<int>(std::floor(uv.x * width))  % width;
+            int y = static_cast<int>(std::floor(uv.y * height)) % height;
+            if (x < 0) x += width;
+            if (y < 0) y += height;
+            return texels[static_cast<std::size_t>(y) * width + x];
+        }
+    };
+
+    /* A frame: opaque and alpha-tested draws first, then the sky,
+     * then blended draws, in the order they appear. */
+    struct frame {
+        uniforms          sky;
+        std::vector<draw> draws;
+        const texture    *atlas;
+    };
+
+    /* The camera sits at the origin, as everything in the game is
+     * already relative to the camera. It looks towards -z when the
+     * yaw is zero, and a positive pitch looks up. */
+    struct camera {
+        int   width, height;
+        vec3  right, up, forward;
+        float tanX, tanY;
+
+        camera(int width_, int height_, float yaw, float pitch, float fovY)
+            : width(width_), height(height_) {
+
+            forward = vec3(std::sin(yaw) * std::cos(pitch),
+                           std::sin(pitch),
+                           -std::cos(yaw) * std::cos(pitch));
+            right   = normalize(cross(forward, vec3(0.0f, 1.0f, 0.0f)));
+            up      = cross(right, forward);
+            tanY    = std::tan(fovY * 0.5f);
+            tanX    = tanY * width / height;
+        }
+
+        /* The equivalent of PROJ * (WORLDVIEW * worldPos). Only .x,
+         * .y, and .w are meaningful. */
+        vec4 project(vec3 worldPos) const {
+            return vec4(dot(worldPos, right) / tanX,
+                        dot(worldPos, up)    / tanY,
+                        0.0f,
+                        dot(worldPos, forward));
+        }
+
+        /* The direction of the ray passing through a point in the
+         * window coordinates, whose origin is at the bottom left. */
+        vec3 ray(float x, float y) const {
+            float ndcX = x / width  * 2.0f - 1.0f;
+            float ndcY = y / height * 2.0f - 1.0f;
+            return normalize(forward + right * (ndcX * tanX) + up * (ndcY * tanY));
+        }
+    };
+
+    /* A color buffer and a depth buffer, from bottom to top like GL
+     * window coordinates. The depth is stored as 1/w so 0.0 is the
+     * far plane. */
+    struct framebuffer {
+        int                width, height;
+        std::vector<vec4>  color;
+        std::vector<float> depth;
+
+        framebuffer(int width_, int height_)
+            : width(width_), height(height_),
+              color(static_cast<std::size_t>(width_) * height_),
+              depth(static_cast<std::size_t>(width_) * height_, 0.0f) {}
+    };
+
+    /* Quads. Lanes are indexed like quadIndex(): x + y * 2 where y
+     * grows upwards. */
+    template <typename T> inline T quadDFdx(const T v[4], int lane) {
+        int row = lane & 2;
+        return v[row + 1] - v[row];
+    }
+
+    template <typename T> inline T quadDFdy(const T v[4], int lane) {
+        int col = lane & 1;
+        return v[col + 2] - v[col];
+    }
+
+    template <typename T> inline T quadCentroid(const T v[4], int lane) {
+        float dirX = (lane & 1) ? -1.0f : 1.0f;
+        float dirY = (lane & 2) ? -1.0f : 1.0f;
+        return v[lane] + 0.5f * (dirX * quadDFdx(v, lane) + dirY * quadDFdy(v, lane));
+    }
+
+    template <typename T> inline T quadOffset(const T v[4], int lane) {
+        return v[lane] - quadCentroid(v, lane);
+    }
+
+    inline float quadFootprint(const vec3 pos[4], int lane) {
+        vec2 fw = abs(quadDFdx(pos, lane).xz()) + abs(quadDFdy(pos, lane).xz());
+        return max(fw.x, fw.y);
+    }
+
+    /* ------------------------------------------------------------
+     * renderchunk
+     * ------------------------------------------------------------ */
+
+    /* Varyings of renderchunk. Smooth ones come first, as the
+     * rasterizer interpolates them as an array of floats. Flat ones
+     * are taken from the provoking (last) vertex. */
+    struct terrain_varyings {
+        vec2  uv0, uv1;
+        vec4  color;
+        vec4  fogColor;
+        vec3  wPos;
+        float cameraDist;
+        vec3  vNormal;
+        float flickerFactor;
+        float desatFactor;
+        float waterPlane;
+        vec3  vAmbientColor, vDirLight, vUndirLight;
+
+        float clearWeather;
+        float waterFlag;
+        float vDaylight;
+    };
+    const int terrainSmoothFloats = offsetof(terrain_varyings, clearWeather) / sizeof(float);
+    const int terrainFlatFloats   = sizeof(terrain_varyings) / sizeof(float) - terrainSmoothFloats;
+
+    /* Port of renderchunk.vertex. Returns gl_Position. */
+    inline vec4 terrainVertex(
+        const config &cfg, unsigned variant, const uniforms &u, const camera &cam,
+        const terrain_vertex &in, terrain_varyings &out) {
+
+        const bool fog       = variant & VARIANT_FOG;
+        const vec3 POSITION  = vec3(in.position[0], in.position[1], in.position[2]);
+        const vec4 COLOR     = vec4(in.color[0], in.color[1], in.color[2], in.color[3]);
+        const vec2 TEXCOORD_0 = vec2(in.uv0[0], in.uv0[1]);
+        const vec2 TEXCOORD_1 = vec2(in.uv1[0], in.uv1[1]);
+        const float time     = u.TOTAL_REAL_WORLD_TIME;
+
+        vec3 worldPos = POSITION * u.CHUNK_ORIGIN_AND_SCALE.w + u.CHUNK_ORIGIN_AND_SCALE.xyz();
+        vec4 pos      = cam.project(worldPos);
+
+        out.uv0   = TEXCOORD_0;
+        out.uv1   = TEXCOORD_1;
+        out.color = COLOR;
+
+        if (cfg.cameraMovementMitigation) {
+            out.wPos = floor(u.CHUNK_ORIGIN_AND_SCALE.xyz() / 16.0f) * 16.0f + POSITION;
+        }
+        else {
+            out.wPos = worldPos;
+        }
+        out.vNormal       = vec3(0.0f);
+        out.flickerFactor = 1.0f; // Torch flickering isn't ported.
+
+        float cameraDepth = length(-worldPos);
+        out.cameraDist = cameraDepth / u.RENDER_DISTANCE;
+
+        out.desatFactor  = (variant & VARIANT_FANCY) ? exponentialFog(vec2(0.0f, 4.0f), out.cameraDist) : 0.0f;
+        out.clearWeather = fog ? isClearWeather(u.FOG_CONTROL) : 1.0f;
+
+        out.fogColor = vec4(0.0f);
+        if (fog) {
+            float len = out.cameraDist;
+            if (variant & VARIANT_ALLOW_FADE) {
+                len += u.RENDER_CHUNK_FOG_ALPHA;
+            }
+            out.fogColor = vec4(u.FOG_COLOR.rgb(), 0.0f);
+            switch (cfg.fogType) {
+            case config::FOG_LINEAR: out.fogColor.w = linearFog(u.FOG_CONTROL, len);             break;
+            case config::FOG_EXP:    out.fogColor.w = exponentialFog(u.FOG_CONTROL, len);        break;
+            case config::FOG_EXP2:   out.fogColor.w = exponentialSquaredFog(u.FOG_CONTROL, len); break;
+            case config::FOG_NONE:   break;
+            }
+        }
+
+        vec3 hsvColor = rgb2hsv(COLOR.rgb());
+        out.waterFlag  = cfg.fancyWater && isWater(hsvColor) ? 1.0f : 0.0f;
+        out.waterPlane = 0.0f;
+        if (cfg.waves) {
+            bool grassFlag = (variant & VARIANT_ALPHA_TEST) && isGrass(hsvColor);
+            if (grassFlag) {
+                vec3  posw      = abs(POSITION - 8.0f);
+                float wave      = std::sin(time * 3.5f + 2.0f * posw.x + 2.0f * posw.z + posw.y);
+                float amplitude = 0.015f;
+                pos.x += wave * amplitude * smoothstep(0.7f, 1.0f, TEXCOORD_1.y);
+            }
+            else if (out.waterFlag > 0.5f) {
+                float volume = fract(POSITION.y);
+                if (volume > 0.0f) {
+                    vec3 wPos1     = waterWaveGeometric(out.wPos, time, out.vNormal);
+                    vec3 wPosDelta = (wPos1 - out.wPos) * volume;
+                    worldPos += wPosDelta * smoothstep(0.5f, 1.0f, TEXCOORD_1.y);
+                    out.wPos  = worldPos;
+                    pos       = cam.project(worldPos);
+                }
+
+                if (variant & VARIANT_FANCY) {
+                    if (isWaterPlane(vec4(POSITION, 1.0f))) {
+                        out.waterPlane = 1.0f;
+                    }
+                    out.color.w *= 0.5f;
+                }
+            }
+        }
+
+        out.vDaylight     = 0.0f;
+        out.vAmbientColor = out.vDirLight = out.vUndirLight = vec3(0.0f);
+        if (cfg.vertexLighting) {
+            out.vDaylight = terrainDaylight(u.lightmapDaylight);
+            float ambientBrightness = terrainAmbientBrightness(u.lightmapAmbient);
+            vec4  lightFogColor     = fog ? out.fogColor : vec4(0.0f);
+            terrainLight(fog, variant & VARIANT_UNDERWATER, u.FOG_CONTROL,
+                         TEXCOORD_1, out.vDaylight, ambientBrightness, lightFogColor,
+                         out.clearWeather, out.flickerFactor, variant & VARIANT_ALWAYS_LIT,
+                         out.vAmbientColor, out.vDirLight, out.vUndirLight);
+            if (out.waterFlag < 0.5f) {
+                out.vDirLight = occlusionShadow(cfg.occlusionShadows, out.vDirLight, occlusionFactor(COLOR.rgb()));
+            }
+        }
+
+        if (variant & VARIANT_BLEND) {
+            bool shouldBecomeOpaqueInTheDistance = out.color.w < 0.95f;
+            if (shouldBecomeOpaqueInTheDistance) {
+                if (!(variant & VARIANT_FANCY)) {
+                    out.color.w = 1.0f;
+                }
+                float cameraDist   = cameraDepth / u.FAR_CHUNKS_DISTANCE;
+                float alphaFadeOut = clamp(cameraDist, 0.0f, 1.0f);
+                out.color.w = mix(out.color.w, 1.0f, alphaFadeOut);
+            }
+        }
+
+        if (!fog) {
+            vec3 rgb = out.color.rgb() + u.FOG_COLOR.rgb() * 0.000001f;
+            out.color = vec4(rgb, out.color.w);
+        }
+
+        return pos;
+    }
+
+    /* Port of renderchunk.vertex with BYPASS_PIXEL_SHADER, which the
+     * game uses for depth-only passes. It has no varyings, so it
+     * keeps wPos, vNormal, and waterFlag as locals and reads
+     * TEXCOORD_1 where the full path reads uv1. Returns gl_Position,
+     * which must be bit-for-bit the same as that of terrainVertex()
+     * or the depth won't match. */
+    inline vec4 terrainVertexDepthOnly(
+        const config &cfg, unsigned variant, const uniforms &u, const camera &cam,
+        const terrain_vertex &in) {
+
+        const vec3 POSITION   = vec3(in.position[0], in.position[1], in.position[2]);
+        const vec4 COLOR      = vec4(in.color[0], in.color[1], in.color[2], in.color[3]);
+        const vec2 TEXCOORD_1 = vec2(in.uv1[0], in.uv1[1]);
+        const float time      = u.TOTAL_REAL_WORLD_TIME;
+
+        vec3 wPos, vNormal;
+        float waterFlag;
+
+        vec3 worldPos = POSITION * u.CHUNK_ORIGIN_AND_SCALE.w + u.CHUNK_ORIGIN_AND_SCALE.xyz();
+        vec4 pos      = cam.project(worldPos);
+
+        if (cfg.cameraMovementMitigation) {
+            wPos = floor(u.CHUNK_ORIGIN_AND_SCALE.xyz() / 16.0f) * 16.0f + POSITION;
+        }
+        else {
+            wPos = worldPos;
+        }
+        vNormal = vec3(0.0f);
+
+        vec3 hsvColor = rgb2hsv(COLOR.rgb());
+        waterFlag = cfg.fancyWater && isWater(hsvColor) ? 1.0f : 0.0f;
+        if (cfg.waves) {
+            bool grassFlag = (variant & VARIANT_ALPHA_TEST) && isGrass(hsvColor);
+            if (grassFlag) {
+                vec3  posw      = abs(POSITION - 8.0f);
+                float wave      = std::sin(time * 3.5f + 2.0f * posw.x + 2.0f * posw.z + posw.y);
+                float amplitude = 0.015f;
+                pos.x += wave * amplitude * smoothstep(0.7f, 1.0f, TEXCOORD_1.y);
+            }
+            else if (waterFlag > 0.5f) {
+                float volume = fract(POSITION.y);
+                if (volume > 0.0f) {
+                    vec3 wPos1     = waterWaveGeometric(wPos, time, vNormal);
+                    vec3 wPosDelta = (wPos1 - wPos) * volume;
+                    worldPos += wPosDelta * smoothstep(0.5f, 1.0f, TEXCOORD_1.y);
+                    wPos      = worldPos;
+                    pos       = cam.project(worldPos);
+                }
+            }
+        }
+
+        return pos;
+    }
+
+    /* Effects that are cut off at a fixed distance from the camera,
+     * as bits. A wet lane within RIPPLES_DISTANCE counts as having
+     * computed ripples even if ripples() then bails out because of
+     * the slope or the footprint, as neither depends on the
+     * distance. */
+    enum terrain_effect {
+        EFFECT_RIPPLES     = 1u << 0,
+        EFFECT_WAVE_NORMAL = 1u << 1
+    };
+
+    /* Port of renderchunk.fragment for a whole quad. "discarded"
+     * tells which lanes have executed discard, and "effects" which of
+     * terrain_effect they have computed. */
+    inline void terrainFragmentQuad(
+        const config &cfg, unsigned variant, const uniforms &u, const texture &atlas,
+        const terrain_varyings in[4], vec4 out[4], bool discarded[4], unsigned effects[4]) {
+
+        const bool  fog        = variant & VARIANT_FOG;
+        const bool  underwater = variant & VARIANT_UNDERWATER;
+        const bool  alphaTest  = variant & VARIANT_ALPHA_TEST;
+        const bool  blend      = variant & VARIANT_BLEND;
+        const float time       = u.TOTAL_REAL_WORLD_TIME;
+
+        vec3 wPos[4];
+        for (int lane = 0; lane < 4; lane++) {
+            wPos[lane] = in[lane].wPos;
+        }
+
+        /* Things needed to emulate quad-shared noise. Flat varyings
+         * are the same for every lane of a quad. */
+        const bool quadShared = cfg.quadSharedNoise && !alphaTest && cfg.waves && in[0].waterFlag > 0.5f;
+        bool       quadPerturb = false;
+        bool       quadPerPixel = false;
+        vec3       quadWaveDelta, quadWaveDeltaX, quadWaveDeltaZ;
+        if (quadShared) {
+            for (int lane = 0; lane < 4; lane++) {
+                quadPerturb = quadPerturb || in[lane].cameraDist * u.RENDER_DISTANCE < cfg.waveNormalDistance;
+            }
+            if (quadPerturb) {
+                /* Port of waterWaveNormalQuad(). */
+                const float Q        = 0.45f;
+                const float numWaves = 3.0f;
+                const float Ai[3]    = {0.0058f, 0.0058f, 0.0045f};
+                const float deg[3]   = {85.0f, 255.0f, 65.0f};
+                const float Li[3]    = {0.75f, 0.725f, 0.7f};
+                const float Si[3]    = {1.0f, 2.0f, 2.0f};
+                for (int lane = 0; lane < 3; lane++) {
+                    const float wFactor = 9.80665f * 2.0f * 3.14159f;
+                    vec2  Di    = deg2dir(deg[lane]);
+                    float wi    = std::sqrt(wFactor / Li[lane]);
+                    float Qi    = Q / (wi * Ai[lane] * numWaves);
+                    float phi_i = Si[lane] * 2.0f / Li[lane];
+
+                    vec3  wPosc = quadCentroid(wPos, lane);
+                    float theta = wi * dot(Di, wPosc.xz()) + phi_i * time;
+                    float wiAi  = wi * Ai[lane];
+                    float cycles = wi * (std::fabs(dot(Di, quadDFdx(wPos, lane).xz())) +
+                                         std::fabs(dot(Di, quadDFdy(wPos, lane).xz()))) / (2.0f * 3.14159f);
+                    float fade   = nyquistFade(cycles);
+                    quadPerPixel = quadPerPixel || fade <= 0.0f;
+                    vec3  dDelta = (wiAi * fade) *
+                        vec3(Di.x * std::sin(theta), -Qi * std::cos(theta), Di.y * std::sin(theta));
+                    quadWaveDelta  -= wiAi * vec3(Di.x * std::cos(theta), Qi * std::sin(theta), Di.y * std::cos(theta));
+                    quadWaveDeltaX += dDelta * (wi * Di.x);
+                    quadWaveDeltaZ += dDelta * (wi * Di.y);
+                }
+            }
+        }
+
+        /* Port of rippleNoiseQuad(), for quads where any lane may
+         * need it. */
+        bool  quadRipples = false;
+        float quadRippleNoise[4];
+        if (cfg.quadSharedNoise && !alphaTest && cfg.ripples) {
+            for (int lane = 0; lane < 4; lane++) {
+                quadRipples = quadRipples ||
+                    (wetness(in[lane].clearWeather, in[lane].uv1.y) > 0.0f &&
+                     in[lane].cameraDist * u.RENDER_DISTANCE < cfg.ripplesDistance);
+            }
+            if (quadRipples) {
+                vec2 st[4], stc[4], offset[4], gen, weight;
+                for (int lane = 0; lane < 4; lane++) {
+                    st[lane] = rippleCoords(wPos[lane]);
+                }
+                for (int lane = 0; lane < 4; lane++) {
+                    stc[lane]    = quadCentroid(st, lane);
+                    offset[lane] = quadOffset(st, lane);
+                }
+                rippleLayers(time, gen, weight);
+                rippleNoiseQuad(stc, offset, gen, weight, quadRippleNoise);
+            }
+        }
+
+        for (int lane = 0; lane < 4; lane++) {
+            const terrain_varyings &v = in[lane];
+
+            vec4 diffuse = atlas.sample(v.uv0);
+
+            discarded[lane] = false;
+            effects[lane]   = 0;
+            if (alphaTest && diffuse.w < 0.5f) {
+                discarded[lane] = true;
+            }
+
+            vec4 inColor = v.color;
+            if (blend) {
+                diffuse.w *= inColor.w;
+            }
+            if (!alphaTest && !blend) {
+                diffuse.w = inColor.w;
+            }
+            vec3  rgb       = diffuse.rgb() * inColor.rgb();
+            float occlusion = occlusionFactor(inColor.rgb());
+
+            vec3 pigment = rgb;
+
+            float daylight;
+            vec3  ambientColor, dirLight, undirLight;
+            if (cfg.vertexLighting) {
+                daylight     = v.vDaylight;
+                ambientColor = v.vAmbientColor;
+                dirLight     = v.vDirLight;
+                undirLight   = v.vUndirLight;
+            }
+            else {
+                daylight = terrainDaylight(u.lightmapDaylight);
+                float ambientBrightness = terrainAmbientBrightness(u.lightmapAmbient);
+                vec4  lightFogColor     = fog ? v.fogColor : vec4(0.0f);
+                terrainLight(fog, underwater, u.FOG_CONTROL,
+                             v.uv1, daylight, ambientBrightness, lightFogColor,
+                             v.clearWeather, v.flickerFactor, variant & VARIANT_ALWAYS_LIT,
+                             ambientColor, dirLight, undirLight);
+            }
+
+            vec3  sNormal   = normalize(cross(quadDFdx(wPos, lane), quadDFdy(wPos, lane)));
+            float wet       = wetness(v.clearWeather, v.uv1.y);
+            float footprint = cfg.bandLimitedNoise ? quadFootprint(wPos, lane) : 0.0f;
+
+            float cameraDepth = v.cameraDist * u.RENDER_DISTANCE;
+            if (v.waterFlag > 0.5f) {
+                vec3 fNormal = normalize(mix(sNormal, v.vNormal, v.waterPlane));
+
+                if (cfg.waves) {
+                    const float distThreshold = cfg.waveNormalDistance;
+                    const float distFadeStart = distThreshold * 0.8f;
+                    bool perturb = quadShared ? quadPerturb : cameraDepth < distThreshold;
+                    if (perturb) {
+                        effects[lane] |= EFFECT_WAVE_NORMAL;
+                        vec3 perturbed = quadShared && !quadPerPixel
+                            ? fNormal + quadWaveDelta
+                                      + quadWaveDeltaX * quadOffset(wPos, lane).x
+                                      + quadWaveDeltaZ * quadOffset(wPos, lane).z
+                            : waterWaveNormal(v.wPos, time, fNormal);
+                        perturbed = mix(perturbed, fNormal,
+                                        smoothstep(distFadeStart, distThreshold, cameraDepth));
+                        perturbed = mix(sNormal, perturbed, smoothstep(0.5f, 1.0f, v.uv1.y));
+                        fNormal = normalize(perturbed);
+                    }
+                }
+
+                rgb  = pigment * (dirLight + undirLight);
+                rgb *= 0.5f;
+
+                if (cfg.specular) {
+                    vec4 specular = waterSpecularLight(diffuse.w, dirLight, undirLight, v.wPos, time, fNormal);
+                    rgb      += specular.rgb();
+                    diffuse.w = specular.w;
+                }
+
+                if (cfg.ripples) {
+                    if (wet > 0.0f && cameraDepth < cfg.ripplesDistance) {
+                        effects[lane] |= EFFECT_RIPPLES;
+                    }
+                    rgb += ripples(cfg.ripplesDistance, wet, dirLight + undirLight, v.wPos, cameraDepth, time, fNormal, footprint,
+                                   quadRipples ? &quadRippleNoise[lane] : nullptr);
+                }
+            }
+            else {
+                if (!cfg.vertexLighting) {
+                    dirLight = occlusionShadow(cfg.occlusionShadows, dirLight, occlusion);
+                }
+
+                rgb  = pigment * (dirLight + undirLight);
+                rgb *= mix(1.0f, 0.5f, wet);
+
+                if (cfg.specular) {
+                    const float fresnel   = 0.04f;
+                    const float shininess = 2.0f;
+                    vec3 specular = specularLight(fresnel, shininess, dirLight, undirLight, v.wPos, sNormal);
+
+                    rgb *= 1.0f - fresnel;
+                    rgb += specular * mix(1.0f, 5.0f, wet);
+                }
+
+                if (cfg.ripples) {
+                    if (wet > 0.0f && cameraDepth < cfg.ripplesDistance) {
+                        effects[lane] |= EFFECT_RIPPLES;
+                    }
+                    rgb += ripples(cfg.ripplesDistance, wet, dirLight + undirLight, v.wPos, cameraDepth, time, sNormal, footprint,
+                                   quadRipples ? &quadRippleNoise[lane] : nullptr);
+                }
+            }
+
+            rgb = uncharted2ToneMap(rgb, 112.0f, 1.0f);
+            rgb = contrastFilter(rgb, 1.25f);
+
+            if (cfg.baseFog) {
+                const float contrast   = 0.45f;
+                const float fogDensity = 0.4f;
+                rgb = mix(
+                    rgb,
+                    mix(contrastFilter(rgb, contrast) * ambientColor,
+                        fogBrightness(v.uv1.x, v.uv1.y, daylight) * ambientColor,
+                        fogDensity),
+                    v.desatFactor);
+            }
+
+            if (fog) {
+                if (underwater || isRenderDistanceFog(u.FOG_CONTROL)) {
+                    rgb = mix(rgb, v.fogColor.rgb(), v.fogColor.w);
+                }
+                else {
+                    rgb = mix(
+                        desaturate(rgb, v.fogColor.w) * ambientColor,
+                        v.fogColor.rgb(),
+                        v.fogColor.w);
+                }
+            }
+
+            out[lane] = vec4(rgb, diffuse.w);
+        }
+    }
+
+    /* ------------------------------------------------------------
+     * sky
+     * ------------------------------------------------------------ */
+
+    /* The sky plane is a disc of radius 1 at this height above the
+     * camera. Its vertex color is 0.0 at the center and 1.0 on the
+     * rim. */
+    const float skyPlaneHeight = 0.2f;
+
+    struct sky_varyings {
+        vec4  skyColor;
+        vec4  cloudColor;
+        vec3  worldPos;
+        float camDist;
+    };
+
+    /* Port of sky.vertex, evaluated at a point on the sky plane. The
+     * outputs of the original are all affine in COLOR.r so this is
+     * exactly what the rasterizer would interpolate. */
+    inline void skyVertex(const uniforms &u, vec3 position, float colorR, sky_varyings &out) {
+        out.skyColor = mix(u.CURRENT_COLOR, u.FOG_COLOR, colorR);
+        out.worldPos = position;
+        out.camDist  = length(position);
+
+        float brightness = clamp(desaturate(u.FOG_COLOR.rgb(), 1.0f).x + 0.05f, 0.105f, 1.0f);
+        out.cloudColor = mix(out.skyColor, u.FOG_COLOR, 0.9f);
+        out.cloudColor = mix(out.cloudColor, vec4(1.0f), brightness);
+        out.cloudColor = vec4(desaturate(out.cloudColor.rgb(), 0.4f), out.cloudColor.w);
+    }
+
+    /* Port of sky.fragment for a whole quad. */
+    inline void skyFragmentQuad(const config &cfg, const uniforms &u, const sky_varyings in[4], vec4 out[4]) {
+        if (!cfg.fbmClouds) {
+            for (int lane = 0; lane < 4; lane++) {
+                out[lane] = in[lane].skyColor;
+            }
+            return;
+        }
+
+        const float time = u.TOTAL_REAL_WORLD_TIME;
+
+        vec3  worldPos[4];
+        float footprint[4];
+        for (int lane = 0; lane < 4; lane++) {
+            worldPos[lane] = in[lane].worldPos;
+        }
+        for (int lane = 0; lane < 4; lane++) {
+            footprint[lane] = cfg.bandLimitedNoise ? quadFootprint(worldPos, lane) : 0.0f;
+        }
+
+        /* Evaluate a cloud map into "value" at the lanes where
+         * "active" is true, or all of them if it's null. In quad-shared mode the lanes
+         * are evaluated together, and "active" is uniform. */
+        auto cloudMap = [&](const fbm_params &p, const vec3 pos[4], const bool *active, float value[4]) {
+            if (cfg.quadSharedNoise) {
+                if (!active || active[0]) {
+                    vec3 posc[4];
+                    for (int l = 0; l < 4; l++) {
+                        posc[l] = quadCentroid(pos, l);
+                    }
+                    cloudMapQuad(p.octaves, p.lowerBound, p.upperBound, time, pos, posc, footprint, value);
+                }
+                return;
+            }
+            for (int lane = 0; lane < 4; lane++) {
+                if (active && !active[lane]) {
+                    continue;
+                }
+                else if (cfg.bandLimitedNoise) {
+                    value[lane] = p.octaves == 6
+                        ? cloudMapFiltered6(p.lowerBound, p.upperBound, time, pos[lane], footprint[lane])
+                        : cloudMapFiltered3(p.lowerBound, p.upperBound, time, pos[lane], footprint[lane]);
+                }
+                else {
+                    value[lane] = p.octaves == 6
+                        ? cloudMap6(p.lowerBound, p.upperBound, time, pos[lane])
+                        : cloudMap3(p.lowerBound, p.upperBound, time, pos[lane]);
+                }
+            }
+        };
+
+        float density[4];
+        cloudMap(cfg.cloudDensityFBM, worldPos, nullptr, density);
+
+        bool hasClouds[4];
+        for (int lane = 0; lane < 4; lane++) {
+            hasClouds[lane] = density[lane] > 0.0f;
+        }
+        if (cfg.quadSharedNoise) {
+            bool any = hasClouds[0] || hasClouds[1] || hasClouds[2] || hasClouds[3];
+            for (int lane = 0; lane < 4; lane++) {
+                hasClouds[lane] = any;
+            }
+        }
+
+        float height[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        vec3  rayPos[4];
+        if (cfg.cloudShade) {
+            const vec3  sunMoonPos = vec3(-0.3f, 4.0f, 0.0f);
+            const float stepSize   = 0.2f;
+            for (int lane = 0; lane < 4; lane++) {
+                rayPos[lane] = worldPos[lane] + normalize(sunMoonPos - worldPos[lane]) * stepSize;
+            }
+            cloudMap(cfg.cloudShadeFBM, rayPos, hasClouds, height);
+        }
+
+        for (int lane = 0; lane < 4; lane++) {
+            const sky_varyings &v = in[lane];
+            vec4 shadedCloud = mix(vec4(v.cloudColor.rgb(), 0.0f), v.cloudColor, density[lane]);
+
+            if (cfg.cloudShade && hasClouds[lane]) {
+                float inside     = max(0.0f, height[lane] - (rayPos[lane].y - worldPos[lane].y));
+                float brightness = v.cloudColor.x;
+                vec3  shaded     = mix(
+                    shadedCloud.rgb() + 0.1f * brightness,
+                    max(shadedCloud.rgb() - 0.2f * brightness, 0.0f),
+                    inside);
+                shadedCloud = vec4(shaded, shadedCloud.w);
+            }
+            shadedCloud = vec4(mix(v.skyColor.rgb(), shadedCloud.rgb(), shadedCloud.w), shadedCloud.w);
+
+            out[lane] = mix(shadedCloud, v.skyColor, smoothstep(0.9f, 1.0f, v.camDist));
+        }
+    }
+
+    /* ------------------------------------------------------------
+     * The rasterizer
+     * ------------------------------------------------------------ */
+
+    /* Time spent in each stage, in seconds. With several threads,
+     * these are sums over all of them rather than the wall-clock
+     * time. */
+    struct stage_timings {
+        double vertex  = 0.0;
+        double setup   = 0.0; // Clipping and binning triangles.
+        double terrain = 0.0; // Rasterization and renderchunk.fragment.
+        double sky     = 0.0;
+
+        /* Not timings, but the number of visible fragments that
+         * computed each of terrain_effect. Unlike the timings, they
+         * don't depend on the number of threads. */
+        std::size_t ripples     = 0;
+        std::size_t waveNormals = 0;
+
+        double total() const { return vertex + setup + terrain + sky; }
+
+        stage_timings &operator+=(const stage_timings &t) {
+            vertex += t.vertex; setup += t.setup; terrain += t.terrain; sky += t.sky;
+            ripples += t.ripples; waveNormals += t.waveNormals;
+            return *this;
+        }
+    };
+
+    /* The screen is divided into tiles, and each tile goes through
+     * the opaque pass, the sky, and the blended pass on its own. Tiles
+     * are rendered in parallel, but the image doesn't depend on the
+     * number of threads as no pixel is touched by two tiles. */
+    class renderer {
+    public:
+        /* "threads" is the number of threads to render with, or 0
+         * for one per core. */
+        renderer(const config &cfg, const camera &cam, unsigned threads = 1)
+            : cfg_(cfg), cam_(cam), sched_(threads) {}
+
+        unsigned threads() const { return sched_.threads(); }
+
+        /* Render a frame into "fb", which is cleared first. If
+         * "perDraw" is given, it receives the time spent in each of
+         * the draws of the frame. */
+        stage_timings render(const frame &f, framebuffer &fb,
+                             std::vector<stage_timings> *perDraw = nullptr) const;
+
+    private:
+        /* Must be even so that no quad straddles two tiles. */
+        enum { tileSize = 32 };
+
+        struct clip_vertex {
+            vec4             pos;
+            terrain_varyings v;
+        };
+
+        /* A triangle after clipping, as indices of
+         * draw_state::vertices. Flat varyings are taken from
+         * "provoking". It may cover tiles [tx0, tx1] x [ty0, ty1]. */
+        struct clipped_triangle {
+            std::uint32_t v[3];
+            std::uint32_t provoking;
+            int           tx0, ty0, tx1, ty1;
+        };
+
+        /* A draw after the vertex shader and clipping. Vertices made
+         * by clipping are appended to the shaded ones. */
+        struct draw_state {
+            std::vector<clip_vertex>      vertices;
+            std::vector<clipped_triangle> triangles;
+        };
+
+        /* Triangles touching a tile in the order they are drawn, as
+         * pairs of indices of a draw and of its triangle. */
+        struct tile_bin {
+            std::vector<std::pair<std::uint32_t, std::uint32_t>> opaque, blend;
+        };
+
+        /* Pixels [x0, x1) x [y0, y1). */
+        struct rect {
+            int x0, y0, x1, y1;
+        };
+
+        /* Quads of a triangle that passed the early depth test, as
+         * structure of arrays. Coverage and depth are computed for a
+         * whole batch before any of it is shaded. */
+        struct quad_batch {
+            enum { capacity = 64 };
+            int   count = 0;
+            int   qx[capacity], qy[capacity];
+            bool  covered[4][capacity];
+            float b[3][4][capacity]; // Barycentric coordinates of each lane.
+            float depth[4][capacity];
+        };
+
+        void prepare(const draw &d, const framebuffer &fb, draw_state &s, stage_timings &t) const;
+        void drawTile(const frame &f, const std::vector<draw_state> &states, const tile_bin &bin,
+                      rect r, framebuffer &fb, stage_timings &t, std::vector<stage_timings> &perDraw) const;
+        void rasterize(const draw &d, const texture &atlas, const draw_state &s,
+                       const clipped_triangle &tri, rect r, framebuffer &fb, stage_timings &t) const;
+        void shade(const draw &d, const texture &atlas, const float attr[3][terrainSmoothFloats],
+                   const float flat[], const quad_batch &batch, framebuffer &fb, stage_timings &t) const;
+        void drawSky(const uniforms &u, rect r, framebuffer &fb) const;
+
+        const config &cfg_;
+        const camera &cam_;
+        scheduler     sched_;
+    };
+
+    namespace detail {
+        inline double seconds() {
+            return std::chrono::duration<double>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        const float nearPlane = 0.05f;
+
+        /* Clip a polygon against w >= nearPlane. */
+        template <typename V>
+        inline int clipNear(const V *in, int n, V *out) {
+            int m = 0;
+            for (int i = 0; i < n; i++) {
+                const V &a = in[i];
+                const V &b = in[(i + 1) % n];
+                bool aIn = a.pos.w >= nearPlane;
+                bool bIn = b.pos.w >= nearPlane;
+                if (aIn) {
+                    out[m++] = a;
+                }
+                if (aIn != bIn) {
+                    float t = (nearPlane - a.pos.w) / (b.pos.w - a.pos.w);
+                    V c;
+                    c.pos = mix(a.pos, b.pos, t);
+                    const float *fa = reinterpret_cast<const float *>(&a.v);
+                    const float *fb = reinterpret_cast<const float *>(&b.v);
+                    float       *fc = reinterpret_cast<float *>(&c.v);
+                    for (std::size_t k = 0; k < sizeof(a.v) / sizeof(float); k++) {
+                        fc[k] = mix(fa[k], fb[k], t);
+                    }
+                    out[m++] = c;
+                }
+            }
+            return m;
+        }
+
+        /* Window coordinates and 1/w of a clip-space position. */
+        inline void windowCoords(vec4 pos, int width, int height, float &x, float &y, float &invW) {
+            invW = 1.0f / pos.w;
+            x    = (pos.x * invW * 0.5f + 0.5f) * width;
+            y    = (pos.y * invW * 0.5f + 0.5f) * height;
+        }
+
+        /* The signed area of a triangle in window coordinates, and
+         * the pixels that may be covered by it. Return false if it
+         * covers nothing. */
+        inline bool triangleBounds(const float x[3], const float y[3], int width, int height,
+                                   float &area, int &minX, int &minY, int &maxX, int &maxY) {
+            area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+            if (std::abs(area) < 1e-8f) {
+                return false;
+            }
+            minX = std::max(0,          static_cast<int>(std::floor(std::min({x[0], x[1], x[2]}))));
+            maxX = std::min(width - 1,  static_cast<int>(std::ceil (std::max({x[0], x[1], x[2]}))));
+            minY = std::max(0,          static_cast<int>(std::floor(std::min({y[0], y[1], y[2]}))));
+            maxY = std::min(height - 1, static_cast<int>(std::ceil (std::max({y[0], y[1], y[2]}))));
+            return minX <= maxX && minY <= maxY;
+        }
+    }
+
+    inline stage_timings renderer::render(const frame &f, framebuffer &fb,
+                                          std::vector<stage_timings> *perDraw) const {
+        const std::size_t numDraws   = f.draws.size();
+        const unsigned    numThreads = sched_.threads();
+
+        /* Each thread has its own timings, so that they don't have
+         * to be synchronized. */
+        std::vector<stage_timings>              threadT(numThreads);
+        std::vector<std::vector<stage_timings>> threadDrawT(
+            numThreads, std::vector<stage_timings>(numDraws));
+
+        std::vector<draw_state> states(numDraws);
+        sched_.parallelFor(numDraws, [&](std::size_t i, unsigned worker) {
+            prepare(f.draws[i], fb, states[i], threadDrawT[worker][i]);
+        });
+
+        /* Binning is serial so that each bin lists triangles in the
+         * order of draws. */
+        double start = detail::seconds();
+        const int tilesX = (fb.width  + tileSize - 1) / tileSize;
+        const int tilesY = (fb.height + tileSize - 1) / tileSize;
+        std::vector<tile_bin> bins(static_cast<std::size_t>(tilesX) * tilesY);
+        for (std::size_t i = 0; i < numDraws; i++) {
+            const bool blend = f.draws[i].variant & VARIANT_BLEND;
+            const std::vector<clipped_triangle> &tris = states[i].triangles;
+            for (std::size_t k = 0; k < tris.size(); k++) {
+                for (int ty = tris[k].ty0; ty <= tris[k].ty1; ty++) {
+                    for (int tx = tris[k].tx0; tx <= tris[k].tx1; tx++) {
+                        tile_bin &bin = bins[static_cast<std::size_t>(ty) * tilesX + tx];
+                        (blend ? bin.blend : bin.opaque).emplace_back(
+                            static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(k));
+                    }
+                }
+            }
+        }
+        threadT[0].setup += detail::seconds() - start;
+
+        sched_.parallelFor(bins.size(), [&](std::size_t k, unsigned worker) {
+            int  tx = static_cast<int>(k % tilesX);
+            int  ty = static_cast<int>(k / tilesX);
+            rect r  = {tx * tileSize, ty * tileSize,
+                       std::min(fb.width,  (tx + 1) * tileSize),
+                       std::min(fb.height, (ty + 1) * tileSize)};
+            drawTile(f, states, bins[k], r, fb, threadT[worker], threadDrawT[worker]);
+        });
+
+        stage_timings t;
+        if (perDraw) {
+            perDraw->assign(numDraws, stage_timings());
+        }
+        for (unsigned w = 0; w < numThreads; w++) {
+            t += threadT[w];
+            for (std::size_t i = 0; i < numDraws; i++) {
+                t += threadDrawT[w][i];
+                if (perDraw) {
+                    (*perDraw)[i] += threadDrawT[w][i];
+                }
+            }
+        }
+        return t;
+    }
+
+    inline void renderer::prepare(const draw &d, const framebuffer &fb, draw_state &s, stage_timings &t) const {
+        double start = detail::seconds();
+
+        s.vertices.resize(d.numVertices);
+        for (std::size_t i = 0; i < d.numVertices; i++) {
+            s.vertices[i].pos = terrainVertex(cfg_, d.variant, d.u, cam_, d.vertices[i], s.vertices[i].v);
+        }
+
+        double mid = detail::seconds();
+        t.vertex += mid - start;
+
+        auto emit = [this, &fb, &s](std::uint32_t a, std::uint32_t b, std::uint32_t c, std::uint32_t provoking) {
+            float x[3], y[3], invW, area;
+            const std::uint32_t v[3] = {a, b, c};
+            for (int k = 0; k < 3; k++) {
+                detail::windowCoords(s.vertices[v[k]].pos, fb.width, fb.height, x[k], y[k], invW);
+            }
+            int minX, minY, maxX, maxY;
+            if (detail::triangleBounds(x, y, fb.width, fb.height, area, minX, minY, maxX, maxY)) {
+                clipped_triangle tri = {
+                    {a, b, c}, provoking,
+                    minX / tileSize, minY / tileSize, maxX / tileSize, maxY / tileSize
+                };
+                s.triangles.push_back(tri);
+            }
+        };
+
+        for (std::size_t i = 0; i + 2 < d.numIndices; i += 3) {
+            const std::uint32_t idx[3] = {d.indices[i], d.indices[i + 1], d.indices[i + 2]};
+            if (s.vertices[idx[0]].pos.w >= detail::nearPlane &&
+                s.vertices[idx[1]].pos.w >= detail::nearPlane &&
+                s.vertices[idx[2]].pos.w >= detail::nearPlane) {
+                emit(idx[0], idx[1], idx[2], idx[2]);
+                continue;
+            }
+
+            clip_vertex tri[3] = {s.vertices[idx[0]], s.vertices[idx[1]], s.vertices[idx[2]]};
+            clip_vertex poly[4];
+            int n = detail::clipNear(tri, 3, poly);
+            std::uint32_t base = static_cast<std::uint32_t>(s.vertices.size());
+            s.vertices.insert(s.vertices.end(), poly, poly + n);
+            for (int k = 1; k + 1 < n; k++) {
+                emit(base, base + k, base + k + 1, idx[2]);
+            }
+        }
+
+        t.setup += detail::seconds() - mid;
+    }
+
+    inline void renderer::drawTile(
+        const frame &f, const std::vector<draw_state> &states, const tile_bin &bin,
+        rect r, framebuffer &fb, stage_timings &t, std::vector<stage_timings> &perDraw) const {
+
+        for (int y = r.y0; y < r.y1; y++) {
+            std::size_t row = static_cast<std::size_t>(y) * fb.width;
+            std::fill(fb.color.begin() + row + r.x0, fb.color.begin() + row + r.x1, f.sky.FOG_COLOR);
+            std::fill(fb.depth.begin() + row + r.x0, fb.depth.begin() + row + r.x1, 0.0f);
+        }
+
+        /* Triangles of a draw are consecutive in a bin, so they are
+         * timed together. */
+        auto drawList = [&](const std::vector<std::pair<std::uint32_t, std::uint32_t>> &list) {
+            for (std::size_t k = 0; k < list.size(); ) {
+                const std::uint32_t i     = list[k].first;
+                double              start = detail::seconds();
+                for (; k < list.size() && list[k].first == i; k++) {
+                    const draw_state &s = states[i];
+                    rasterize(f.draws[i], *f.atlas, s, s.triangles[list[k].second], r, fb, perDraw[i]);
+                }
+                perDraw[i].terrain += detail::seconds() - start;
+            }
+        };
+
+        drawList(bin.opaque);
+
+        double start = detail::seconds();
+        drawSky(f.sky, r, fb);
+        t.sky += detail::seconds() - start;
+
+        drawList(bin.blend);
+    }
+
+    inline void renderer::rasterize(
+        const draw &d, const texture &atlas, const draw_state &s,
+        const clipped_triangle &tri, rect r, framebuffer &fb, stage_timings &t) const {
+
+        const int W = fb.width;
+        const int H = fb.height;
+
+        /* Window coordinates and 1/w. */
+        float sx[3], sy[3], iw[3];
+        for (int k = 0; k < 3; k++) {
+            detail::windowCoords(s.vertices[tri.v[k]].pos, W, H, sx[k], sy[k], iw[k]);
+        }
+
+        float area;
+        int   minX, minY, maxX, maxY;
+        if (!detail::triangleBounds(sx, sy, W, H, area, minX, minY, maxX, maxY)) {
+            return;
+        }
+        minX = std::max(minX, r.x0);
+        minY = std::max(minY, r.y0);
+        maxX = std::min(maxX, r.x1 - 1);
+        maxY = std::min(maxY, r.y1 - 1);
+        if (minX > maxX || minY > maxY) {
+            return;
+        }
+        minX &= ~1;
+        minY &= ~1;
+
+        /* Make it counter-clockwise so the edge functions are
+         * positive inside. There is no face culling. */
+        int order[3] = {0, 1, 2};
+        if (area < 0.0f) {
+            std::swap(order[1], order[2]);
+            area = -area;
+        }
+        float x[3], y[3], w[3];
+        for (int k = 0; k < 3; k++) {
+            x[k] = sx[order[k]];
+            y[k] = sy[order[k]];
+            w[k] = iw[order[k]];
+        }
+
+        /* Edge k is opposite to vertex k. The top-left rule makes
+         * shared edges rasterized exactly once. */
+        float ea[3], eb[3], ec[3];
+        bool  topLeft[3];
+        for (int k = 0; k < 3; k++) {
+            int i = (k + 1) % 3, j = (k + 2) % 3;
+            ea[k] = y[i] - y[j];
+            eb[k] = x[j] - x[i];
+            ec[k] = x[i] * y[j] - x[j] * y[i];
+            topLeft[k] = (ea[k] > 0.0f) || (ea[k] == 0.0f && eb[k] < 0.0f);
+        }
+
+        /* Varyings premultiplied by 1/w. */
+        const int nSmooth = terrainSmoothFloats;
+        float attr[3][terrainSmoothFloats];
+        for (int k = 0; k < 3; k++) {
+            const float *src = reinterpret_cast<const float *>(&s.vertices[tri.v[order[k]]].v);
+            for (int a = 0; a < nSmooth; a++) {
+                attr[k][a] = src[a] * w[k];
+            }
+        }
+        const float *flat = reinterpret_cast<const float *>(&s.vertices[tri.provoking].v) + terrainSmoothFloats;
+
+        quad_batch batch;
+        for (int qy = minY; qy <= maxY; qy += 2) {
+            for (int qx = minX; qx <= maxX; qx += 2) {
+                const int n   = batch.count;
+                bool      any = false;
+                for (int lane = 0; lane < 4; lane++) {
+                    float px = qx + (lane & 1) + 0.5f;
+                    float py = qy + (lane >> 1) + 0.5f;
+                    bool inside = true;
+                    for (int k = 0; k < 3; k++) {
+                        float e = ea[k] * px + eb[k] * py + ec[k];
+                        batch.b[k][lane][n] = e / area;
+                        inside = inside && (e > 0.0f || (e == 0.0f && topLeft[k]));
+                    }
+                    int ix = qx + (lane & 1), iy = qy + (lane >> 1);
+                    batch.covered[lane][n] = inside && ix < W && iy < H;
+                    any = any || batch.covered[lane][n];
+                }
+                if (!any) {
+                    continue;
+                }
+
+                /* Early depth test. The shader doesn't write the
+                 * depth, and quads of a triangle never overlap, so
+                 * testing them before shading any is fine. */
+                bool visible = false;
+                for (int lane = 0; lane < 4; lane++) {
+                    float depth = batch.b[0][lane][n] * w[0] + batch.b[1][lane][n] * w[1] + batch.b[2][lane][n] * w[2];
+                    batch.depth[lane][n] = depth;
+                    if (batch.covered[lane][n]) {
+                        std::size_t idx = static_cast<std::size_t>(qy + (lane >> 1)) * W + qx + (lane & 1);
+                        batch.covered[lane][n] = depth > fb.depth[idx];
+                        visible = visible || batch.covered[lane][n];
+                    }
+                }
+                if (!visible) {
+                    continue;
+                }
+
+                batch.qx[n] = qx;
+                batch.qy[n] = qy;
+                if (++batch.count == quad_batch::capacity) {
+                    shade(d, atlas, attr, flat, batch, fb, t);
+                    batch.count = 0;
+                }
+            }
+        }
+        if (batch.count > 0) {
+            shade(d, atlas, attr, flat, batch, fb, t);
+        }
+    }
+
+    inline void renderer::shade(
+        const draw &d, const texture &atlas, const float attr[3][terrainSmoothFloats],
+        const float flat[], const quad_batch &batch, framebuffer &fb, stage_timings &t) const {
+
+        const int  W       = fb.width;
+        const int  nSmooth = terrainSmoothFloats;
+        const bool blend   = d.variant & VARIANT_BLEND;
+
+        for (int n = 0; n < batch.count; n++) {
+            /* Interpolate the varyings of every lane, including
+             * helpers. */
+            terrain_varyings v[4];
+            for (int lane = 0; lane < 4; lane++) {
+                const float b0 = batch.b[0][lane][n], b1 = batch.b[1][lane][n], b2 = batch.b[2][lane][n];
+                float invW = std::max(batch.depth[lane][n], 1e-6f);
+                float *dst = reinterpret_cast<float *>(&v[lane]);
+                for (int a = 0; a < nSmooth; a++) {
+                    dst[a] = (b0 * attr[0][a] + b1 * attr[1][a] + b2 * attr[2][a]) / invW;
+                }
+                std::memcpy(dst + nSmooth, flat, terrainFlatFloats * sizeof(float));
+            }
+
+            vec4 color[4];
+            bool     discarded[4];
+            unsigned effects[4];
+            terrainFragmentQuad(cfg_, d.variant, d.u, atlas, v, color, discarded, effects);
+
+            for (int lane = 0; lane < 4; lane++) {
+                if (!batch.covered[lane][n] || discarded[lane]) {
+                    continue;
+                }
+                t.ripples     += (effects[lane] & EFFECT_RIPPLES)     ? 1 : 0;
+                t.waveNormals += (effects[lane] & EFFECT_WAVE_NORMAL) ? 1 : 0;
+                std::size_t idx = static_cast<std::size_t>(batch.qy[n] + (lane >> 1)) * W + batch.qx[n] + (lane & 1);
+                if (blend) {
+                    float a = clamp(color[lane].w, 0.0f, 1.0f);
+                    fb.color[idx] = vec4(mix(fb.color[idx].rgb(), color[lane].rgb(), a), 1.0f);
+                }
+                else {
+                    fb.color[idx] = vec4(color[lane].rgb(), 1.0f);
+                    fb.depth[idx] = batch.depth[lane][n];
+                }
+            }
+        }
+    }
+
+    inline void renderer::drawSky(const uniforms &u, rect r, framebuffer &fb) const {
+        const int W = fb.width;
+        const int H = fb.height;
+
+        for (int qy = r.y0; qy < r.y1; qy += 2) {
+            for (int qx = r.x0; qx < r.x1; qx += 2) {
+                bool covered[4];
+                bool any = false;
+                for (int lane = 0; lane < 4; lane++) {
+                    int ix = qx + (lane & 1), iy = qy + (lane >> 1);
+                    covered[lane] = ix < W && iy < H &&
+                        fb.depth[static_cast<std::size_t>(iy) * W + ix] == 0.0f;
+                }
+
+                /* Intersect the ray of each lane with the sky
+                 * plane. Lanes that miss the disc aren't covered by
+                 * the sky mesh, but they still take part in the quad
+                 * as helpers. */
+                sky_varyings v[4];
+                for (int lane = 0; lane < 4; lane++) {
+                    vec3  dir  = cam_.ray(qx + (lane & 1) + 0.5f, qy + (lane >> 1) + 0.5f);
+                    float dy   = std::max(dir.y, 1e-4f);
+                    vec3  hit  = dir * (skyPlaneHeight / dy);
+                    vec3  pos  = vec3(hit.x, 0.0f, hit.z);
+                    float dist = length(pos);
+                    if (covered[lane] && (dir.y <= 0.0f || dist > 1.0f)) {
+                        covered[lane] = false;
+                    }
+                    skyVertex(u, pos, std::min(dist, 1.0f), v[lane]);
+                    any = any || covered[lane];
+                }
+                if (!any) {
+                    continue;
+                }
+
+                vec4 color[4];
+                skyFragmentQuad(cfg_, u, v, color);
+                for (int lane = 0; lane < 4; lane++) {
+                    if (covered[lane]) {
+                        std::size_t idx = static_cast<std::size_t>(qy + (lane >> 1)) * W + qx + (lane & 1);
+                        fb.color[idx] = vec4(color[lane].rgb(), 1.0f);
+                    }
+                }
+            }
+        }
+    }
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_PIPELINE_HPP_INCLUDED) */
@@ -0,0 +1,479 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_PREPROCESSOR_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_PREPROCESSOR_HPP_INCLUDED 1
+
+/* Just enough of the GLSL ES preprocessor to tell whether two
+ * shaders compile to the same thing: it evaluates conditional
+ * directives and keeps the lines that survive them, with comments
+ * removed and whitespace trimmed. Macros are only expanded within
+ * conditions. The text of the shader is kept as is, so two shaders
+ * with the same output are the same shader as long as the macros
+ * they define differently don't appear in the output.
+ *
+ * The C preprocessor can't be used for this, as it rejects GLSL
+ * directives such as #extension and #version.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace nm {
+    class preprocessor {
+    public:
+        /* Macros defined before the first line, such as __VERSION__. */
+        explicit preprocessor(const std::map<std::string, std::string> &predefined)
+            : predefined_(predefined) {}
+
+        /* Preprocess "source". Return false and set error() on
+         * failure. */
+        bool run(const std::string &source, std::string &out) {
+            macros_ = predefined_;
+            functionLike_.clear();
+            out.clear();
+
+            struct group {
+                bool active;  // Whether lines in the group are kept.
+                bool taken;   // Whether a branch has been taken.
+                bool outer;   // Whether the enclosing group is active.
+                bool hasElse;
+            };
+            std::vector<group> groups;
+            bool               active = true;
+
+            std::vector<std::string> lines = splitLines(stripComments(source));
+            for (line_ = 1; line_ <= lines.size(); line_++) {
+                const std::string &line = lines[line_ - 1];
+                std::size_t p = line.find_first_not_of(" \t");
+                if (p == std::string::npos) {
+                    continue;
+                }
+                if (line[p] != '#') {
+                    if (active) {
+                        out += trim(line) + "\n";
+                    }
+                    continue;
+                }
+
+                std::size_t nameBegin = line.find_first_not_of(" \t", p + 1);
+                std::size_t nameEnd   = nameBegin;
+                while (nameEnd < line.size() && isIdentChar(line[nameEnd])) {
+                    nameEnd++;
+                }
+                std::string directive = nameBegin == std::string::npos
+                    ? std::string()
+                    : line.substr(nameBegin, nameEnd - nameBegin);
+                std::string rest = nameBegin == std::string::npos ? std::string() : trim(line.substr(nameEnd));
+
+                if (directive == "if" || directive == "ifdef" || directive == "ifndef") {
+                    bool cond = false;
+                    if (active) {
+                        if (directive == "if") {
+                            if (!evaluate(rest, cond)) {
+                                return false;
+                            }
+                        }
+                        else {
+                            std::string name = firstIdentifier(rest);
+                            cond = macros_.count(name) || functionLike_.count(name);
+                            cond = directive == "ifdef" ? cond : !cond;
+                        }
+                    }
+                    groups.push_back({active && cond, active && cond, active, false});
+                    active = active && cond;
+                }
+                else if (directive == "elif" || directive == "else") {
+                    if (groups.empty() || groups.back().hasElse) {
+                        return fail("#" + directive + " without a matching #if");
+                    }
+                    group &g = groups.back();
+                    bool cond = true;
+                    if (g.outer && !g.taken && directive == "elif" && !evaluate(rest, cond)) {
+                        return false;
+                    }
+                    g.hasElse = directive == "else";
+                    g.active  = g.outer && !g.taken && cond;
+                    g.taken   = g.taken || g.active;
+                    active    = g.active;
+                }
+                else if (directive == "endif") {
+                    if (groups.empty()) {
+                        return fail("#endif without a matching #if");
+                    }
+                    groups.pop_back();
+                    active = groups.empty() || groups.back().active;
+                }
+                else if (active) {
+                    if (directive == "define") {
+                        define(rest);
+                    }
+                    else if (directive == "undef") {
+                        std::string name = firstIdentifier(rest);
+                        macros_.erase(name);
+                        functionLike_.erase(name);
+                    }
+                    out += "#" + directive + (rest.empty() ? "" : " " + rest) + "\n";
+                }
+            }
+            if (!groups.empty()) {
+                return fail("unterminated #if");
+            }
+            return true;
+        }
+
+        const std::string &error() const { return error_; }
+
+        /* The identifiers each #if, #ifdef, #ifndef and #elif of
+         * "source" tests, whether or not the directive would be
+         * reached. */
+        static std::vector<std::vector<std::string>> conditions(const std::string &source) {
+            std::vector<std::vector<std::string>> out;
+            for (const std::string &line: splitLines(stripComments(source))) {
+                std::size_t p = line.find_first_not_of(" \t");
+                if (p == std::string::npos || line[p] != '#') {
+                    continue;
+                }
+                std::string rest = trim(line.substr(p + 1));
+                std::string directive = firstIdentifier(rest);
+                if (directive != "if" && directive != "ifdef" && directive != "ifndef" && directive != "elif") {
+                    continue;
+                }
+                std::vector<token> tokens;
+                tokenize(rest.substr(directive.size()), tokens);
+                std::vector<std::string> idents;
+                for (const token &t: tokens) {
+                    if (t.type == TOKEN_IDENTIFIER && t.text != "defined") {
+                        idents.push_back(t.text);
+                    }
+                }
+                out.push_back(idents);
+            }
+            return out;
+        }
+
+    private:
+        enum token_type {
+            TOKEN_NUMBER,
+            TOKEN_IDENTIFIER,
+            TOKEN_OPERATOR,
+            TOKEN_END
+        };
+
+        struct token {
+            token_type  type;
+            std::string text;
+            long long   value;
+        };
+
+        static bool isIdentChar(char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        static std::string trim(const std::string &s) {
+            std::size_t b = s.find_first_not_of(" \t\r");
+            std::size_t e = s.find_last_not_of(" \t\r");
+            return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+        }
+
+        static std::string firstIdentifier(const std::string &s) {
+            std::size_t e = 0;
+            while (e < s.size() && isIdentChar(s[e])) {
+                e++;
+            }
+            return s.substr(0, e);
+        }
+
+        /* Replace comments with a space, keeping newlines so that
+         * line numbers stay the same, and join continued lines. */
+        static std::string stripComments(const std::string &in) {
+            std::string out;
+            out.reserve(in.size());
+            for (std::size_t i = 0; i < in.size(); i++) {
+                if (in.compare(i, 2, "//") == 0) {
+                    while (i < in.size() && in[i] != '\n') {
+                        i++;
+                    }
+                    out += '\n';
+                }
+                else if (in.compare(i, 2, "/*") == 0) {
+                    std::size_t end = in.find("*/", i + 2);
+                    end = end == std::string::npos ? in.size() : end;
+                    out += ' ';
+                    for (std::size_t k = i; k < end; k++) {
+                        if (in[k] == '\n') {
+                            out += '\n';
+                        }
+                    }
+                    i = end + 1;
+                }
+                else if (in[i] == '\\' && i + 1 < in.size() && in[i + 1] == '\n') {
+                    i++;
+                }
+                else {
+                    out += in[i];
+                }
+            }
+            return out;
+        }
+
+        static std::vector<std::string> splitLines(const std::string &s) {
+            std::vector<std::string> lines;
+            std::size_t pos = 0;
+            while (pos <= s.size()) {
+                std::size_t end = s.find('\n', pos);
+                if (end == std::string::npos) {
+                    lines.push_back(s.substr(pos));
+                    break;
+                }
+                lines.push_back(s.substr(pos, end - pos));
+                pos = end + 1;
+            }
+            return lines;
+        }
+
+        bool fail(const std::string &what) {
+            error_ = "line " + std::to_string(line_) + ": " + what;
+            return false;
+        }
+
+        void define(const std::string &rest) {
+            std::string name = firstIdentifier(rest);
+            if (name.size() < rest.size() && rest[name.size()] == '(') {
+                macros_.erase(name);
+                functionLike_.insert(name);
+            }
+            else {
+                functionLike_.erase(name);
+                macros_[name] = trim(rest.substr(name.size()));
+            }
+        }
+
+        static void tokenize(const std::string &s, std::vector<token> &out) {
+            static const char *const operators[] = {
+                "&&", "||", "==", "!=", "<=", ">=", "<<", ">>",
+            };
+            std::size_t i = 0;
+            while (i < s.size()) {
+                char c = s[i];
+                if (c == ' ' || c == '\t' || c == '\r') {
+                    i++;
+                }
+                else if (std::isdigit(static_cast<unsigned char>(c))) {
+                    char *end;
+                    long long v = std::strtoll(s.c_str() + i, &end, 0);
+                    std::size_t next = static_cast<std::size_t>(end - s.c_str());
+                    /* Skip suffixes, and fail on floats later. */
+                    std::size_t e = next;
+                    while (e < s.size() && (isIdentChar(s[e]) || s[e] == '.')) {
+                        e++;
+                    }
+                    out.push_back({TOKEN_NUMBER, s.substr(i, e - i), v});
+                    i = e;
+                }
+                else if (isIdentChar(c)) {
+                    std::size_t e = i;
+                    while (e < s.size() && isIdentChar(s[e])) {
+                        e++;
+                    }
+                    out.push_back({TOKEN_IDENTIFIER, s.substr(i, e - i), 0});
+                    i = e;
+                }
+                else {
+                    std::string op(1, c);
+                    for (const char *o: operators) {
+                        if (s.compare(i, 2, o) == 0) {
+                            op = o;
+                        }
+                    }
+                    out.push_back({TOKEN_OPERATOR, op, 0});
+                    i += op.size();
+                }
+            }
+        }
+
+        /* Expand the macros of a condition, evaluating "defined"
+         * first. Undefined identifiers become 0. */
+        bool expand(const std::vector<token> &in, std::vector<token> &out,
+                    std::set<std::string> &expanding) {
+            for (std::size_t i = 0; i < in.size(); i++) {
+                const token &t = in[i];
+                if (t.type != TOKEN_IDENTIFIER) {
+                    out.push_back(t);
+                }
+                else if (t.text == "defined") {
+                    bool paren = i + 1 < in.size() && in[i + 1].text == "(";
+                    std::size_t n = paren ? i + 2 : i + 1;
+                    if (n >= in.size() || in[n].type != TOKEN_IDENTIFIER ||
+                        (paren && (n + 1 >= in.size() || in[n + 1].text != ")"))) {
+                        return fail("malformed \"defined\"");
+                    }
+                    long long v = macros_.count(in[n].text) || functionLike_.count(in[n].text) ? 1 : 0;
+                    out.push_back({TOKEN_NUMBER, std::to_string(v), v});
+                    i = paren ? n + 1 : n;
+                }
+                else if (functionLike_.count(t.text)) {
+                    return fail("function-like macro " + t.text + " in a condition");
+                }
+                else if (macros_.count(t.text) && !expanding.count(t.text)) {
+                    std::vector<token> body;
+                    tokenize(macros_[t.text], body);
+                    expanding.insert(t.text);
+                    bool ok = expand(body, out, expanding);
+                    expanding.erase(t.text);
+                    if (!ok) {
+                        return false;
+                    }
+                }
+                else {
+                    out.push_back({TOKEN_NUMBER, "0", 0});
+                }
+            }
+            return true;
+        }
+
+        bool evaluate(const std::string &expr, bool &result) {
+            std::vector<token> raw;
+            std::set<std::string> expanding;
+            tokenize(expr, raw);
+            tokens_.clear();
+            if (!expand(raw, tokens_, expanding)) {
+                return false;
+            }
+            tokens_.push_back({TOKEN_END, "", 0});
+            pos_ = 0;
+
+            long long v;
+            if (!ternary(v)) {
+                return false;
+            }
+            if (tokens_[pos_].type != TOKEN_END) {
+                return fail("garbage after a condition: " + tokens_[pos_].text);
+            }
+            result = v != 0;
+            return true;
+        }
+
+        bool accept(const char *op) {
+            if (tokens_[pos_].type == TOKEN_OPERATOR && tokens_[pos_].text == op) {
+                pos_++;
+                return true;
+            }
+            return false;
+        }
+
+        bool ternary(long long &v) {
+            if (!binary(0, v)) {
+                return false;
+            }
+            if (accept("?")) {
+                long long a, b;
+                if (!ternary(a) || !accept(":") || !ternary(b)) {
+                    return fail("malformed ?:");
+                }
+                v = v ? a : b;
+            }
+            return true;
+        }
+
+        /* Binary operators by precedence, lowest first. */
+        bool binary(int level, long long &v) {
+            static const std::vector<std::vector<std::string>> levels = {
+                {"||"}, {"&&"}, {"|"}, {"^"}, {"&"}, {"==", "!="},
+                {"<", ">", "<=", ">="}, {"<<", ">>"}, {"+", "-"}, {"*", "/", "%"},
+            };
+            if (level == static_cast<int>(levels.size())) {
+                return unary(v);
+            }
+            if (!binary(level + 1, v)) {
+                return false;
+            }
+            while (true) {
+                const token &t = tokens_[pos_];
+                const auto  &ops = levels[static_cast<std::size_t>(level)];
+                if (t.type != TOKEN_OPERATOR || std::find(ops.begin(), ops.end(), t.text) == ops.end()) {
+                    return true;
+                }
+                std::string op = t.text;
+                pos_++;
+                long long r;
+                if (!binary(level + 1, r)) {
+                    return false;
+                }
+                if ((op == "/" || op == "%") && r == 0) {
+                    return fail("division by zero");
+                }
+                /* Wrap around instead of overflowing. */
+                unsigned long long uv = static_cast<unsigned long long>(v);
+                unsigned long long ur = static_cast<unsigned long long>(r);
+                v = op == "||" ? (v || r) : op == "&&" ? (v && r)
+                  : op == "|"  ? (v | r)  : op == "^"  ? (v ^ r)  : op == "&" ? (v & r)
+                  : op == "==" ? (v == r) : op == "!=" ? (v != r)
+                  : op == "<"  ? (v < r)  : op == ">"  ? (v > r)
+                  : op == "<=" ? (v <= r) : op == ">=" ? (v >= r)
+                  : op == "<<" ? static_cast<long long>(uv << (ur & 63))
+                  : op == ">>" ? (v >> (r & 63))
+                  : op == "+"  ? static_cast<long long>(uv + ur)
+                  : op == "-"  ? static_cast<long long>(uv - ur)
+                  : op == "*"  ? static_cast<long long>(uv * ur)
+                  : op == "/"  ? (v / r) : (v % r);
+            }
+        }
+
+        bool unary(long long &v) {
+            if (accept("!")) {
+                if (!unary(v)) {
+                    return false;
+                }
+                v = !v;
+                return true;
+            }
+            if (accept("-")) {
+                if (!unary(v)) {
+                    return false;
+                }
+                v = static_cast<long long>(0ull - static_cast<unsigned long long>(v));
+                return true;
+            }
+            if (accept("~")) {
+                if (!unary(v)) {
+                    return false;
+                }
+                v = ~v;
+                return true;
+            }
+            if (accept("+")) {
+                return unary(v);
+            }
+            if (accept("(")) {
+                if (!ternary(v) || !accept(")")) {
+                    return fail("unbalanced parentheses");
+                }
+                return true;
+            }
+            const token &t = tokens_[pos_];
+            if (t.type != TOKEN_NUMBER) {
+                return fail("unexpected token in a condition: " + t.text);
+            }
+            if (t.text.find('.') != std::string::npos) {
+                return fail("floating-point number in a condition: " + t.text);
+            }
+            v = t.value;
+            pos_++;
+            return true;
+        }
+
+        std::map<std::string, std::string> predefined_;
+        std::map<std::string, std::string> macros_;
+        std::set<std::string>              functionLike_;
+        std::vector<token>                 tokens_;
+        std::size_t                        pos_  = 0;
+        std::size_t                        line_ = 0;
+        std::string                        error_;
+    };
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_PREPROCESSOR_HPP_INCLUDED) */
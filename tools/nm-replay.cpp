@@ -0,0 +1,193 @@
+// -*- c++ -*-
+/* nm-replay: Replay a frame capture and time each draw.
+ *
+ * This renders a capture written by nm-capture with the software
+ * rasterizer of nm-golden, and reports where the time goes: the
+ * draws that cost the most, and the total per material variant. The
+ * capture is memory-mapped, so even captures of large worlds start
+ * rendering immediately.
+ *
+ * Usage: nm-replay [--iterations=N] [--top=N] [--output=FILE]
+ *                  [--threads=N] [CONFIGURE-OPTION]... CAPTURE
+ *
+ * The frame is rendered N times (default 5) and each draw reports the
+ * fastest of its runs. --top limits the list of draws to the N most
+ * expensive ones (default 20, 0 for all). --output writes the
+ * rendered image as a TGA file. --threads and CONFIGURE-OPTION are
+ * the same as those of nm-golden.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "nm-capture.hpp"
+#include "nm-image.hpp"
+
+using namespace glsl;
+
+namespace {
+    std::string variantName(unsigned variant) {
+        static const struct {
+            unsigned    bit;
+            const char *name;
+        } bits[] = {
+            {nm::VARIANT_FOG,        "fog"},
+            {nm::VARIANT_UNDERWATER, "underwater"},
+            {nm::VARIANT_BLEND,      "blend"},
+            {nm::VARIANT_ALPHA_TEST, "alpha-test"},
+            {nm::VARIANT_ALWAYS_LIT, "always-lit"},
+            {nm::VARIANT_FANCY,      "fancy"},
+            {nm::VARIANT_ALLOW_FADE, "allow-fade"},
+        };
+        std::string name;
+        for (const auto &b: bits) {
+            if (variant & b.bit) {
+                name += name.empty() ? "" : ",";
+                name += b.name;
+            }
+        }
+        return name.empty() ? "opaque" : name;
+    }
+
+    void usage(const char *prog) {
+        std::fprintf(stderr,
+                     "Usage: %s [--iterations=N] [--top=N] [--output=FILE]\n"
+                     "       [--threads=N] [CONFIGURE-OPTION]... CAPTURE\n",
+                     prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string path;
+    std::string output;
+    int         iterations = 5;
+    int         top        = 20;
+    int         threads    = 1;
+    nm::config  cfg;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--iterations=", 13) == 0) {
+            iterations = std::atoi(argv[i] + 13);
+            if (iterations < 1) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--top=", 6) == 0) {
+            top = std::atoi(argv[i] + 6);
+            if (top < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = std::atoi(argv[i] + 10);
+            if (threads < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        }
+        else if (argv[i][0] != '-' && path.empty()) {
+            path = argv[i];
+        }
+        else if (!cfg.parse(argv[i])) {
+            std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            usage(argv[0]);
+        }
+    }
+    if (path.empty()) {
+        usage(argv[0]);
+    }
+
+    nm::capture cap;
+    if (!cap.open(path)) {
+        return 1;
+    }
+    const nm::frame        &f    = cap.get();
+    const nm::capture_view &view = cap.view();
+
+    nm::camera      cam(view.width, view.height, view.yaw, view.pitch, view.fovY);
+    nm::renderer    r(cfg, cam, static_cast<unsigned>(threads));
+    nm::framebuffer fb(view.width, view.height);
+
+    /* Keep the fastest run of each draw separately, as a single slow
+     * draw shouldn't discard the timings of the others. */
+    nm::stage_timings                best;
+    std::vector<nm::stage_timings>   bestDraws, draws;
+    for (int i = 0; i < iterations; i++) {
+        nm::stage_timings t = r.render(f, fb, &draws);
+        if (i == 0) {
+            best      = t;
+            bestDraws = draws;
+            continue;
+        }
+        best.sky = std::min(best.sky, t.sky);
+        for (std::size_t k = 0; k < draws.size(); k++) {
+            if (draws[k].total() < bestDraws[k].total()) {
+                bestDraws[k] = draws[k];
+            }
+        }
+    }
+
+    nm::stage_timings total;
+    total.sky = best.sky;
+    for (const nm::stage_timings &t: bestDraws) {
+        total += t;
+    }
+
+    /* Clipping counts as a part of the vertex stage. */
+    auto vertexTime = [](const nm::stage_timings &t) {
+        return t.vertex + t.setup;
+    };
+
+    std::vector<std::size_t> order(f.draws.size());
+    for (std::size_t k = 0; k < order.size(); k++) {
+        order[k] = k;
+    }
+    std::stable_sort(order.begin(), order.end(), [&bestDraws](std::size_t a, std::size_t b) {
+        return bestDraws[a].total() > bestDraws[b].total();
+    });
+    if (top > 0 && order.size() > static_cast<std::size_t>(top)) {
+        order.resize(top);
+    }
+
+    std::printf("%s: %dx%d, %zu draws\n\n", path.c_str(), view.width, view.height, f.draws.size());
+    std::printf("%6s %-28s %8s %8s %10s %10s %7s\n",
+                "draw", "variant", "verts", "tris", "vertex ms", "frag ms", "share");
+    for (std::size_t k: order) {
+        const nm::draw          &d = f.draws[k];
+        const nm::stage_timings &t = bestDraws[k];
+        std::printf("%6zu %-28s %8zu %8zu %10.3f %10.3f %6.1f%%\n",
+                    k, variantName(d.variant).c_str(), d.numVertices, d.numIndices / 3,
+                    vertexTime(t) * 1000.0, t.terrain * 1000.0, 100.0 * t.total() / total.total());
+    }
+
+    std::map<unsigned, std::pair<std::size_t, nm::stage_timings>> byVariant;
+    for (std::size_t k = 0; k < f.draws.size(); k++) {
+        auto &v = byVariant[f.draws[k].variant];
+        v.first++;
+        v.second += bestDraws[k];
+    }
+    std::printf("\n%-35s %8s %10s %10s %7s\n", "variant", "draws", "vertex ms", "frag ms", "share");
+    for (const auto &kv: byVariant) {
+        const nm::stage_timings &t = kv.second.second;
+        std::printf("%-35s %8zu %10.3f %10.3f %6.1f%%\n",
+                    variantName(kv.first).c_str(), kv.second.first,
+                    vertexTime(t) * 1000.0, t.terrain * 1000.0, 100.0 * t.total() / total.total());
+    }
+    std::printf("%-35s %8s %10s %10.3f %6.1f%%\n", "sky", "", "",
+                total.sky * 1000.0, 100.0 * total.sky / total.total());
+    std::printf("%-35s %8zu %10.3f %10.3f\n", "total", f.draws.size(),
+                vertexTime(total) * 1000.0, (total.terrain + total.sky) * 1000.0);
+
+    if (!output.empty() && !nm::writeTGA(output, nm::toImage(fb))) {
+        return 1;
+    }
+    return 0;
+}
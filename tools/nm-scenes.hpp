@@ -0,0 +1,591 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_SCENES_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_SCENES_HPP_INCLUDED 1
+
+/* Synthetic scenes for nm-pipeline.hpp. Each of them is a small voxel
+ * world meshed into chunks the way the game does it, together with a
+ * camera and uniforms for a particular time of day or weather. The
+ * world, the texture atlas, and the light levels are all procedural
+ * so the scenes are fully deterministic.
+ */
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "nm-pipeline.hpp"
+#include "natural-mystic-noise.hpp"
+
+namespace nm {
+    enum block : std::uint8_t {
+        BLOCK_AIR, BLOCK_GRASS, BLOCK_DIRT, BLOCK_STONE, BLOCK_SAND, BLOCK_WATER, BLOCK_TALL_GRASS
+    };
+
+    /* Cells of the texture atlas, which is a 4x4 grid. */
+    enum atlas_cell {
+        CELL_GRASS_TOP, CELL_GRASS_SIDE, CELL_DIRT, CELL_STONE, CELL_SAND, CELL_WATER, CELL_TALL_GRASS
+    };
+
+    /* The description of a scene. */
+    struct scene_desc {
+        enum terrain_kind { HILLS, OCEAN, CAVE };
+
+        const char  *name;
+        terrain_kind terrain;
+        float        yaw, pitch;
+        float        eyeHeight;    // Above the ground, or below the sea level if negative.
+        vec4         fogColor;
+        vec2         fogControl;
+        vec4         skyColor;     // CURRENT_COLOR
+        float        daylightTexel;
+        bool         underwater;
+        float        ssimBudget;   // The minimum mean SSIM against the reference. See scenes().
+    };
+
+    /* Every scene has a budget of 0.98. It comes from how much the
+     * scenes change by themselves: between two frames 1/30 s apart,
+     * the most animated one (underwater) scores 0.984 against itself,
+     * and the others 0.989 or higher. A difference smaller than that
+     * disappears in the animation, so the budget is that, rounded
+     * down. Scenes don't get looser budgets for being noisy, as the
+     * noise is exactly where optimizations tend to cut corners.
+     *
+     * "make check" holds these optimizations to the budgets against
+     * tools/golden. They scored:
+     *
+     *   --enable-quad-shared-noise: day 0.9986, dusk 0.9987, night
+     *   0.9997, rain 0.9964, underwater 0.9952, ocean 0.9960, cave
+     *   1.0000.
+     *
+     *   --enable-vertex-lighting: day 0.9860, dusk 0.9923, night
+     *   0.9812, rain 1.0000, underwater 0.9999, ocean 0.9994, cave
+     *   0.9992. Night is 0.0012 above its budget, i.e. vertex
+     *   lighting is already as far from per-pixel lighting at night
+     *   as is acceptable, and any further change to it will fail.
+     *
+     * Options that change the look on purpose are expected to exceed
+     * the budgets against the default configuration. These are
+     * accepted:
+     *
+     *   --disable-band-limited-noise brings back the aliasing of
+     *   ripples that the default filters out: rain 0.951, underwater
+     *   0.898. The fog underwater looks like rain to
+     *   isClearWeather(), so that scene is full of ripples too. The
+     *   same holds in combination with other options, e.g.
+     *   --enable-vertex-lighting. Check those with
+     *   nm-golden --baseline=--disable-band-limited-noise.
+     *
+     *   --enable-camera-movement-mitigation shifts the phase of every
+     *   animation: rain 0.744, underwater 0.846, ocean 0.866, day
+     *   0.951, dusk 0.971.
+     */
+    inline const std::vector<scene_desc> &scenes() {
+        static const std::vector<scene_desc> all = {
+            {"day",        scene_desc::HILLS,  2.7f, -0.12f,  2.5f,
+             vec4(0.66f, 0.81f, 1.00f, 1.0f), vec2(0.8f, 1.0f), vec4(0.38f, 0.56f, 1.00f, 1.0f), 1.0f, false, 0.98f},
+            {"dusk",       scene_desc::HILLS,  2.2f, -0.10f,  2.5f,
+             vec4(0.86f, 0.52f, 0.30f, 1.0f), vec2(0.8f, 1.0f), vec4(0.45f, 0.40f, 0.70f, 1.0f), 0.7f, false, 0.98f},
+            {"night",      scene_desc::HILLS, -0.9f, -0.10f,  2.5f,
+             vec4(0.04f, 0.05f, 0.09f, 1.0f), vec2(0.8f, 1.0f), vec4(0.00f, 0.00f, 0.02f, 1.0f), 0.4f, false, 0.98f},
+            {"rain",       scene_desc::HILLS,  1.9f, -0.15f,  2.5f,
+             vec4(0.42f, 0.46f, 0.52f, 1.0f), vec2(0.2f, 0.7f), vec4(0.35f, 0.38f, 0.45f, 1.0f), 0.9f, false, 0.98f},
+            {"underwater", scene_desc::OCEAN,  1.0f,  0.20f, -2.0f,
+             vec4(0.05f, 0.20f, 0.45f, 1.0f), vec2(0.0f, 0.4f), vec4(0.38f, 0.56f, 1.00f, 1.0f), 1.0f, true,  0.98f},
+            {"ocean",      scene_desc::OCEAN, -0.4f, -0.12f,  3.0f,
+             vec4(0.66f, 0.81f, 1.00f, 1.0f), vec2(0.8f, 1.0f), vec4(0.38f, 0.56f, 1.00f, 1.0f), 1.0f, false, 0.98f},
+            {"cave",       scene_desc::CAVE,   3.14159f, -0.05f, 0.0f,
+             vec4(0.66f, 0.81f, 1.00f, 1.0f), vec2(0.8f, 1.0f), vec4(0.38f, 0.56f, 1.00f, 1.0f), 1.0f, false, 0.98f},
+        };
+        return all;
+    }
+
+    /* Return nullptr if there is no such scene. */
+    inline const scene_desc *findScene(const std::string &name) {
+        for (const scene_desc &d: scenes()) {
+            if (name == d.name) {
+                return &d;
+            }
+        }
+        return nullptr;
+    }
+
+    /* Set the uniforms that change with the time of day and the
+     * weather, by interpolating those of the day, dusk, night, and
+     * rain scenes. "hour" is in [0, 24) with the noon at 12, and
+     * "rain" is the strength of rain in [0, 1]. */
+    inline void setWeather(float hour, float rain, uniforms &u) {
+        const scene_desc &day   = *findScene("day");
+        const scene_desc &dusk  = *findScene("dusk");
+        const scene_desc &night = *findScene("night");
+        const scene_desc &wet   = *findScene("rain");
+
+        float             sunHeight = -std::cos(hour / 24.0f * 6.2831853f);
+        const scene_desc &other     = sunHeight >= 0.0f ? day : night;
+        float             t         = sunHeight >= 0.0f
+            ? smoothstep(0.0f, 0.5f, sunHeight)
+            : smoothstep(0.0f, 0.3f, -sunHeight);
+
+        vec4  fogColor = mix(dusk.fogColor,      other.fogColor,      t);
+        vec4  skyColor = mix(dusk.skyColor,      other.skyColor,      t);
+        float daylight = mix(dusk.daylightTexel, other.daylightTexel, t);
+
+        /* Rain darkens the sky as much as the time of day does. */
+        float brightness = dot(fogColor.rgb(), vec3(0.299f, 0.587f, 0.114f)) /
+                           dot(day.fogColor.rgb(), vec3(0.299f, 0.587f, 0.114f));
+        u.FOG_COLOR        = mix(fogColor, vec4(wet.fogColor.rgb() * brightness, 1.0f), rain);
+        u.CURRENT_COLOR    = mix(skyColor, vec4(wet.skyColor.rgb() * brightness, 1.0f), rain);
+        u.FOG_CONTROL      = mix(day.fogControl, wet.fogControl, rain);
+        u.lightmapDaylight = daylight * mix(1.0f, wet.daylightTexel / day.daylightTexel, rain);
+    }
+
+    /* A voxel world. Cells outside of it are considered opaque. */
+    class world {
+    public:
+        enum { sizeX = 128, sizeY = 48, sizeZ = 128 };
+        enum { seaLevel = 24 };
+
+        explicit world(scene_desc::terrain_kind kind)
+            : cells_(static_cast<std::size_t>(sizeX) * sizeY * sizeZ, BLOCK_AIR) {
+
+            if (kind == scene_desc::CAVE) {
+                generateCave();
+            }
+            else {
+                generateTerrain(kind == scene_desc::OCEAN ? 10 : 20, 16);
+            }
+        }
+
+        block at(int x, int y, int z) const {
+            if (x < 0 || y < 0 || z < 0 || x >= sizeX || y >= sizeY || z >= sizeZ) {
+                return BLOCK_STONE;
+            }
+            return static_cast<block>(cells_[index(x, y, z)]);
+        }
+
+        static bool isOpaque(block b) {
+            return b != BLOCK_AIR && b != BLOCK_WATER && b != BLOCK_TALL_GRASS;
+        }
+
+        bool opaque(int x, int y, int z) const {
+            return isOpaque(at(x, y, z));
+        }
+
+        /* The height of the topmost opaque block plus one. */
+        int surface(int x, int z) const {
+            for (int y = sizeY - 1; y >= 0; y--) {
+                if (opaque(x, y, z)) {
+                    return y + 1;
+                }
+            }
+            return 0;
+        }
+
+        /* The sunlight level of an air or water cell [0, 1]. Water
+         * attenuates it. */
+        float sunLevel(int x, int y, int z) const {
+            int water = 0;
+            for (int yy = y; yy < sizeY; yy++) {
+                block b = at(x, yy, z);
+                if (isOpaque(b)) {
+                    return 0.0f;
+                }
+                else if (b == BLOCK_WATER) {
+                    water++;
+                }
+            }
+            return std::max(0.0f, 1.0f - 0.08f * water);
+        }
+
+        /* The torch light level at a point [0, 1]. */
+        float torchLevel(vec3 p) const {
+            float level = 0.0f;
+            for (const vec3 &t: torches_) {
+                level = std::max(level, 1.0f - length(p - t) / 14.0f);
+            }
+            return level;
+        }
+
+        /* Where the camera should be for the cave. */
+        vec3 caveEntrance() const {
+            return vec3(caveCenter(8.0f), 8.0f);
+        }
+
+    private:
+        static std::size_t index(int x, int y, int z) {
+            return (static_cast<std::size_t>(y) * sizeZ + z) * sizeX + x;
+        }
+
+        void set(int x, int y, int z, block b) {
+            cells_[index(x, y, z)] = b;
+        }
+
+        static float hash(int x, int y, int z) {
+            std::uint32_t h = static_cast<std::uint32_t>(x) * 73856093u
+                            ^ static_cast<std::uint32_t>(y) * 19349663u
+                            ^ static_cast<std::uint32_t>(z) * 83492791u;
+            h ^= h >> 13; h *= 0x5bd1e995u; h ^= h >> 15;
+            return static_cast<float>(h & 0xffffu) / 65535.0f;
+        }
+
+        void generateTerrain(int base, int amplitude) {
+            for (int z = 0; z < sizeZ; z++) {
+                for (int x = 0; x < sizeX; x++) {
+                    float n = fBM(4, 0.0f, 1.0f, vec2(x / 48.0f, z / 48.0f));
+                    int   h = base + static_cast<int>(n * amplitude);
+                    h = std::min(h, sizeY - 4);
+
+                    for (int y = 0; y < h; y++) {
+                        block b = y < h - 4 ? BLOCK_STONE
+                                : y < h - 1 ? BLOCK_DIRT
+                                : h - 1 < seaLevel ? BLOCK_SAND
+                                : BLOCK_GRASS;
+                        set(x, y, z, b);
+                    }
+                    for (int y = h; y < seaLevel; y++) {
+                        set(x, y, z, BLOCK_WATER);
+                    }
+                    if (h > seaLevel && hash(x, h, z) < 0.08f) {
+                        set(x, h, z, BLOCK_TALL_GRASS);
+                    }
+                }
+            }
+        }
+
+        /* The centerline of the tunnel, which runs along the z
+         * axis. */
+        static vec2 caveCenter(float z) {
+            return vec2(64.0f + 6.0f * std::sin(z / 12.0f),
+                        20.0f + 2.0f * std::sin(z / 9.0f));
+        }
+
+        void generateCave() {
+            for (int z = 0; z < sizeZ; z++) {
+                vec2 c = caveCenter(static_cast<float>(z));
+                for (int y = 0; y < sizeY; y++) {
+                    for (int x = 0; x < sizeX; x++) {
+                        float radius = 3.5f + 1.5f * simplexNoise(vec2(x / 7.0f, y / 7.0f + z / 11.0f));
+                        float dx = x + 0.5f - c.x;
+                        float dy = (y + 0.5f - c.y) * 1.3f;
+                        bool  hollow = dx * dx + dy * dy < radius * radius;
+                        set(x, y, z, hollow ? BLOCK_AIR : (y < sizeY - 6 ? BLOCK_STONE : BLOCK_DIRT));
+                    }
+                }
+            }
+            for (int z = 14; z < sizeZ; z += 10) {
+                vec2 c = caveCenter(static_cast<float>(z));
+                torches_.push_back(vec3(c.x + 2.0f, c.y - 1.0f, static_cast<float>(z)));
+            }
+        }
+
+        std::vector<std::uint8_t> cells_;
+        std::vector<vec3>         torches_;
+    };
+
+    /* The procedural texture atlas: 4x4 cells of 16x16 texels. */
+    inline texture makeAtlas() {
+        const int cell = 16;
+        texture t;
+        t.width  = cell * 4;
+        t.height = cell * 4;
+        t.texels.resize(static_cast<std::size_t>(t.width) * t.height);
+
+        for (int y = 0; y < t.height; y++) {
+            for (int x = 0; x < t.width; x++) {
+                int   c  = (y / cell) * 4 + x / cell;
+                int   cx = x % cell, cy = y % cell;
+                std::uint32_t h = static_cast<std::uint32_t>(x) * 374761393u + static_cast<std::uint32_t>(y) * 668265263u;
+                h = (h ^ (h >> 13)) * 1274126177u;
+                float noise = 0.85f + 0.3f * static_cast<float>((h >> 8) & 0xff) / 255.0f;
+
+                vec4 texel;
+                switch (c) {
+                case CELL_GRASS_TOP:  texel = vec4(vec3(0.62f), 1.0f); break;
+                case CELL_GRASS_SIDE: texel = cy < 3 + static_cast<int>(h & 1)
+                                          ? vec4(0.36f, 0.56f, 0.22f, 1.0f)
+                                          : vec4(0.45f, 0.32f, 0.20f, 1.0f); break;
+                case CELL_DIRT:       texel = vec4(0.45f, 0.32f, 0.20f, 1.0f); break;
+                case CELL_STONE:      texel = vec4(0.50f, 0.50f, 0.50f, 1.0f); break;
+                case CELL_SAND:       texel = vec4(0.86f, 0.80f, 0.60f, 1.0f); break;
+                case CELL_WATER:      texel = vec4(vec3(0.80f), 1.0f); break;
+                case CELL_TALL_GRASS: {
+                    /* A few blades getting thinner towards the top. */
+                    int  blade = (cx + 2) % 5;
+                    bool solid = blade < 2 && cy >= (cx * 7) % 6;
+                    texel = vec4(vec3(0.65f), solid ? 1.0f : 0.0f);
+                    break;
+                }
+                default:              texel = vec4(1.0f, 0.0f, 1.0f, 1.0f); break;
+                }
+                t.texels[static_cast<std::size_t>(y) * t.width + x] =
+                    vec4(clamp(texel.rgb() * noise, 0.0f, 1.0f), texel.w);
+            }
+        }
+        return t;
+    }
+
+    /* A scene ready to be rendered. */
+    class scene {
+    public:
+        scene(const scene_desc &desc, int width, int height)
+            : desc_(desc), world_(desc.terrain), atlas_(makeAtlas()) {
+
+            placeCamera();
+            mesh();
+
+            uniforms base = {};
+            base.FOG_COLOR              = desc.fogColor;
+            base.FOG_CONTROL            = desc.fogControl;
+            base.RENDER_DISTANCE        = 64.0f;
+            base.FAR_CHUNKS_DISTANCE    = 64.0f;
+            base.RENDER_CHUNK_FOG_ALPHA = 0.0f;
+            base.TOTAL_REAL_WORLD_TIME  = 1000.0f;
+            base.CURRENT_COLOR          = desc.skyColor;
+            base.CHUNK_ORIGIN_AND_SCALE = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            base.lightmapDaylight       = desc.daylightTexel;
+            base.lightmapAmbient        = 0.134f;
+
+            frame_.sky   = base;
+            frame_.atlas = &atlas_;
+
+            unsigned common = VARIANT_FOG | VARIANT_FANCY | (desc.underwater ? VARIANT_UNDERWATER : 0u);
+            for (const auto &kv: chunks_) {
+                const chunk_mesh &m = *kv.second;
+                uniforms u = base;
+                u.CHUNK_ORIGIN_AND_SCALE = vec4(
+                    static_cast<float>(std::get<0>(kv.first) * 16) - eye_.x,
+                    static_cast<float>(std::get<1>(kv.first) * 16) - eye_.y,
+                    static_cast<float>(std::get<2>(kv.first) * 16) - eye_.z,
+                    1.0f);
+
+                const unsigned variants[3] = {common, common | VARIANT_ALPHA_TEST, common | VARIANT_BLEND};
+                for (int layer = 0; layer < 3; layer++) {
+                    if (!m.indices[layer].empty()) {
+                        draw d;
+                        d.variant     = variants[layer];
+                        d.u           = u;
+                        d.vertices    = m.vertices[layer].data();
+                        d.numVertices = m.vertices[layer].size();
+                        d.indices     = m.indices[layer].data();
+                        d.numIndices  = m.indices[layer].size();
+                        frame_.draws.push_back(d);
+                    }
+                }
+            }
+
+            camera_.reset(new camera(width, height, desc.yaw, desc.pitch, radians(70.0f)));
+        }
+
+        const scene_desc &desc()  const { return desc_; }
+        const frame      &get()   const { return frame_; }
+        const camera     &cam()   const { return *camera_; }
+
+    private:
+        /* Opaque, alpha-tested, and blended layers of a 16x16x16
+         * chunk. */
+        struct chunk_mesh {
+            std::vector<terrain_vertex> vertices[3];
+            std::vector<std::uint32_t>  indices[3];
+        };
+        typedef std::tuple<int, int, int> chunk_key;
+
+        void placeCamera() {
+            if (desc_.terrain == scene_desc::CAVE) {
+                eye_ = world_.caveEntrance();
+                return;
+            }
+
+            /* Find a spot near the center which is above the ground
+             * or, when the eye should be under the sea level, above
+             * deep enough water. */
+            int bestX = world::sizeX / 2, bestZ = world::sizeZ / 2;
+            if (desc_.eyeHeight < 0.0f) {
+                for (int r = 0; r < 32; r++) {
+                    bool found = false;
+                    for (int dz = -r; dz <= r && !found; dz++) {
+                        for (int dx = -r; dx <= r && !found; dx++) {
+                            int x = world::sizeX / 2 + dx, z = world::sizeZ / 2 + dz;
+                            if (world_.surface(x, z) <= world::seaLevel + desc_.eyeHeight - 3) {
+                                bestX = x;
+                                bestZ = z;
+                                found = true;
+                            }
+                        }
+                    }
+                    if (found) {
+                        break;
+                    }
+                }
+                eye_ = vec3(bestX + 0.5f, world::seaLevel + desc_.eyeHeight, bestZ + 0.5f);
+            }
+            else {
+                float ground = static_cast<float>(std::max(world_.surface(bestX, bestZ), static_cast<int>(world::seaLevel)));
+                eye_ = vec3(bestX + 0.5f, ground + desc_.eyeHeight, bestZ + 0.5f);
+            }
+        }
+
+        chunk_mesh &chunkAt(int x, int y, int z) {
+            std::unique_ptr<chunk_mesh> &m = chunks_[chunk_key(x / 16, y / 16, z / 16)];
+            if (!m) {
+                m.reset(new chunk_mesh);
+            }
+            return *m;
+        }
+
+        /* Emit a quad. The corners are in world coordinates. */
+        void quad(int layer, int cx, int cy, int cz, const vec3 corners[4], const vec2 uvs[4],
+                  const vec4 colors[4], const float sun[4]) {
+
+            chunk_mesh &m    = chunkAt(cx, cy, cz);
+            vec3        base = vec3(static_cast<float>(cx / 16 * 16),
+                                    static_cast<float>(cy / 16 * 16),
+                                    static_cast<float>(cz / 16 * 16));
+            std::uint32_t first = static_cast<std::uint32_t>(m.vertices[layer].size());
+            for (int k = 0; k < 4; k++) {
+                vec3 p = corners[k] - base;
+                terrain_vertex v = {
+                    {p.x, p.y, p.z},
+                    {world_.torchLevel(corners[k]), sun[k]},
+                    {colors[k].x, colors[k].y, colors[k].z, colors[k].w},
+                    {uvs[k].x, uvs[k].y},
+                };
+                m.vertices[layer].push_back(v);
+            }
+            const std::uint32_t order[6] = {0, 1, 2, 0, 2, 3};
+            for (std::uint32_t i: order) {
+                m.indices[layer].push_back(first + i);
+            }
+        }
+
+        static vec2 cellUV(atlas_cell c, float s, float t) {
+            const float eps = 0.001f;
+            s = clamp(s, eps, 1.0f - eps);
+            t = clamp(t, eps, 1.0f - eps);
+            return vec2((c % 4 + s) / 4.0f, (c / 4 + t) / 4.0f);
+        }
+
+        void mesh() {
+            static const int normals[6][3] = {
+                { 0,  1,  0}, { 0, -1,  0}, { 1,  0,  0}, {-1,  0,  0}, { 0,  0,  1}, { 0,  0, -1}
+            };
+            /* Tangents of each face, and the shade the game applies
+             * to faces depending on their direction. */
+            static const int tangentU[6][3] = {
+                {1, 0, 0}, {1, 0, 0}, {0, 0, 1}, {0, 0, 1}, {1, 0, 0}, {1, 0, 0}
+            };
+            static const int tangentV[6][3] = {
+                {0, 0, 1}, {0, 0, 1}, {0, 1, 0}, {0, 1, 0}, {0, 1, 0}, {0, 1, 0}
+            };
+            static const float faceShade[6] = {1.0f, 0.5f, 0.8f, 0.8f, 0.9f, 0.9f};
+            static const float aoShade[4]   = {0.55f, 0.7f, 0.85f, 1.0f};
+
+            const vec3 grassTint = vec3(0.48f, 0.74f, 0.31f);
+            const vec4 waterTint = vec4(0.25f, 0.45f, 0.85f, 0.65f);
+
+            for (int y = 0; y < world::sizeY; y++) {
+                for (int z = 0; z < world::sizeZ; z++) {
+                    for (int x = 0; x < world::sizeX; x++) {
+                        block b = world_.at(x, y, z);
+
+                        if (world::isOpaque(b)) {
+                            for (int f = 0; f < 6; f++) {
+                                const int *n = normals[f];
+                                int nx = x + n[0], ny = y + n[1], nz = z + n[2];
+                                if (world_.opaque(nx, ny, nz)) {
+                                    continue;
+                                }
+
+                                const int *tu = tangentU[f];
+                                const int *tv = tangentV[f];
+                                atlas_cell cell =
+                                    b == BLOCK_GRASS ? (f == 0 ? CELL_GRASS_TOP : f == 1 ? CELL_DIRT : CELL_GRASS_SIDE)
+                                  : b == BLOCK_DIRT  ? CELL_DIRT
+                                  : b == BLOCK_SAND  ? CELL_SAND
+                                  : CELL_STONE;
+                                vec3 tint = (b == BLOCK_GRASS && f == 0) ? grassTint : vec3(1.0f);
+                                float sun = world_.sunLevel(nx, ny, nz);
+
+                                vec3  corners[4];
+                                vec2  uvs[4];
+                                vec4  colors[4];
+                                float suns[4];
+                                const int su[4] = {0, 1, 1, 0};
+                                const int sv[4] = {0, 0, 1, 1};
+                                for (int k = 0; k < 4; k++) {
+                                    /* The corner of the face. */
+                                    float ox = (n[0] > 0 ? 1.0f : 0.0f) + su[k] * tu[0] + sv[k] * tv[0];
+                                    float oy = (n[1] > 0 ? 1.0f : 0.0f) + su[k] * tu[1] + sv[k] * tv[1];
+                                    float oz = (n[2] > 0 ? 1.0f : 0.0f) + su[k] * tu[2] + sv[k] * tv[2];
+                                    corners[k] = vec3(x + ox, y + oy, z + oz);
+
+                                    /* Voxel ambient occlusion. */
+                                    int du = su[k] ? 1 : -1, dv = sv[k] ? 1 : -1;
+                                    bool s1 = world_.opaque(nx + du * tu[0], ny + du * tu[1], nz + du * tu[2]);
+                                    bool s2 = world_.opaque(nx + dv * tv[0], ny + dv * tv[1], nz + dv * tv[2]);
+                                    bool c  = world_.opaque(nx + du * tu[0] + dv * tv[0],
+                                                            ny + du * tu[1] + dv * tv[1],
+                                                            nz + du * tu[2] + dv * tv[2]);
+                                    int ao = (s1 && s2) ? 0 : 3 - (s1 + s2 + c);
+
+                                    colors[k] = vec4(tint * faceShade[f] * aoShade[ao], 1.0f);
+                                    /* Side textures are upright. */
+                                    uvs[k]    = cellUV(cell, static_cast<float>(su[k]),
+                                                       static_cast<float>(f >= 2 ? 1 - sv[k] : sv[k]));
+                                    suns[k]   = sun;
+                                }
+                                quad(0, x, y, z, corners, uvs, colors, suns);
+                            }
+                        }
+                        else if (b == BLOCK_WATER && world_.at(x, y + 1, z) == BLOCK_AIR) {
+                            float top = y + 0.875f;
+                            vec3  corners[4] = {
+                                vec3(x, top, z), vec3(x + 1.0f, top, z),
+                                vec3(x + 1.0f, top, z + 1.0f), vec3(x, top, z + 1.0f)
+                            };
+                            vec2  uvs[4] = {
+                                cellUV(CELL_WATER, 0, 0), cellUV(CELL_WATER, 1, 0),
+                                cellUV(CELL_WATER, 1, 1), cellUV(CELL_WATER, 0, 1)
+                            };
+                            vec4  colors[4] = {waterTint, waterTint, waterTint, waterTint};
+                            float sun       = world_.sunLevel(x, y + 1, z);
+                            float suns[4]   = {sun, sun, sun, sun};
+                            quad(2, x, y, z, corners, uvs, colors, suns);
+                        }
+                        else if (b == BLOCK_TALL_GRASS) {
+                            vec4  tint    = vec4(grassTint, 1.0f);
+                            vec4  colors[4] = {tint, tint, tint, tint};
+                            float sun     = world_.sunLevel(x, y, z);
+                            float suns[4] = {sun, sun, sun, sun};
+                            vec2  uvs[4]  = {
+                                cellUV(CELL_TALL_GRASS, 0, 1), cellUV(CELL_TALL_GRASS, 1, 1),
+                                cellUV(CELL_TALL_GRASS, 1, 0), cellUV(CELL_TALL_GRASS, 0, 0)
+                            };
+                            vec3 a[4] = {
+                                vec3(x, y, z), vec3(x + 1.0f, y, z + 1.0f),
+                                vec3(x + 1.0f, y + 1.0f, z + 1.0f), vec3(x, y + 1.0f, z)
+                            };
+                            vec3 c[4] = {
+                                vec3(x + 1.0f, y, z), vec3(x, y, z + 1.0f),
+                                vec3(x, y + 1.0f, z + 1.0f), vec3(x + 1.0f, y + 1.0f, z)
+                            };
+                            quad(1, x, y, z, a, uvs, colors, suns);
+                            quad(1, x, y, z, c, uvs, colors, suns);
+                        }
+                    }
+                }
+            }
+        }
+
+        scene_desc                                       desc_;
+        world                                            world_;
+        texture                                          atlas_;
+        vec3                                             eye_;
+        std::map<chunk_key, std::unique_ptr<chunk_mesh>> chunks_;
+        frame                                            frame_;
+        std::unique_ptr<camera>                          camera_;
+    };
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_SCENES_HPP_INCLUDED) */
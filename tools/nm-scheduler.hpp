@@ -0,0 +1,111 @@
+// -*- c++ -*-
+#if !defined(NATURAL_MYSTIC_TOOLS_SCHEDULER_HPP_INCLUDED)
+#define NATURAL_MYSTIC_TOOLS_SCHEDULER_HPP_INCLUDED 1
+
+/* A work-stealing scheduler for loops whose iterations take wildly
+ * different amounts of time, such as screen tiles where some are
+ * mostly sky and others are full of water. Each thread starts with a
+ * contiguous range of iterations, so neighbouring tiles tend to be
+ * rendered by the same thread, and a thread that runs out of work
+ * steals the upper half of the remaining iterations of another.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nm {
+    class scheduler {
+    public:
+        /* 0 means one thread per core. */
+        explicit scheduler(unsigned threads = 1)
+            : threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+        unsigned threads() const { return threads_; }
+
+        /* Call fn(i, worker) for every i in [0, n), where worker is
+         * the index of the calling thread in [0, threads()). Return
+         * when all of them have returned. */
+        template <typename F>
+        void parallelFor(std::size_t n, F fn) const {
+            const unsigned workers = static_cast<unsigned>(std::min<std::size_t>(threads_, n));
+            if (workers <= 1) {
+                for (std::size_t i = 0; i < n; i++) {
+                    fn(i, 0u);
+                }
+                return;
+            }
+
+            std::vector<range> ranges(workers);
+            for (unsigned w = 0; w < workers; w++) {
+                ranges[w].begin = n * w / workers;
+                ranges[w].end   = n * (w + 1) / workers;
+            }
+
+            auto work = [&ranges, &fn, workers](unsigned self) {
+                std::size_t i;
+                while (next(ranges, self, workers, i)) {
+                    fn(i, self);
+                }
+            };
+
+            std::vector<std::thread> pool;
+            for (unsigned w = 1; w < workers; w++) {
+                pool.emplace_back(work, w);
+            }
+            work(0);
+            for (std::thread &t: pool) {
+                t.join();
+            }
+        }
+
+    private:
+        /* Iterations not yet taken by anyone. Padded so that
+         * threads taking from their own ranges don't share cache
+         * lines. */
+        struct alignas(64) range {
+            std::mutex  lock;
+            std::size_t begin = 0;
+            std::size_t end   = 0;
+        };
+
+        /* Take an iteration from our own range, or steal from
+         * others. No iterations are ever added, so there is nothing
+         * left once every range is empty. */
+        static bool next(std::vector<range> &ranges, unsigned self, unsigned workers, std::size_t &i) {
+            range &own = ranges[self];
+            {
+                std::lock_guard<std::mutex> g(own.lock);
+                if (own.begin < own.end) {
+                    i = own.begin++;
+                    return true;
+                }
+            }
+            for (unsigned k = 1; k < workers; k++) {
+                range      &victim = ranges[(self + k) % workers];
+                std::size_t begin, end;
+                {
+                    std::lock_guard<std::mutex> g(victim.lock);
+                    if (victim.begin >= victim.end) {
+                        continue;
+                    }
+                    begin      = victim.begin + (victim.end - victim.begin) / 2;
+                    end        = victim.end;
+                    victim.end = begin;
+                }
+                std::lock_guard<std::mutex> g(own.lock);
+                i         = begin;
+                own.begin = begin + 1;
+                own.end   = end;
+                return true;
+            }
+            return false;
+        }
+
+        unsigned threads_;
+    };
+}
+
+#endif /* !defined(NATURAL_MYSTIC_TOOLS_SCHEDULER_HPP_INCLUDED) */
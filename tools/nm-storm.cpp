@@ -0,0 +1,294 @@
+// -*- c++ -*-
+/* nm-storm: Time rain_snow.fragment under the overdraw of a storm.
+ *
+ * Rain and snow are drawn as screen-filling sheets of particles many
+ * layers deep, so their fragment shader runs far more often than any
+ * other, and a good part of it is hidden under roofs and behind hills
+ * by the occlusion texture. This program draws such sheets with a C++
+ * port of rain_snow.fragment and with a port of the shader as it was
+ * before occluded fragments were discarded first, and reports the
+ * time per fragment of each and the largest difference between the
+ * two images, which should be at most 1.
+ *
+ * Usage: nm-storm [--output=DIR] [--size=WxH] [--iterations=N]
+ *                 [--layers=N] [--sheltered=F] [--snow]
+ *
+ * --layers is the number of sheets (default 24), and --sheltered is
+ * the fraction of the occlusion texture covered by roofs, which hide
+ * every particle under them (default 0.5). --snow reads the channels
+ * of the occlusion texture that the SNOW variant reads. With --output
+ * the image of the current shader is written to DIR/storm.tga. The
+ * exit status is 1 if the images differ by more than 1.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "nm-image.hpp"
+
+using namespace glsl;
+using nm::image;
+
+namespace {
+    /* Textures and material defines of the weather material. The
+     * occlusion texture holds the height and the luminance of rain
+     * in .a and .b, and those of snow in .g and .r. */
+    struct weather_state {
+        nm::texture particle;  // TEXTURE_0
+        nm::texture occlusion; // TEXTURE_1
+        nm::texture lightmap;  // TEXTURE_2
+        bool        snow = false;
+    };
+
+    struct weather_varyings {
+        vec2 uv;
+        vec4 color;
+        vec4 worldPosition;
+        vec4 fogColor;
+    };
+
+    /* The occlusion texture and the lightmap are clamped rather than
+     * repeated. */
+    vec4 texture2DClamped(const nm::texture &t, vec2 uv) {
+        return t.sample(clamp(uv, 0.0f, 0.99999f));
+    }
+
+    bool occluded(const weather_state &s, vec4 worldPosition, vec4 occlusionTexture) {
+        float height = s.snow ? occlusionTexture.y : occlusionTexture.w;
+        return worldPosition.x >= 0.0f && worldPosition.x <= 1.0f &&
+               worldPosition.z >= 0.0f && worldPosition.z <= 1.0f &&
+               worldPosition.y < height;
+    }
+
+    vec3 lighting(const weather_state &s, vec4 worldPosition, vec4 occlusionTexture) {
+        float height    = s.snow ? occlusionTexture.y : occlusionTexture.w;
+        float luminance = s.snow ? occlusionTexture.x : occlusionTexture.z;
+        float mixAmount = (worldPosition.y - height) * 25.0f;
+        vec2  lightingUVs(mix(luminance, 0.0f, mixAmount), 1.0f);
+        return texture2DClamped(s.lightmap, lightingUVs).rgb();
+    }
+
+    /* Port of rain_snow.fragment before the fast path: occluded
+     * fragments are fully shaded and get zero alpha. */
+    bool rainSnowSlow(const weather_state &s, const weather_varyings &in, vec4 &out) {
+        vec4 albedo = s.particle.sample(in.uv);
+        albedo.w *= in.color.w;
+
+        vec4 occlusionTexture = texture2DClamped(s.occlusion, in.worldPosition.xyz().xz());
+        if (occluded(s, in.worldPosition, occlusionTexture)) {
+            albedo.w = 0.0f;
+        }
+
+        vec3 rgb = albedo.rgb() * lighting(s, in.worldPosition, occlusionTexture);
+        rgb = nm::desaturate(rgb, 0.9f);
+
+        out = vec4(mix(rgb, in.fogColor.rgb(), in.fogColor.w), albedo.w);
+        return true;
+    }
+
+    /* Port of rain_snow.fragment. Return false if it discards the
+     * fragment. */
+    bool rainSnowFragment(const weather_state &s, const weather_varyings &in, vec4 &out) {
+        vec4 occlusionTexture = texture2DClamped(s.occlusion, in.worldPosition.xyz().xz());
+        if (occluded(s, in.worldPosition, occlusionTexture)) {
+            return false;
+        }
+
+        vec4 albedo = s.particle.sample(in.uv);
+        albedo.w *= in.color.w;
+
+        vec3 c   = albedo.rgb() * lighting(s, in.worldPosition, occlusionTexture);
+        vec3 rgb = mix(vec3(nm::rgb2luma(c)), c, 0.1f);
+
+        out = vec4(mix(rgb, in.fogColor.rgb(), in.fogColor.w), albedo.w);
+        return true;
+    }
+
+    std::uint32_t hash(int x, int y) {
+        std::uint32_t h = static_cast<std::uint32_t>(x) * 374761393u + static_cast<std::uint32_t>(y) * 668265263u;
+        return (h ^ (h >> 13)) * 1274126177u;
+    }
+
+    float hash01(int x, int y) {
+        return static_cast<float>((hash(x, y) >> 8) & 0xff) / 255.0f;
+    }
+
+    /* Procedural textures. Roofs are 8x8 texels and are higher than
+     * any particle. */
+    weather_state makeWeather(float sheltered, bool snow) {
+        weather_state s;
+        s.snow = snow;
+
+        s.particle.width  = 8;
+        s.particle.height = 32;
+        s.particle.texels.resize(8 * 32);
+        for (int y = 0; y < 32; y++) {
+            for (int x = 0; x < 8; x++) {
+                bool streak = (x + y / 8) % 3 == 0;
+                s.particle.texels[y * 8 + x] = vec4(0.70f, 0.80f, 1.00f, streak ? 0.4f + 0.4f * hash01(x, y) : 0.0f);
+            }
+        }
+
+        const int size = 64;
+        s.occlusion.width  = size;
+        s.occlusion.height = size;
+        s.occlusion.texels.resize(size * size);
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                bool  roof      = hash01(x / 8, y / 8 + 1000) < sheltered;
+                float height    = roof ? 1.0f : 0.25f + 0.1f * hash01(x / 2, y / 2);
+                float luminance = 0.1f + 0.6f * hash01(x, y + 2000);
+                s.occlusion.texels[y * size + x] = vec4(luminance, height, luminance, height);
+            }
+        }
+
+        s.lightmap.width  = 16;
+        s.lightmap.height = 16;
+        s.lightmap.texels.resize(16 * 16);
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < 16; x++) {
+                vec3 torch = vec3(1.00f, 0.80f, 0.60f) * (x / 15.0f);
+                vec3 sky   = vec3(0.55f, 0.60f, 0.70f) * (y / 15.0f);
+                s.lightmap.texels[y * 16 + x] = vec4(min(torch + sky, 1.0f), 1.0f);
+            }
+        }
+        return s;
+    }
+
+    /* Sheets of particles facing a camera that looks along +z over
+     * the occlusion texture, from the middle of its near edge. */
+    weather_varyings sheetVaryings(int layer, int layers, float x, float y, int width, int height) {
+        const vec4 fogColor = vec4(0.42f, 0.46f, 0.52f, 1.0f);
+
+        float z    = 0.05f + 0.9f * (layer + 0.5f) / layers;
+        float ndcX = x / width  * 2.0f - 1.0f;
+        float ndcY = y / height * 2.0f - 1.0f;
+
+        weather_varyings v;
+        v.uv            = vec2(x / width * 4.0f + layer * 0.37f, y / height * 2.0f + layer * 0.61f);
+        v.color         = vec4(1.0f, 1.0f, 1.0f, 0.9f);
+        v.worldPosition = vec4(0.5f + ndcX * z * 0.7f, 0.4f + ndcY * z * 0.4f, z, 1.0f);
+        v.fogColor      = vec4(fogColor.rgb(), 0.6f * z);
+        return v;
+    }
+
+    template <typename Shader>
+    double drawStorm(const weather_state &s, int layers, Shader shader,
+                     nm::framebuffer &fb, std::size_t &discarded) {
+        std::fill(fb.color.begin(), fb.color.end(), vec4(0.30f, 0.32f, 0.36f, 1.0f));
+        discarded = 0;
+
+        double start = nm::detail::seconds();
+        for (int layer = layers - 1; layer >= 0; layer--) {
+            for (int y = 0; y < fb.height; y++) {
+                for (int x = 0; x < fb.width; x++) {
+                    weather_varyings v = sheetVaryings(layer, layers, x + 0.5f, y + 0.5f, fb.width, fb.height);
+                    vec4 color;
+                    if (!shader(s, v, color)) {
+                        discarded++;
+                        continue;
+                    }
+                    vec4 &dst = fb.color[static_cast<std::size_t>(y) * fb.width + x];
+                    dst = vec4(mix(dst.rgb(), color.rgb(), clamp(color.w, 0.0f, 1.0f)), 1.0f);
+                }
+            }
+        }
+        return nm::detail::seconds() - start;
+    }
+
+    void usage(const char *prog) {
+        std::fprintf(stderr,
+                     "Usage: %s [--output=DIR] [--size=WxH] [--iterations=N]\n"
+                     "       [--layers=N] [--sheltered=F] [--snow]\n",
+                     prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string output;
+    int         width      = 320;
+    int         height     = 180;
+    int         iterations = 5;
+    int         layers     = 24;
+    float       sheltered  = 0.5f;
+    bool        snow       = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        }
+        else if (std::strncmp(argv[i], "--size=", 7) == 0) {
+            if (std::sscanf(argv[i] + 7, "%dx%d", &width, &height) != 2 ||
+                width < 16 || height < 16 || width > 4096 || height > 4096) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--iterations=", 13) == 0) {
+            iterations = std::atoi(argv[i] + 13);
+            if (iterations < 1) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--layers=", 9) == 0) {
+            layers = std::atoi(argv[i] + 9);
+            if (layers < 1 || layers > 1000) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--sheltered=", 12) == 0) {
+            sheltered = static_cast<float>(std::atof(argv[i] + 12));
+            if (sheltered < 0.0f || sheltered > 1.0f) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strcmp(argv[i], "--snow") == 0) {
+            snow = true;
+        }
+        else {
+            std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            usage(argv[0]);
+        }
+    }
+
+    const weather_state s = makeWeather(sheltered, snow);
+    nm::framebuffer     slowFB(width, height), fastFB(width, height);
+    double              slowT = 0.0, fastT = 0.0;
+    std::size_t         slowDiscarded = 0, fastDiscarded = 0;
+
+    /* Interleaved for the same reason as nm-golden. */
+    for (int i = 0; i < iterations; i++) {
+        double tSlow = drawStorm(s, layers, rainSnowSlow,     slowFB, slowDiscarded);
+        double tFast = drawStorm(s, layers, rainSnowFragment, fastFB, fastDiscarded);
+        if (i == 0 || tSlow < slowT) {
+            slowT = tSlow;
+        }
+        if (i == 0 || tFast < fastT) {
+            fastT = tFast;
+        }
+    }
+
+    image slow = nm::toImage(slowFB);
+    image fast = nm::toImage(fastFB);
+    int   diff = 0;
+    for (std::size_t i = 0; i < slow.rgb.size(); i++) {
+        diff = std::max(diff, std::abs(slow.rgb[i] - fast.rgb[i]));
+    }
+
+    if (!output.empty() && !nm::writeTGA(output + "/storm.tga", fast)) {
+        return 1;
+    }
+
+    const double fragments = static_cast<double>(width) * height * layers;
+    std::printf("%dx%d, %d layers, %.0f fragments, %.1f%% occluded\n\n",
+                width, height, layers, fragments, 100.0 * fastDiscarded / fragments);
+    std::printf("%-8s %10s %12s\n", "shader", "ms", "ns/fragment");
+    std::printf("%-8s %10.2f %12.2f\n", "before", slowT * 1000.0, slowT * 1e9 / fragments);
+    std::printf("%-8s %10.2f %12.2f\n", "current", fastT * 1000.0, fastT * 1e9 / fragments);
+    std::printf("\nspeedup %.2fx, largest difference %d\n", slowT / fastT, diff);
+
+    return diff > 1 ? 1 : 0;
+}
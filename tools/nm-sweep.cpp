@@ -0,0 +1,165 @@
+// -*- c++ -*-
+/* nm-sweep: Render a scene through a whole day, in clear weather and
+ * in rain.
+ *
+ * A change to the shaders rarely breaks the scene it was tuned for,
+ * but often breaks another time of day or the rain. This program
+ * renders a scene of nm-golden or a capture of nm-capture at evenly
+ * spaced times of day, each of them with and without rain, using all
+ * of the cores. Only the geometry and the camera come from the scene
+ * or the capture: the fog, the sky, and the daylight are interpolated
+ * between the day, dusk, night, and rain scenes.
+ *
+ * Usage: nm-sweep [--scene=NAME | CAPTURE] [--output=DIR] [--size=WxH]
+ *                 [--steps=N] [--threads=N] [CONFIGURE-OPTION]...
+ *
+ * The scene defaults to "day". --steps is the number of times of day
+ * (default 8, i.e. every 3 hours starting at midnight). With --output
+ * the images are written to DIR/HHMM-WEATHER.tga. --size only
+ * applies to scenes, as captures have their own size. --threads
+ * defaults to 0, which means one thread per core. CONFIGURE-OPTION is
+ * the same as that of nm-golden.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "nm-capture.hpp"
+#include "nm-image.hpp"
+#include "nm-scenes.hpp"
+
+using namespace glsl;
+
+namespace {
+    void usage(const char *prog) {
+        std::fprintf(stderr,
+                     "Usage: %s [--scene=NAME | CAPTURE] [--output=DIR] [--size=WxH]\n"
+                     "       [--steps=N] [--threads=N] [CONFIGURE-OPTION]...\n",
+                     prog);
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string sceneName;
+    std::string path;
+    std::string output;
+    int         width   = 320;
+    int         height  = 180;
+    int         steps   = 8;
+    int         threads = 0;
+    nm::config  cfg;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--scene=", 8) == 0) {
+            sceneName = argv[i] + 8;
+        }
+        else if (std::strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        }
+        else if (std::strncmp(argv[i], "--size=", 7) == 0) {
+            if (std::sscanf(argv[i] + 7, "%dx%d", &width, &height) != 2 ||
+                width < 16 || height < 16 || width > 4096 || height > 4096) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--steps=", 8) == 0) {
+            steps = std::atoi(argv[i] + 8);
+            if (steps < 1) {
+                usage(argv[0]);
+            }
+        }
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = std::atoi(argv[i] + 10);
+            if (threads < 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (argv[i][0] != '-' && path.empty()) {
+            path = argv[i];
+        }
+        else if (!cfg.parse(argv[i])) {
+            std::fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            usage(argv[0]);
+        }
+    }
+    if (!sceneName.empty() && !path.empty()) {
+        usage(argv[0]);
+    }
+
+    /* The frame to sweep, and the camera looking at it. */
+    std::unique_ptr<nm::scene>  s;
+    std::unique_ptr<nm::camera> capCam;
+    nm::capture                 cap;
+    const nm::frame            *source;
+    const nm::camera           *cam;
+    if (path.empty()) {
+        const nm::scene_desc *desc = nm::findScene(sceneName.empty() ? "day" : sceneName);
+        if (!desc) {
+            std::fprintf(stderr, "%s: unknown scene: %s\n", argv[0], sceneName.c_str());
+            return 1;
+        }
+        s.reset(new nm::scene(*desc, width, height));
+        source = &s->get();
+        cam    = &s->cam();
+    }
+    else {
+        if (!cap.open(path)) {
+            return 1;
+        }
+        const nm::capture_view &v = cap.view();
+        capCam.reset(new nm::camera(v.width, v.height, v.yaw, v.pitch, v.fovY));
+        source = &cap.get();
+        cam    = capCam.get();
+    }
+
+    nm::renderer    r(cfg, *cam, static_cast<unsigned>(threads));
+    nm::framebuffer fb(cam->width, cam->height);
+    nm::frame       f = *source;
+
+    std::printf("%dx%d, %zu draws, %u threads\n\n", cam->width, cam->height, f.draws.size(), r.threads());
+    std::printf("%5s %-7s %10s %10s %10s %10s %10s\n",
+                "time", "weather", "wall ms", "vertex ms", "setup ms", "terrain ms", "sky ms");
+
+    nm::stage_timings total;
+    double            start = nm::detail::seconds();
+    for (int step = 0; step < steps; step++) {
+        float hour = 24.0f * step / steps;
+        int   hhmm = static_cast<int>(hour) * 100 + static_cast<int>((hour - std::floor(hour)) * 60.0f);
+        for (int rain = 0; rain <= 1; rain++) {
+            const char *weather = rain ? "rain" : "clear";
+
+            nm::setWeather(hour, static_cast<float>(rain), f.sky);
+            for (nm::draw &d: f.draws) {
+                nm::setWeather(hour, static_cast<float>(rain), d.u);
+            }
+
+            double            frameStart = nm::detail::seconds();
+            nm::stage_timings t          = r.render(f, fb);
+            double            wall       = nm::detail::seconds() - frameStart;
+            total += t;
+
+            std::printf("%02d:%02d %-7s %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                        hhmm / 100, hhmm % 100, weather, wall * 1000.0,
+                        t.vertex * 1000.0, t.setup * 1000.0, t.terrain * 1000.0, t.sky * 1000.0);
+
+            if (!output.empty()) {
+                char name[32];
+                std::snprintf(name, sizeof(name), "/%04d-%s.tga", hhmm, weather);
+                if (!nm::writeTGA(output + name, nm::toImage(fb))) {
+                    return 1;
+                }
+            }
+        }
+    }
+    double elapsed = nm::detail::seconds() - start;
+
+    std::printf("\n%d frames in %.2f s (%.2f frames/s), CPU time: vertex %.2f s, setup %.2f s, "
+                "terrain %.2f s, sky %.2f s\n",
+                steps * 2, elapsed, steps * 2 / elapsed,
+                total.vertex, total.setup, total.terrain, total.sky);
+    return 0;
+}